@@ -14,7 +14,7 @@ class SimHDF5Detector(AsynPort):
     # This tells xmlbuilder to use PORT instead of name as the row ID
     UniqueName = "PORT"
     _SpecificTemplate = SimHDF5DetectorTemplate
-    def __init__(self, PORT, MEMORY = 0, **args):
+    def __init__(self, PORT, MEMORY = 0, READER_WORKERS = 0, **args):
         # Init the superclass (AsynPort)
         self.__super.__init__(PORT)
         # Update the attributes of self from the commandline args
@@ -25,14 +25,19 @@ class SimHDF5Detector(AsynPort):
     # __init__ arguments
     ArgInfo = ADBaseTemplate.ArgInfo + _SpecificTemplate.ArgInfo + makeArgInfo(__init__,
         PORT = Simple('Port name for the detector', str),
-        MEMORY = Simple('Max memory to allocate, should be maxw*maxh*nbuffer for driver and all attached plugins', int))
+        MEMORY = Simple('Max memory to allocate, should be maxw*maxh*nbuffer for driver and all attached plugins', int),
+        READER_WORKERS = Simple('Number of worker processes forked to read frames when the process reader is selected, 0 for none', int))
 
     # Device attributes
     LibFileList = ['simHDF5Detector']
     DbdFileList = ['simHDF5Support']
 
     def Initialise(self):
-        print '# SimHDF5DetectorConfig(portName, maxBuffers, maxMemory )'
-        print 'SimHDF5DetectorConfig( %(PORT)10s, 0, %(MEMORY)9d )' % self.__dict__
+        print '# SimHDF5DetectorConfig(portName, maxBuffers, maxMemory, priority, stackSize, readerWorkers )'
+        print 'SimHDF5DetectorConfig( %(PORT)10s, 0, %(MEMORY)9d, 0, 0, %(READER_WORKERS)d )' % self.__dict__
+
+class SimHDF5DetectorROI(AutoSubstitution):
+    """Region of each frame published on its own asyn address of a SimHDF5Detector"""
+    TemplateFile = "simHDF5DetectorROI.template"
 
 
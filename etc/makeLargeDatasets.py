@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+"""Write HDF5 files that exercise 64-bit sizes and frame indexes.
+
+Two datasets are written:
+
+  /entry/bytes   frames of --width x --height uint16 pixels, enough of them
+                 that the dataset holds more than 2^31 bytes
+  /entry/frames  2^31 + --extra frames of 1 x 1 uint8 pixels
+
+Both are chunked one frame per chunk.  Only a few marker frames are written
+unless --dense is given, so the files stay small while the dataset sizes
+are not, and every unwritten frame reads back as the fill value 0.  With
+--dense the other frames of /entry/bytes are filled with 0xffff.
+
+Every pixel of the n'th marker frame is set to n + 1.  The markers past the
+32-bit limits are placed so that the frame a truncated index or byte offset
+lands on is unwritten, so a reader that loses the high bits returns 0.  The
+marker frame numbers are printed and stored in the "markers" attribute of
+each dataset.
+
+Usage: makeLargeDatasets.py [--dense] [--width W] [--height H] [--extra N] file.h5
+"""
+
+from __future__ import print_function
+
+import argparse
+
+import h5py
+import numpy
+
+
+LIMIT = 2 ** 31
+
+
+def write_markers(dset, markers):
+    """Write the marker frames of a dataset and record where they are."""
+    frame_shape = dset.shape[1:]
+    for number, frame in enumerate(markers):
+        dset[frame] = numpy.full(frame_shape, number + 1, dset.dtype)
+    dset.attrs["markers"] = numpy.array(markers, numpy.uint64)
+    print("%s %s %s markers at frames %s" % (dset.name, dset.shape, dset.dtype,
+                                             ", ".join(str(m) for m in markers)))
+
+
+def make_bytes(group, width, height, dense):
+    frame_bytes = width * height * 2
+    nframes = LIMIT // frame_bytes + 2
+    dset = group.create_dataset("bytes", (nframes, height, width), numpy.uint16,
+                                chunks=(1, height, width), fillvalue=0)
+    # The last frames start past 2 GiB from the start of the dataset
+    markers = [0, nframes // 2, nframes - 2, nframes - 1]
+    if dense:
+        # Fill the other frames with a value no marker uses
+        for frame in range(nframes):
+            if frame not in markers:
+                dset[frame] = numpy.full((height, width), 0xffff, dset.dtype)
+    write_markers(dset, markers)
+
+
+def make_frames(group, extra):
+    nframes = LIMIT + extra
+    dset = group.create_dataset("frames", (nframes, 1, 1), numpy.uint8,
+                                chunks=(1, 1, 1), fillvalue=0)
+    # Frame 2^31 - 1 is the last a 32-bit signed index reaches, the rest are beyond it
+    markers = [0, LIMIT - 1, LIMIT + 1, nframes - 1]
+    write_markers(dset, markers)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write HDF5 datasets over 2^31 bytes and over 2^31 frames")
+    parser.add_argument("filename", help="HDF5 file to create")
+    parser.add_argument("--width", type=int, default=2048, help="width of the frames of /entry/bytes")
+    parser.add_argument("--height", type=int, default=2048, help="height of the frames of /entry/bytes")
+    parser.add_argument("--extra", type=int, default=16, help="frames of /entry/frames beyond 2^31")
+    parser.add_argument("--dense", action="store_true",
+                        help="write every frame of /entry/bytes so that the whole dataset is stored")
+    args = parser.parse_args()
+
+    with h5py.File(args.filename, "w") as f:
+        group = f.create_group("entry")
+        make_bytes(group, args.width, args.height, args.dense)
+        make_frames(group, args.extra)
+
+
+if __name__ == "__main__":
+    main()
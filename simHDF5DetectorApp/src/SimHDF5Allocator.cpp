@@ -0,0 +1,135 @@
+/*
+ * SimHDF5Allocator.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "SimHDF5Allocator.h"
+#include <NDArray.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <map>
+
+// Alignments in bytes of the SimHDF5Align_t values
+#define SIMHDF5_PAGE_ALIGN      4096
+#define SIMHDF5_HUGE_PAGE_ALIGN (2 * 1024 * 1024)
+
+static int policyAlignment = SimHDF5AlignDefault;
+static bool policyHugePages = false;
+static int fallbacks = 0;
+static bool installed = false;
+static epicsThreadOnceId allocatorOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId allocatorMutex = 0;
+// Sizes of the buffers mapped with MAP_HUGETLB, which must be unmapped rather than freed
+static std::map<void *, size_t> hugeMappings;
+
+/** Create the mutex that protects the allocation policy, run once. */
+static void createAllocator(void *arg)
+{
+  allocatorMutex = epicsMutexMustCreate();
+}
+
+/** Select how frame buffers are allocated.
+  * \param[in] alignment one of the SimHDF5Align_t values
+  * \param[in] hugePages map buffers with MAP_HUGETLB
+  *
+  * The frame memory functions are installed the first time a policy other
+  * than the default is selected.  Buffers already in the pool are not
+  * reallocated, so the caller should empty the free list.
+  */
+void SimHDF5Allocator::setPolicy(int alignment, bool hugePages)
+{
+  epicsThreadOnce(&allocatorOnce, createAllocator, NULL);
+  epicsMutexLock(allocatorMutex);
+  if (!installed){
+    if (alignment == SimHDF5AlignDefault && !hugePages){
+      epicsMutexUnlock(allocatorMutex);
+      return;
+    }
+    NDArrayPool::setDefaultFrameMemoryFunctions(frameMalloc, frameFree);
+    installed = true;
+  }
+  policyAlignment = alignment;
+  policyHugePages = hugePages;
+  fallbacks = 0;
+  epicsMutexUnlock(allocatorMutex);
+}
+
+/** Number of huge page buffers that used normal pages since the policy was set.
+  *
+  */
+int SimHDF5Allocator::hugePageFallbacks()
+{
+  epicsThreadOnce(&allocatorOnce, createAllocator, NULL);
+  epicsMutexLock(allocatorMutex);
+  int count = fallbacks;
+  epicsMutexUnlock(allocatorMutex);
+  return count;
+}
+
+/** Allocate a frame buffer according to the current policy.
+  * \param[in] size size of the buffer in bytes
+  * \return the buffer, or NULL if it cannot be allocated.
+  */
+void *SimHDF5Allocator::frameMalloc(size_t size)
+{
+  void *ptr = NULL;
+  epicsMutexLock(allocatorMutex);
+  int alignment = policyAlignment;
+  if (policyHugePages){
+    size_t length = (size + SIMHDF5_HUGE_PAGE_ALIGN - 1) & ~(size_t)(SIMHDF5_HUGE_PAGE_ALIGN - 1);
+    ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED){
+      hugeMappings[ptr] = length;
+      epicsMutexUnlock(allocatorMutex);
+      return ptr;
+    }
+    // No huge pages are reserved, ask for transparent huge pages instead
+    ptr = NULL;
+    fallbacks++;
+    alignment = SimHDF5Align2M;
+  }
+  epicsMutexUnlock(allocatorMutex);
+
+  switch (alignment){
+    case SimHDF5Align4K:
+      if (posix_memalign(&ptr, SIMHDF5_PAGE_ALIGN, size) != 0){
+        ptr = NULL;
+      }
+      break;
+    case SimHDF5Align2M:
+      if (posix_memalign(&ptr, SIMHDF5_HUGE_PAGE_ALIGN, size) != 0){
+        ptr = NULL;
+      } else if (size >= SIMHDF5_HUGE_PAGE_ALIGN){
+        madvise(ptr, size & ~(size_t)(SIMHDF5_HUGE_PAGE_ALIGN - 1), MADV_HUGEPAGE);
+      }
+      break;
+    default:
+      ptr = malloc(size);
+      break;
+  }
+  return ptr;
+}
+
+/** Free a frame buffer.
+  * \param[in] ptr buffer allocated by frameMalloc or by malloc
+  */
+void SimHDF5Allocator::frameFree(void *ptr)
+{
+  if (!ptr){
+    return;
+  }
+  epicsMutexLock(allocatorMutex);
+  std::map<void *, size_t>::iterator iter = hugeMappings.find(ptr);
+  if (iter != hugeMappings.end()){
+    size_t length = iter->second;
+    hugeMappings.erase(iter);
+    epicsMutexUnlock(allocatorMutex);
+    munmap(ptr, length);
+    return;
+  }
+  epicsMutexUnlock(allocatorMutex);
+  free(ptr);
+}
@@ -0,0 +1,39 @@
+/*
+ * SimHDF5Allocator.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5ALLOCATOR_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5ALLOCATOR_H_
+
+#include <stddef.h>
+
+/** Enumeration of the alignments available for NDArray buffers */
+typedef enum
+{
+  SimHDF5AlignDefault,        // Buffers are allocated with malloc
+  SimHDF5Align4K,             // Buffers start on a 4 KiB page boundary
+  SimHDF5Align2M              // Buffers start on a 2 MiB boundary and may use transparent huge pages
+} SimHDF5Align_t;
+
+/** Allocation policy for NDArray frame buffers.
+  *
+  * Installed as the NDArrayPool frame memory functions, so the policy
+  * applies to every pool in the IOC and the last detector to set it wins.
+  * Aligned buffers suit SIMD code downstream and allow O_DIRECT reads
+  * straight into the buffer.  Huge page buffers are mapped with MAP_HUGETLB
+  * and fall back to 2 MiB aligned memory when no huge pages are reserved.
+  * Buffers are always freed the way they were allocated, so the policy can
+  * be changed while buffers are in use.
+  */
+class SimHDF5Allocator
+{
+public:
+  static void setPolicy(int alignment, bool hugePages);
+  static int hugePageFallbacks();
+  static void *frameMalloc(size_t size);
+  static void frameFree(void *ptr);
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5ALLOCATOR_H_ */
@@ -0,0 +1,881 @@
+/*
+ * SimHDF5ChunkEngine.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "SimHDF5ChunkEngine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef __linux__
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+#define SIMHDF5_HAVE_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// Alignment used for buffers and file offsets when O_DIRECT is in use
+#define SIMHDF5_DIRECT_ALIGN 4096
+
+// Largest chunk table that will be built for a dataset
+#define SIMHDF5_MAX_CHUNKS (1 << 24)
+
+/** Constructor.
+  * \param[in] queueDepth maximum number of chunk reads to keep in flight.
+  * \param[in] directIO open the file with O_DIRECT to bypass the page cache.
+  * \param[in] readahead number of frames the reader prefetches ahead.
+  */
+SimHDF5ChunkEngine::SimHDF5ChunkEngine(int queueDepth, bool directIO, int readahead) :
+  queueDepth(queueDepth < 1 ? 1 : queueDepth),
+  readahead(readahead < 0 ? 0 : readahead),
+  directIO(directIO),
+  fd(-1),
+  dset(-1),
+  ndims(0),
+  elementSize(0),
+  deflate(false),
+  contiguous(false),
+  dataOffset(HADDR_UNDEF),
+  chunkBytes(0),
+  cacheLimit(0),
+  frameChunks(0),
+  useCounter(0),
+  hintCounter(0),
+  inFlight(0),
+  ringFd(-1),
+  sqRing(0),
+  cqRing(0),
+  sqes(0),
+  sqRingSize(0),
+  cqRingSize(0),
+  sqesSize(0),
+  sqEntries(0),
+  sqHead(0),
+  sqTail(0),
+  sqMask(0),
+  sqArray(0),
+  cqHead(0),
+  cqTail(0),
+  cqMask(0),
+  cqes(0),
+  toSubmit(0)
+{
+}
+
+/** Destructor.
+  *
+  */
+SimHDF5ChunkEngine::~SimHDF5ChunkEngine()
+{
+  close();
+}
+
+/** Prepare to read a dataset.
+  * \param[in] filename full path of the file containing the dataset.
+  * \param[in] dset open HDF5 dataset.
+  * \param[in] ntype native memory type of the dataset.
+  * \return true if the dataset can be served by this engine.
+  */
+bool SimHDF5ChunkEngine::open(const std::string& filename, hid_t dset, hid_t ntype)
+{
+  close();
+
+  // The raw bytes are copied without conversion, so the file type must
+  // already be the native type
+  hid_t ftype = H5Dget_type(dset);
+  bool native = (H5Tequal(ftype, ntype) > 0);
+  H5Tclose(ftype);
+  if (!native){
+    printf("Chunk engine: dataset is not stored in native byte order\n");
+    return false;
+  }
+
+  hid_t dspace = H5Dget_space(dset);
+  ndims = H5Sget_simple_extent_ndims(dspace);
+  dims.assign(ndims, 0);
+  H5Sget_simple_extent_dims(dspace, &dims[0], NULL);
+  H5Sclose(dspace);
+  elementSize = H5Tget_size(ntype);
+
+  bool supported = true;
+  hid_t dcpl = H5Dget_create_plist(dset);
+  H5D_layout_t layout = H5Pget_layout(dcpl);
+  chunkDims.assign(ndims, 1);
+  if (layout == H5D_CHUNKED){
+    H5Pget_chunk(dcpl, ndims, &chunkDims[0]);
+    contiguous = false;
+    int nfilters = H5Pget_nfilters(dcpl);
+    if (nfilters == 1){
+      unsigned flags = 0;
+      size_t nelmts = 0;
+      H5Z_filter_t filter = H5Pget_filter2(dcpl, 0, &flags, &nelmts, NULL, 0, NULL, NULL);
+      deflate = (filter == H5Z_FILTER_DEFLATE);
+      supported = deflate;
+    } else {
+      deflate = false;
+      supported = (nfilters == 0);
+    }
+  } else if (layout == H5D_CONTIGUOUS && ndims >= 2){
+    // Treat each plane of the last two dimensions as a chunk
+    contiguous = true;
+    deflate = false;
+    chunkDims[ndims-2] = dims[ndims-2];
+    chunkDims[ndims-1] = dims[ndims-1];
+    dataOffset = H5Dget_offset(dset);
+    supported = (dataOffset != HADDR_UNDEF);
+  } else {
+    supported = false;
+  }
+  H5Pclose(dcpl);
+  if (!supported){
+    printf("Chunk engine: dataset layout or filters are not supported\n");
+    return false;
+  }
+
+  size_t total = 1;
+  gridDims.assign(ndims, 0);
+  chunkBytes = elementSize;
+  for (int index = 0; index < ndims; index++){
+    gridDims[index] = (dims[index] + chunkDims[index] - 1) / chunkDims[index];
+    total *= gridDims[index];
+    chunkBytes *= chunkDims[index];
+  }
+  if (total > SIMHDF5_MAX_CHUNKS){
+    printf("Chunk engine: dataset has too many chunks (%lu)\n", (unsigned long)total);
+    return false;
+  }
+  ChunkInfo unknown = {false, HADDR_UNDEF, 0, 0};
+  chunks.assign(total, unknown);
+
+  // Open our own descriptor, falling back to buffered reads if the
+  // filesystem refuses O_DIRECT
+  fd = -1;
+  if (directIO){
+    fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+    if (fd < 0){
+      printf("Chunk engine: O_DIRECT not available, using buffered reads\n");
+      directIO = false;
+    }
+  }
+  if (fd < 0){
+    fd = ::open(filename.c_str(), O_RDONLY);
+  }
+  if (fd < 0){
+    printf("Chunk engine: unable to open %s\n", filename.c_str());
+    return false;
+  }
+
+  this->dset = dset;
+  frameChunks = 0;
+  sizeCache(1);
+  if (!setupRing()){
+    printf("Chunk engine: io_uring not available, using synchronous reads\n");
+  }
+  return true;
+}
+
+/** Release the file, the ring and all chunk buffers.
+  *
+  */
+void SimHDF5ChunkEngine::close()
+{
+  // Wait for any outstanding reads before freeing their buffers
+  while (inFlight > 0 && ringFd >= 0){
+    if (enterRing(toSubmit, 1) < 0 && errno != EINTR){
+      break;
+    }
+    reapRing();
+  }
+  closeRing();
+  std::map<size_t, ChunkBuffer *>::iterator iter;
+  for (iter = cache.begin(); iter != cache.end(); ++iter){
+    release(iter->second);
+  }
+  cache.clear();
+  for (size_t index = 0; index < spare.size(); index++){
+    release(spare[index]);
+  }
+  spare.clear();
+  chunks.clear();
+  if (fd >= 0){
+    ::close(fd);
+    fd = -1;
+  }
+  dset = -1;
+  inFlight = 0;
+}
+
+/** Are reads being batched through io_uring.
+  * \return false if synchronous reads are in use.
+  */
+bool SimHDF5ChunkEngine::usingUring()
+{
+  return ringFd >= 0;
+}
+
+/** Start reading the chunks for a frame without waiting for them.
+  * \param[in] start first element of the frame in each dimension.
+  * \param[in] count number of elements of the frame in each dimension.
+  */
+void SimHDF5ChunkEngine::prefetchFrame(const hsize_t *start, const hsize_t *count)
+{
+  if (fd < 0){
+    return;
+  }
+  std::vector<size_t> touched;
+  touchedChunks(start, count, touched);
+  sizeCache(touched.size());
+  hintCounter++;
+  for (size_t index = 0; index < touched.size(); index++){
+    request(touched[index])->hint = hintCounter;
+  }
+  if (toSubmit > 0){
+    enterRing(toSubmit, 0);
+  }
+}
+
+/** Read a frame.
+  * \param[in] start first element of the frame in each dimension.
+  * \param[in] count number of elements of the frame in each dimension.
+  * \param[in] wdim dimension used for the image width.
+  * \param[in] hdim dimension used for the image height.
+  * \param[out] data buffer for count[hdim]*count[wdim] elements.
+  * \return false if the frame could not be read and H5Dread should be used.
+  *
+  * All chunks for the frame are submitted as one batch, then each one is
+  * waited for, decoded and the rows covered by the frame copied out.  The
+  * prefetch hint for the frame is then consumed, while chunks that a later
+  * hint also asked for stay protected from eviction.
+  */
+bool SimHDF5ChunkEngine::readFrame(const hsize_t *start, const hsize_t *count, int wdim, int hdim, void *data)
+{
+  if (fd < 0 || wdim != ndims-1 || hdim >= wdim){
+    return false;
+  }
+  for (int index = 0; index < ndims; index++){
+    if (index != wdim && index != hdim && count[index] != 1){
+      return false;
+    }
+  }
+
+  std::vector<size_t> touched;
+  touchedChunks(start, count, touched);
+  bool whole = (touched.size() == 1);
+  for (int index = 0; index < ndims && whole; index++){
+    whole = (count[index] == chunkDims[index]);
+  }
+  if (whole && readWhole(touched[0], data)){
+    return true;
+  }
+  sizeCache(touched.size());
+  std::vector<ChunkBuffer *> buffers;
+  for (size_t index = 0; index < touched.size(); index++){
+    buffers.push_back(request(touched[index]));
+    buffers.back()->pinned = true;
+  }
+  if (toSubmit > 0){
+    enterRing(toSubmit, 0);
+  }
+
+  // Element strides within a chunk
+  hsize_t strides[ndims];
+  strides[ndims-1] = 1;
+  for (int index = ndims-2; index >= 0; index--){
+    strides[index] = strides[index+1] * chunkDims[index+1];
+  }
+
+  char *out = (char *)data;
+  hsize_t origin[ndims];
+  bool success = true;
+  for (size_t c = 0; c < buffers.size(); c++){
+    ChunkBuffer *buffer = buffers[c];
+    wait(buffer);
+    const char *plain = decode(buffer);
+    if (!plain){
+      success = false;
+      break;
+    }
+    buffer->lastUse = ++useCounter;
+    chunkCoords(buffer->index, origin);
+
+    // Offset within the chunk of the fixed frame dimensions
+    size_t base = 0;
+    for (int index = 0; index < ndims; index++){
+      if (index != wdim && index != hdim){
+        base += (start[index] - origin[index]) * strides[index];
+      }
+    }
+    hsize_t y0 = start[hdim] > origin[hdim] ? start[hdim] : origin[hdim];
+    hsize_t y1 = start[hdim] + count[hdim];
+    if (y1 > origin[hdim] + chunkDims[hdim]){
+      y1 = origin[hdim] + chunkDims[hdim];
+    }
+    hsize_t x0 = start[wdim] > origin[wdim] ? start[wdim] : origin[wdim];
+    hsize_t x1 = start[wdim] + count[wdim];
+    if (x1 > origin[wdim] + chunkDims[wdim]){
+      x1 = origin[wdim] + chunkDims[wdim];
+    }
+    size_t rowBytes = (x1 - x0) * elementSize;
+    for (hsize_t y = y0; y < y1; y++){
+      size_t src = base + (y - origin[hdim]) * strides[hdim] + (x0 - origin[wdim]);
+      size_t dst = (y - start[hdim]) * count[wdim] + (x0 - start[wdim]);
+      memcpy(out + dst * elementSize, plain + src * elementSize, rowBytes);
+    }
+  }
+  for (size_t c = 0; c < buffers.size(); c++){
+    buffers[c]->pinned = false;
+    if (buffers[c]->hint != 0 && hintCounter - buffers[c]->hint >= (unsigned long)readahead){
+      buffers[c]->hint = 0;
+    }
+  }
+  return success;
+}
+
+/** Read a chunk that forms a whole frame straight into the frame buffer.
+  * \param[in] index linear index of the chunk in the chunk grid.
+  * \param[out] data buffer for the frame.
+  * \return false if the chunk must be read through a chunk buffer instead.
+  *
+  * Only used for frames that cover the whole chunk when the chunk is
+  * stored uncompressed and is not already cached or being prefetched.
+  * With O_DIRECT the chunk offset and size and the buffer must all be
+  * aligned.
+  */
+bool SimHDF5ChunkEngine::readWhole(size_t index, void *data)
+{
+  if (cache.count(index) > 0){
+    return false;
+  }
+  ChunkInfo& info = chunkInfo(index);
+  if (info.addr == HADDR_UNDEF || info.size != chunkBytes || (deflate && !(info.mask & 1))){
+    return false;
+  }
+  if (directIO && ((info.addr % SIMHDF5_DIRECT_ALIGN) != 0 ||
+                   (chunkBytes % SIMHDF5_DIRECT_ALIGN) != 0 ||
+                   ((size_t)data % SIMHDF5_DIRECT_ALIGN) != 0)){
+    return false;
+  }
+  size_t done = 0;
+  while (done < chunkBytes){
+    ssize_t result = pread(fd, (char *)data + done, chunkBytes - done, (off_t)info.addr + done);
+    if (result < 0 && errno == EINTR){
+      continue;
+    }
+    if (result <= 0){
+      return false;
+    }
+    done += result;
+  }
+  return true;
+}
+
+/** Look up the location of a chunk, querying HDF5 the first time only.
+  * \param[in] index linear index of the chunk in the chunk grid.
+  */
+SimHDF5ChunkEngine::ChunkInfo& SimHDF5ChunkEngine::chunkInfo(size_t index)
+{
+  ChunkInfo& info = chunks[index];
+  if (!info.known){
+    if (contiguous){
+      info.addr = dataOffset + (haddr_t)index * chunkBytes;
+      info.size = chunkBytes;
+      info.mask = 0;
+    } else {
+      hsize_t coord[ndims];
+      chunkCoords(index, coord);
+      if (H5Dget_chunk_info_by_coord(dset, coord, &info.mask, &info.addr, &info.size) < 0){
+        info.addr = HADDR_UNDEF;
+        info.size = 0;
+      }
+    }
+    info.known = true;
+  }
+  return info;
+}
+
+/** Calculate the first element of a chunk in each dimension.
+  * \param[in] index linear index of the chunk in the chunk grid.
+  * \param[out] coord element coordinates of the chunk origin.
+  */
+void SimHDF5ChunkEngine::chunkCoords(size_t index, hsize_t *coord)
+{
+  for (int dim = ndims-1; dim >= 0; dim--){
+    coord[dim] = (index % gridDims[dim]) * chunkDims[dim];
+    index /= gridDims[dim];
+  }
+}
+
+/** List the chunks touched by a region, in file order.
+  * \param[in] start first element of the region in each dimension.
+  * \param[in] count number of elements of the region in each dimension.
+  * \param[out] touched linear chunk indexes.
+  */
+void SimHDF5ChunkEngine::touchedChunks(const hsize_t *start, const hsize_t *count, std::vector<size_t>& touched)
+{
+  hsize_t first[ndims];
+  hsize_t last[ndims];
+  hsize_t cur[ndims];
+  for (int index = 0; index < ndims; index++){
+    first[index] = start[index] / chunkDims[index];
+    last[index] = (start[index] + count[index] - 1) / chunkDims[index];
+    cur[index] = first[index];
+  }
+  bool done = false;
+  while (!done){
+    size_t linear = 0;
+    for (int index = 0; index < ndims; index++){
+      linear = linear * gridDims[index] + cur[index];
+    }
+    touched.push_back(linear);
+    done = true;
+    for (int index = ndims-1; index >= 0; index--){
+      if (++cur[index] <= last[index]){
+        done = false;
+        break;
+      }
+      cur[index] = first[index];
+    }
+  }
+}
+
+/** Return the buffer for a chunk, starting a read if it is not cached.
+  * \param[in] index linear index of the chunk in the chunk grid.
+  */
+SimHDF5ChunkEngine::ChunkBuffer *SimHDF5ChunkEngine::request(size_t index)
+{
+  std::map<size_t, ChunkBuffer *>::iterator iter = cache.find(index);
+  if (iter != cache.end()){
+    iter->second->lastUse = ++useCounter;
+    return iter->second;
+  }
+  ChunkBuffer *buffer = allocate(index);
+  cache[index] = buffer;
+  submit(buffer);
+  return buffer;
+}
+
+/** Size the chunk cache for the frames prefetched ahead of the reader.
+  * \param[in] chunks number of chunks touched by a frame.
+  *
+  * The cache holds the chunks of the frame being read and of every frame
+  * in the readahead window, with room for a full queue of reads on top.
+  */
+void SimHDF5ChunkEngine::sizeCache(size_t chunks)
+{
+  if (chunks > frameChunks){
+    frameChunks = chunks;
+    cacheLimit = (readahead + 1) * frameChunks + queueDepth;
+  }
+}
+
+/** Can a cached chunk be evicted.
+  * \param[in] buffer chunk buffer in the cache.
+  * \return false if the chunk is in flight, being copied out, or was
+  * prefetched for a frame in the readahead window that has not been read.
+  */
+bool SimHDF5ChunkEngine::evictable(ChunkBuffer *buffer)
+{
+  if (buffer->inFlight || buffer->pinned){
+    return false;
+  }
+  return buffer->hint == 0 || hintCounter - buffer->hint > (unsigned long)readahead;
+}
+
+/** Obtain a buffer large enough for a chunk, evicting the oldest idle chunk if the cache is full.
+  * \param[in] index linear index of the chunk in the chunk grid.
+  *
+  * If every cached chunk is protected the cache grows past its limit.
+  */
+SimHDF5ChunkEngine::ChunkBuffer *SimHDF5ChunkEngine::allocate(size_t index)
+{
+  while (cache.size() >= cacheLimit){
+    std::map<size_t, ChunkBuffer *>::iterator oldest = cache.end();
+    std::map<size_t, ChunkBuffer *>::iterator iter;
+    for (iter = cache.begin(); iter != cache.end(); ++iter){
+      if (evictable(iter->second) && (oldest == cache.end() || iter->second->lastUse < oldest->second->lastUse)){
+        oldest = iter;
+      }
+    }
+    if (oldest == cache.end()){
+      if (inFlight == 0){
+        break;
+      }
+      // Wait for a read to finish, it may free a chunk
+      if (enterRing(toSubmit, 1) < 0 && errno != EINTR){
+        break;
+      }
+      reapRing();
+      continue;
+    }
+    spare.push_back(oldest->second);
+    cache.erase(oldest);
+  }
+
+  ChunkInfo& info = chunkInfo(index);
+  size_t skip = 0;
+  size_t needed = 0;
+  size_t length = 0;
+  off_t offset = 0;
+  if (info.addr != HADDR_UNDEF){
+    offset = (off_t)info.addr;
+    needed = info.size;
+    length = info.size;
+    if (directIO){
+      // O_DIRECT needs the offset, length and buffer to be aligned
+      offset = (off_t)(info.addr & ~(haddr_t)(SIMHDF5_DIRECT_ALIGN-1));
+      skip = (size_t)(info.addr - offset);
+      needed = skip + info.size;
+      length = (needed + SIMHDF5_DIRECT_ALIGN - 1) & ~(size_t)(SIMHDF5_DIRECT_ALIGN-1);
+    }
+  }
+
+  ChunkBuffer *buffer = 0;
+  if (!spare.empty()){
+    buffer = spare.back();
+    spare.pop_back();
+  } else {
+    buffer = new ChunkBuffer;
+    buffer->raw = 0;
+    buffer->capacity = 0;
+    buffer->inflated = 0;
+  }
+  if (buffer->capacity < length){
+    free(buffer->raw);
+    buffer->raw = 0;
+    if (posix_memalign((void **)&buffer->raw, SIMHDF5_DIRECT_ALIGN, length) != 0){
+      buffer->raw = 0;
+    }
+    buffer->capacity = buffer->raw ? length : 0;
+  }
+  buffer->index = index;
+  buffer->plain = 0;
+  buffer->decoded = false;
+  buffer->offset = offset;
+  buffer->skip = skip;
+  buffer->needed = needed;
+  buffer->length = length;
+  buffer->done = 0;
+  buffer->inFlight = false;
+  buffer->failed = (length > 0 && !buffer->raw);
+  buffer->pinned = false;
+  buffer->hint = 0;
+  buffer->lastUse = ++useCounter;
+  return buffer;
+}
+
+/** Start reading a chunk into its buffer.
+  * \param[in] buffer chunk buffer to fill.
+  *
+  * Reads are queued on the ring and only submitted to the kernel when a
+  * batch is complete.  Without a ring the read is carried out immediately.
+  */
+void SimHDF5ChunkEngine::submit(ChunkBuffer *buffer)
+{
+  if (buffer->length == 0 || buffer->failed){
+    return;
+  }
+  if (ringFd >= 0){
+    // Keep no more than the queue depth in flight
+    while (inFlight >= queueDepth){
+      if (enterRing(toSubmit, 1) < 0 && errno != EINTR){
+        break;
+      }
+      reapRing();
+    }
+    buffer->inFlight = true;
+    inFlight++;
+    if (queueRead(buffer)){
+      return;
+    }
+    buffer->inFlight = false;
+    inFlight--;
+  }
+  while (buffer->done < buffer->length){
+    ssize_t result = pread(fd, buffer->raw + buffer->done, buffer->length - buffer->done, buffer->offset + buffer->done);
+    if (result < 0 && errno == EINTR){
+      continue;
+    }
+    if (result <= 0){
+      break;
+    }
+    buffer->done += result;
+  }
+  buffer->failed = (buffer->done < buffer->needed);
+}
+
+/** Account for a completed read.
+  * \param[in] buffer chunk buffer the read was for.
+  * \param[in] result number of bytes read or a negative error number.
+  */
+void SimHDF5ChunkEngine::complete(ChunkBuffer *buffer, long result)
+{
+  if (result > 0){
+    buffer->done += result;
+    // Short reads are continued, except at the end of the file
+    if (buffer->done < buffer->length && queueRead(buffer)){
+      return;
+    }
+  }
+  buffer->inFlight = false;
+  inFlight--;
+  buffer->failed = (buffer->done < buffer->needed);
+}
+
+/** Wait until the read for a chunk has completed.
+  * \param[in] buffer chunk buffer to wait for.
+  */
+void SimHDF5ChunkEngine::wait(ChunkBuffer *buffer)
+{
+  while (buffer->inFlight){
+    if (enterRing(toSubmit, 1) < 0 && errno != EINTR){
+      // The ring has failed, give up on this read
+      buffer->inFlight = false;
+      buffer->failed = true;
+      inFlight--;
+      break;
+    }
+    reapRing();
+  }
+}
+
+/** Free a chunk buffer.
+  * \param[in] buffer chunk buffer to free, which must not be in flight.
+  */
+void SimHDF5ChunkEngine::release(ChunkBuffer *buffer)
+{
+  free(buffer->raw);
+  free(buffer->inflated);
+  delete buffer;
+}
+
+/** Decode a chunk that has been read.
+  * \param[in] buffer chunk buffer to decode.
+  * \return pointer to the chunk elements, or NULL on failure.
+  */
+const char *SimHDF5ChunkEngine::decode(ChunkBuffer *buffer)
+{
+  if (buffer->failed){
+    return 0;
+  }
+  if (buffer->decoded){
+    return buffer->plain;
+  }
+  ChunkInfo& info = chunkInfo(buffer->index);
+  if (info.addr == HADDR_UNDEF){
+    // The chunk was never written so it holds the default fill value
+    if (zeros.size() < chunkBytes){
+      zeros.assign(chunkBytes, 0);
+    }
+    buffer->plain = &zeros[0];
+  } else if (deflate && !(info.mask & 1)){
+    if (!buffer->inflated){
+      buffer->inflated = (char *)malloc(chunkBytes);
+      if (!buffer->inflated){
+        return 0;
+      }
+    }
+    uLongf size = chunkBytes;
+    if (uncompress((Bytef *)buffer->inflated, &size, (const Bytef *)(buffer->raw + buffer->skip), info.size) != Z_OK || size != chunkBytes){
+      buffer->failed = true;
+      return 0;
+    }
+    buffer->plain = buffer->inflated;
+  } else {
+    if (info.size < chunkBytes){
+      buffer->failed = true;
+      return 0;
+    }
+    buffer->plain = buffer->raw + buffer->skip;
+  }
+  buffer->decoded = true;
+  return buffer->plain;
+}
+
+#ifdef SIMHDF5_HAVE_URING
+
+/** Create the io_uring and map its queues.
+  * \return false if the kernel does not allow io_uring.
+  */
+bool SimHDF5ChunkEngine::setupRing()
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ringFd = (int)syscall(__NR_io_uring_setup, queueDepth, &params);
+  if (ringFd < 0){
+    return false;
+  }
+  sqEntries = params.sq_entries;
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP){
+    if (cqRingSize > sqRingSize){
+      sqRingSize = cqRingSize;
+    }
+    cqRingSize = sqRingSize;
+  }
+  sqRing = mmap(0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED){
+    sqRing = 0;
+    closeRing();
+    return false;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP){
+    cqRing = sqRing;
+  } else {
+    cqRing = mmap(0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED){
+      cqRing = 0;
+      closeRing();
+      return false;
+    }
+  }
+  sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED){
+    sqes = 0;
+    closeRing();
+    return false;
+  }
+  char *sq = (char *)sqRing;
+  char *cq = (char *)cqRing;
+  sqHead = (unsigned *)(sq + params.sq_off.head);
+  sqTail = (unsigned *)(sq + params.sq_off.tail);
+  sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+  sqArray = (unsigned *)(sq + params.sq_off.array);
+  cqHead = (unsigned *)(cq + params.cq_off.head);
+  cqTail = (unsigned *)(cq + params.cq_off.tail);
+  cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+  cqes = cq + params.cq_off.cqes;
+  toSubmit = 0;
+  return true;
+}
+
+/** Unmap the queues and close the io_uring.
+  *
+  */
+void SimHDF5ChunkEngine::closeRing()
+{
+  if (sqes){
+    munmap(sqes, sqesSize);
+    sqes = 0;
+  }
+  if (cqRing && cqRing != sqRing){
+    munmap(cqRing, cqRingSize);
+  }
+  cqRing = 0;
+  if (sqRing){
+    munmap(sqRing, sqRingSize);
+    sqRing = 0;
+  }
+  if (ringFd >= 0){
+    ::close(ringFd);
+    ringFd = -1;
+  }
+  toSubmit = 0;
+}
+
+/** Place a read for the remainder of a chunk on the submission queue.
+  * \param[in] buffer chunk buffer to read into.
+  * \return false if the read could not be queued.
+  */
+bool SimHDF5ChunkEngine::queueRead(ChunkBuffer *buffer)
+{
+  if (ringFd < 0){
+    return false;
+  }
+  unsigned tail = *sqTail;
+  if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries){
+    // The submission queue is full, hand it to the kernel first
+    enterRing(toSubmit, 0);
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries){
+      return false;
+    }
+  }
+  unsigned slot = tail & *sqMask;
+  struct io_uring_sqe *sqe = &((struct io_uring_sqe *)sqes)[slot];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)(buffer->raw + buffer->done);
+  sqe->len = (unsigned)(buffer->length - buffer->done);
+  sqe->off = (unsigned long long)(buffer->offset + buffer->done);
+  sqe->user_data = (unsigned long long)(unsigned long)buffer;
+  sqArray[slot] = slot;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+  toSubmit++;
+  return true;
+}
+
+/** Submit queued reads and optionally wait for completions.
+  * \param[in] submit number of queued reads to submit.
+  * \param[in] wait minimum number of completions to wait for.
+  * \return the result of io_uring_enter.
+  */
+int SimHDF5ChunkEngine::enterRing(unsigned submit, unsigned wait)
+{
+  if (ringFd < 0){
+    errno = EBADF;
+    return -1;
+  }
+  int result = (int)syscall(__NR_io_uring_enter, ringFd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  if (result > 0){
+    toSubmit -= ((unsigned)result < toSubmit) ? (unsigned)result : toSubmit;
+  }
+  return result;
+}
+
+/** Process every entry on the completion queue.
+  *
+  */
+void SimHDF5ChunkEngine::reapRing()
+{
+  if (ringFd < 0){
+    return;
+  }
+  unsigned head = *cqHead;
+  while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)){
+    struct io_uring_cqe *cqe = &((struct io_uring_cqe *)cqes)[head & *cqMask];
+    ChunkBuffer *buffer = (ChunkBuffer *)(unsigned long)cqe->user_data;
+    long result = cqe->res;
+    head++;
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    complete(buffer, result);
+  }
+}
+
+#else
+
+bool SimHDF5ChunkEngine::setupRing()
+{
+  return false;
+}
+
+void SimHDF5ChunkEngine::closeRing()
+{
+}
+
+bool SimHDF5ChunkEngine::queueRead(ChunkBuffer *buffer)
+{
+  return false;
+}
+
+int SimHDF5ChunkEngine::enterRing(unsigned submit, unsigned wait)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+void SimHDF5ChunkEngine::reapRing()
+{
+}
+
+#endif
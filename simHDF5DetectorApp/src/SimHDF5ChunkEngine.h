@@ -0,0 +1,138 @@
+/*
+ * SimHDF5ChunkEngine.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5CHUNKENGINE_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5CHUNKENGINE_H_
+
+#include <hdf5.h>
+#include <sys/types.h>
+#include <string>
+#include <map>
+#include <vector>
+
+/** Alternative read engine that bypasses H5Dread.
+  *
+  * The file offset and size of each chunk is looked up once from HDF5 and
+  * kept in a table.  Frames are then served by reading the raw chunk bytes
+  * straight from the file, batched through io_uring where the kernel allows
+  * it, and decoding them in user space.  Only datasets that are unfiltered
+  * or deflate compressed, stored in native byte order, and have the image
+  * width as the last dimension are supported; open() returns false for
+  * anything else so that the caller can fall back to H5Dread.  A frame
+  * that is exactly one uncompressed chunk is read straight into the
+  * caller's buffer, which with O_DIRECT needs the buffer to be page aligned.
+  *
+  * The chunk cache holds the chunks of the frames prefetched ahead of the
+  * reader as well as the reads in flight.  Chunks that are in flight, being
+  * copied out, or prefetched for a frame within the readahead window are
+  * never evicted; the cache grows past its limit instead.
+  */
+class SimHDF5ChunkEngine
+{
+public:
+  SimHDF5ChunkEngine(int queueDepth, bool directIO, int readahead);
+  virtual ~SimHDF5ChunkEngine();
+
+  bool open(const std::string& filename, hid_t dset, hid_t ntype);
+  void close();
+  bool usingUring();
+  void prefetchFrame(const hsize_t *start, const hsize_t *count);
+  bool readFrame(const hsize_t *start, const hsize_t *count, int wdim, int hdim, void *data);
+
+private:
+  struct ChunkInfo
+  {
+    bool known;        // Has the chunk been looked up yet
+    haddr_t addr;      // File offset of the chunk, HADDR_UNDEF if not allocated
+    hsize_t size;      // Stored size of the chunk in bytes
+    unsigned mask;     // Filter mask, a set bit means the filter was skipped
+  };
+
+  struct ChunkBuffer
+  {
+    size_t index;      // Linear index of the chunk in the chunk grid
+    char *raw;         // Aligned buffer the chunk is read into
+    size_t capacity;   // Size of the raw buffer
+    char *inflated;    // Buffer holding the decompressed chunk
+    char *plain;       // Decoded chunk, inside raw unless the chunk is compressed
+    bool decoded;      // Has plain been filled in
+    off_t offset;      // File offset of the first byte requested
+    size_t skip;       // Offset of the chunk data within the raw buffer
+    size_t needed;     // Number of bytes that must be read to hold the chunk
+    size_t length;     // Number of bytes requested from the file
+    size_t done;       // Number of bytes read so far
+    bool inFlight;     // Is a read outstanding
+    bool failed;       // Did the read fail
+    bool pinned;       // Is the chunk being copied out by readFrame
+    unsigned long hint; // Number of the last prefetch hint for the chunk, 0 once it has been read
+    unsigned long lastUse;
+  };
+
+  ChunkInfo& chunkInfo(size_t index);
+  void chunkCoords(size_t index, hsize_t *coord);
+  void touchedChunks(const hsize_t *start, const hsize_t *count, std::vector<size_t>& chunks);
+  bool readWhole(size_t index, void *data);
+  ChunkBuffer *request(size_t index);
+  ChunkBuffer *allocate(size_t index);
+  void sizeCache(size_t frameChunks);
+  bool evictable(ChunkBuffer *buffer);
+  void submit(ChunkBuffer *buffer);
+  void complete(ChunkBuffer *buffer, long result);
+  void wait(ChunkBuffer *buffer);
+  void release(ChunkBuffer *buffer);
+  const char *decode(ChunkBuffer *buffer);
+
+  bool setupRing();
+  void closeRing();
+  bool queueRead(ChunkBuffer *buffer);
+  int enterRing(unsigned submit, unsigned wait);
+  void reapRing();
+
+  int queueDepth;                             // Maximum number of reads in flight
+  int readahead;                              // Number of frames prefetched ahead of the reader
+  bool directIO;                              // Open the file with O_DIRECT
+  int fd;                                     // Descriptor used for the raw reads
+  hid_t dset;                                 // Dataset being read
+  int ndims;                                  // Number of dataset dimensions
+  size_t elementSize;                         // Size of one element in bytes
+  bool deflate;                               // Are the chunks deflate compressed
+  bool contiguous;                            // Is the dataset stored contiguously
+  haddr_t dataOffset;                         // File offset of a contiguous dataset
+  std::vector<hsize_t> dims;                  // Dataset dimensions
+  std::vector<hsize_t> chunkDims;             // Chunk dimensions
+  std::vector<hsize_t> gridDims;              // Number of chunks in each dimension
+  size_t chunkBytes;                          // Decoded size of one chunk in bytes
+  std::vector<ChunkInfo> chunks;              // Table of chunk offsets and sizes
+  std::map<size_t, ChunkBuffer *> cache;      // Chunks read or being read
+  std::vector<ChunkBuffer *> spare;           // Evicted buffers ready for reuse
+  std::vector<char> zeros;                    // Contents of chunks that were never written
+  size_t cacheLimit;                          // Maximum number of cached chunks
+  size_t frameChunks;                         // Largest number of chunks touched by one frame
+  unsigned long useCounter;                   // Counter used to find the oldest chunk
+  unsigned long hintCounter;                  // Number of prefetch hints received
+  int inFlight;                               // Number of reads outstanding
+
+  // io_uring state, ringFd is negative when synchronous reads are used
+  int ringFd;
+  void *sqRing;
+  void *cqRing;
+  void *sqes;
+  size_t sqRingSize;
+  size_t cqRingSize;
+  size_t sqesSize;
+  unsigned sqEntries;
+  unsigned *sqHead;
+  unsigned *sqTail;
+  unsigned *sqMask;
+  unsigned *sqArray;
+  unsigned *cqHead;
+  unsigned *cqTail;
+  unsigned *cqMask;
+  void *cqes;
+  unsigned toSubmit;
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5CHUNKENGINE_H_ */
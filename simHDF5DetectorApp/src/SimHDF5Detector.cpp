@@ -6,12 +6,23 @@
  */
 
 #include <epicsThread.h>
+#include <epicsVersion.h>
+#include <errlog.h>
 #include <iocsh.h>
 #include <drvSup.h>
 #include <epicsExport.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <set>
+#include <sys/resource.h>
 #include "SimHDF5Detector.h"
+#include "SimHDF5Layout.h"
+#include "SimHDF5Placement.h"
 
 static const char *driverName = "SimHDF5Detector";
 
@@ -30,6 +41,65 @@ static void SimHDF5DetectorTaskC(void *drvPvt)
   pPvt->acqTask();
 }
 
+/** C function called by the newly created loader thread.
+  * \param[in] drvPvt pointer to the SimHDF5Detector object that created the thread.
+  */
+static void SimHDF5DetectorLoaderTaskC(void *drvPvt)
+{
+  SimHDF5Detector *pPvt = (SimHDF5Detector *)drvPvt;
+  pPvt->loaderTask();
+}
+
+/** C function called by the newly created status thread.
+  * \param[in] drvPvt pointer to the SimHDF5Detector object that created the thread.
+  */
+static void SimHDF5DetectorStatusTaskC(void *drvPvt)
+{
+  SimHDF5Detector *pPvt = (SimHDF5Detector *)drvPvt;
+  pPvt->statusTask();
+}
+
+/** Return the names of all datasets read with the given settings.
+  * \param[in] config the settings.
+  * \return set of dataset names.
+  */
+static std::set<std::string> configDatasets(const ADSimReadConfig& config)
+{
+  std::set<std::string> names;
+  names.insert(config.dname);
+  for (size_t entry = 0; entry < config.playlist.size(); entry++){
+    names.insert(config.playlist[entry].dname);
+  }
+  return names;
+}
+
+/** Return the number of frames of a sequence that belong to a shard.
+  * \param[in] frames number of frames in the whole sequence.
+  * \param[in] rank position of the shard.
+  * \param[in] size number of shards.
+  */
+static int shardFrames(int frames, int rank, int size)
+{
+  return frames > rank ? (frames - rank + size - 1) / size : 0;
+}
+
+/** Return whether a region of a frame is contiguous in memory, so that it can be viewed.
+  * \param[in] region the region.
+  * \param[in] width width of the frame.
+  * \param[in] height height of the frame.
+  * \param[in] colorMode colour layout of the frame.
+  * \param[in] planes number of planar colours or stacked frames.
+  */
+static bool regionContiguous(const ADSimRegion& region, int width, int height, int colorMode, int planes)
+{
+  if (region.minX == 0 && region.sizeX == width){
+    // Whole rows are contiguous, and so are whole planes
+    return planes == 1 || region.sizeY == height;
+  }
+  // Part of a single row, which is split between colours when row interleaved
+  return region.sizeY == 1 && planes == 1 && colorMode != NDColorModeRGB2;
+}
+
 /** Constructor.
   * \param[in] portName name of the asyn port for this driver.
   * \param[in] maxBuffers The maximum number of NDArray buffers that the NDArrayPool for this driver is
@@ -38,28 +108,58 @@ static void SimHDF5DetectorTaskC(void *drvPvt)
   *            allowed to allocate. Set this to 0 to allow an unlimited amount of memory.
   * \param[in] priority The thread priority for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
   * \param[in] stackSize The stack size for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
+  * \param[in] readerWorkers The number of worker processes forked to read frames when the
+  *            process reader is selected.  Set this to 0 to fork none.
   *
   * Construct a new SimHDF5Detector object.  Acquisition thread is started during the
-  * construction of the object.
+  * construction of the object.  Address 0 publishes whole frames and addresses
+  * 1 to SIMHDF5_MAX_ROIS publish regions of them.
   */
 SimHDF5Detector::SimHDF5Detector(const char *portName,
                                  int maxBuffers,
                                  size_t maxMemory,
                                  int priority,
-                                 int stackSize)
+                                 int stackSize,
+                                 int readerWorkers)
   : ADDriver(portName,
-             1,
+             SIMHDF5_MAX_ROIS + 1,
              NUM_ADSIM_DETECTOR_PARAMS,
              maxBuffers,
              maxMemory,
              0,
              0, // No interfaces beyond those set in ADDriver.cpp
-             0, // ASYN_CANBLOCK=0, ASYN_MULTIDEVICE=0, autoConnect=1
+             ASYN_MULTIDEVICE, // ASYN_CANBLOCK=0, ASYN_MULTIDEVICE=1, autoConnect=1
              1, // autoConnect = 1
              priority,
              stackSize),
   validFile(false),
-  pRaw(NULL)
+  cancelLoad(false),
+  activeTrigger(ADSimTriggerInternal),
+  missedTriggers(0),
+  pRaw(NULL),
+  rawColorMode(NDColorModeMono),
+  statusPending(false),
+  savedCallbacks(0),
+  callbackCost(0.0),
+  droppedFrames(0),
+  lateFrames(0),
+  poolExhaustedCount(0),
+  throttle(0.0),
+  configChanged(false),
+  configReady(false),
+  configLoading(false),
+  configRequests(0),
+  configLoads(0),
+  configSwaps(0),
+  acqRealtime(false),
+  poolBuffers(maxBuffers),
+  bufferAlign(SimHDF5AlignDefault),
+  hugePages(false),
+  frameTimesMean(0.0),
+  viewPool(NULL),
+  syncGroup(NULL),
+  syncSkewMax(0.0),
+  arrayCount(0)
 {
   int status = asynSuccess;
   const char *functionName = "SimHDF5Detector";
@@ -80,6 +180,80 @@ SimHDF5Detector::SimHDF5Detector(const char *portName,
   createParam(str_ADSim_XDim,          asynParamInt32,   &ADSim_XDim);
   createParam(str_ADSim_YDim,          asynParamInt32,   &ADSim_YDim);
   createParam(str_ADSim_DsetPath,      asynParamOctet,   &ADSim_DsetPath);
+  createParam(str_ADSim_ColorDim,      asynParamInt32,   &ADSim_ColorDim);
+  createParam(str_ADSim_FramesPerArray, asynParamInt32,  &ADSim_FramesPerArray);
+  createParam(str_ADSim_StatusRate,    asynParamFloat64, &ADSim_StatusRate);
+  createParam(str_ADSim_CallbacksSaved, asynParamInt32,  &ADSim_CallbacksSaved);
+  createParam(str_ADSim_CallbackTimeSaved, asynParamFloat64, &ADSim_CallbackTimeSaved);
+  createParam(str_ADSim_BackPressure,  asynParamInt32,   &ADSim_BackPressure);
+  createParam(str_ADSim_DroppedFrames, asynParamInt32,   &ADSim_DroppedFrames);
+  createParam(str_ADSim_LateFrames,    asynParamInt32,   &ADSim_LateFrames);
+  createParam(str_ADSim_PoolExhausted, asynParamInt32,   &ADSim_PoolExhausted);
+  createParam(str_ADSim_PoolFreeBuffers, asynParamInt32, &ADSim_PoolFreeBuffers);
+  createParam(str_ADSim_PoolUsedBuffers, asynParamInt32, &ADSim_PoolUsedBuffers);
+  createParam(str_ADSim_Throttle,      asynParamFloat64, &ADSim_Throttle);
+  createParam(str_ADSim_ReadaheadFrames, asynParamInt32, &ADSim_ReadaheadFrames);
+  createParam(str_ADSim_DropCache,     asynParamInt32,   &ADSim_DropCache);
+  createParam(str_ADSim_ReadEngine,    asynParamInt32,   &ADSim_ReadEngine);
+  createParam(str_ADSim_ReadEngineActive, asynParamInt32, &ADSim_ReadEngineActive);
+  createParam(str_ADSim_QueueDepth,    asynParamInt32,   &ADSim_QueueDepth);
+  createParam(str_ADSim_DirectIO,      asynParamInt32,   &ADSim_DirectIO);
+  createParam(str_ADSim_FileDriver,    asynParamInt32,   &ADSim_FileDriver);
+  createParam(str_ADSim_FileLoadTime,  asynParamFloat64, &ADSim_FileLoadTime);
+  createParam(str_ADSim_ReaderType,    asynParamInt32,   &ADSim_ReaderType);
+  createParam(str_ADSim_SharedStore,   asynParamInt32,   &ADSim_SharedStore);
+  createParam(str_ADSim_SnapshotDir,   asynParamOctet,   &ADSim_SnapshotDir);
+  createParam(str_ADSim_ConfigSwaps,   asynParamInt32,   &ADSim_ConfigSwaps);
+  createParam(str_ADSim_Playlist,      asynParamOctet,   &ADSim_Playlist);
+  createParam(str_ADSim_PlaylistOrder, asynParamInt32,   &ADSim_PlaylistOrder);
+  createParam(str_ADSim_PlaylistEntry, asynParamInt32,   &ADSim_PlaylistEntry);
+  createParam(str_ADSim_OutputMode,    asynParamInt32,   &ADSim_OutputMode);
+  createParam(str_ADSim_OutputSizeX,   asynParamInt32,   &ADSim_OutputSizeX);
+  createParam(str_ADSim_OutputSizeY,   asynParamInt32,   &ADSim_OutputSizeY);
+  createParam(str_ADSim_OutputThreads, asynParamInt32,   &ADSim_OutputThreads);
+  createParam(str_ADSim_SoftTrigger,   asynParamInt32,   &ADSim_SoftTrigger);
+  createParam(str_ADSim_TriggerCount,  asynParamInt32,   &ADSim_TriggerCount);
+  createParam(str_ADSim_TriggersMissed, asynParamInt32,  &ADSim_TriggersMissed);
+  createParam(str_ADSim_TriggerLatency, asynParamFloat64, &ADSim_TriggerLatency);
+  createParam(str_ADSim_TriggerLatencyMean, asynParamFloat64, &ADSim_TriggerLatencyMean);
+  createParam(str_ADSim_TriggerLatencyMax, asynParamFloat64, &ADSim_TriggerLatencyMax);
+  createParam(str_ADSim_AcqCPUs,       asynParamOctet,   &ADSim_AcqCPUs);
+  createParam(str_ADSim_AcqPriority,   asynParamInt32,   &ADSim_AcqPriority);
+  createParam(str_ADSim_WorkerCPUs,    asynParamOctet,   &ADSim_WorkerCPUs);
+  createParam(str_ADSim_WorkerPriority, asynParamInt32,  &ADSim_WorkerPriority);
+  createParam(str_ADSim_NumaNode,      asynParamInt32,   &ADSim_NumaNode);
+  createParam(str_ADSim_PlacementStatus, asynParamOctet, &ADSim_PlacementStatus);
+  createParam(str_ADSim_MemoryLock,    asynParamInt32,   &ADSim_MemoryLock);
+  createParam(str_ADSim_LockedBytes,   asynParamFloat64, &ADSim_LockedBytes);
+  createParam(str_ADSim_LockStatus,    asynParamOctet,   &ADSim_LockStatus);
+  createParam(str_ADSim_PrefaultBuffers, asynParamInt32, &ADSim_PrefaultBuffers);
+  createParam(str_ADSim_BufferAlign,   asynParamInt32,   &ADSim_BufferAlign);
+  createParam(str_ADSim_HugePages,     asynParamInt32,   &ADSim_HugePages);
+  createParam(str_ADSim_PoolPreallocate, asynParamInt32, &ADSim_PoolPreallocate);
+  createParam(str_ADSim_BufferStatus,  asynParamOctet,   &ADSim_BufferStatus);
+  createParam(str_ADSim_TimestampDset, asynParamOctet,   &ADSim_TimestampDset);
+  createParam(str_ADSim_TimestampSpeedup, asynParamFloat64, &ADSim_TimestampSpeedup);
+  createParam(str_ADSim_TimestampCount, asynParamInt32,  &ADSim_TimestampCount);
+  createParam(str_ADSim_AttributeDsets, asynParamOctet,  &ADSim_AttributeDsets);
+  createParam(str_ADSim_AttributeCount, asynParamInt32,  &ADSim_AttributeCount);
+  createParam(str_ADSim_LoadState,     asynParamInt32,   &ADSim_LoadState);
+  createParam(str_ADSim_LoadProgress,  asynParamFloat64, &ADSim_LoadProgress);
+  createParam(str_ADSim_LoadRate,      asynParamFloat64, &ADSim_LoadRate);
+  createParam(str_ADSim_LoadCancel,    asynParamInt32,   &ADSim_LoadCancel);
+  createParam(str_ADSim_RoiEnable,     asynParamInt32,   &ADSim_RoiEnable);
+  createParam(str_ADSim_RoiMinX,       asynParamInt32,   &ADSim_RoiMinX);
+  createParam(str_ADSim_RoiMinY,       asynParamInt32,   &ADSim_RoiMinY);
+  createParam(str_ADSim_RoiSizeX,      asynParamInt32,   &ADSim_RoiSizeX);
+  createParam(str_ADSim_RoiSizeY,      asynParamInt32,   &ADSim_RoiSizeY);
+  createParam(str_ADSim_RoiView,       asynParamInt32,   &ADSim_RoiView);
+  createParam(str_ADSim_SyncGroup,     asynParamOctet,   &ADSim_SyncGroup);
+  createParam(str_ADSim_SyncTimeout,   asynParamFloat64, &ADSim_SyncTimeout);
+  createParam(str_ADSim_SyncMembers,   asynParamInt32,   &ADSim_SyncMembers);
+  createParam(str_ADSim_SyncSkew,      asynParamFloat64, &ADSim_SyncSkew);
+  createParam(str_ADSim_SyncSkewMax,   asynParamFloat64, &ADSim_SyncSkewMax);
+  createParam(str_ADSim_ReaderWorkers, asynParamInt32,   &ADSim_ReaderWorkers);
+  createParam(str_ADSim_ShardRank,     asynParamInt32,   &ADSim_ShardRank);
+  createParam(str_ADSim_ShardSize,     asynParamInt32,   &ADSim_ShardSize);
 
   // Create sensible default values for the parameters
   setStringParam (ADSim_Filename,    "");
@@ -97,14 +271,102 @@ SimHDF5Detector::SimHDF5Detector(const char *portName,
   setIntegerParam(ADSim_XDim,        0);
   setIntegerParam(ADSim_YDim,        0);
   setStringParam (ADSim_DsetPath,    "");
+  setIntegerParam(ADSim_ColorDim,    0);
+  setIntegerParam(ADSim_FramesPerArray, 1);
+  setDoubleParam (ADSim_StatusRate,  10.0);
+  setIntegerParam(ADSim_CallbacksSaved, 0);
+  setDoubleParam (ADSim_CallbackTimeSaved, 0.0);
+  setIntegerParam(ADSim_BackPressure, ADSimBackPressureBlock);
+  setIntegerParam(ADSim_DroppedFrames, 0);
+  setIntegerParam(ADSim_LateFrames,  0);
+  setIntegerParam(ADSim_PoolExhausted, 0);
+  setIntegerParam(ADSim_PoolFreeBuffers, 0);
+  setIntegerParam(ADSim_PoolUsedBuffers, 0);
+  setDoubleParam (ADSim_Throttle,    0.0);
+  setIntegerParam(ADSim_ReadaheadFrames, 0);
+  setIntegerParam(ADSim_DropCache,   0);
+  setIntegerParam(ADSim_ReadEngine,  SimHDF5EngineHDF5);
+  setIntegerParam(ADSim_ReadEngineActive, SimHDF5EngineHDF5);
+  setIntegerParam(ADSim_QueueDepth,  32);
+  setIntegerParam(ADSim_DirectIO,    0);
+  setIntegerParam(ADSim_FileDriver,  SimHDF5DriverSec2);
+  setDoubleParam (ADSim_FileLoadTime, 0.0);
+  setIntegerParam(ADSim_ReaderType,  ADSimReaderFile);
+  setIntegerParam(ADSim_SharedStore, 0);
+  setStringParam (ADSim_SnapshotDir, "");
+  setIntegerParam(ADSim_ConfigSwaps, 0);
+  setStringParam (ADSim_Playlist,    "");
+  setIntegerParam(ADSim_PlaylistOrder, ADSimPlaylistForward);
+  setIntegerParam(ADSim_PlaylistEntry, 0);
+  setIntegerParam(ADSim_OutputMode,  SimHDF5GeometryDirect);
+  setIntegerParam(ADSim_OutputSizeX, 0);
+  setIntegerParam(ADSim_OutputSizeY, 0);
+  setIntegerParam(ADSim_OutputThreads, 4);
+  setIntegerParam(ADSim_SoftTrigger, 0);
+  setIntegerParam(ADSim_TriggerCount, 0);
+  setIntegerParam(ADSim_TriggersMissed, 0);
+  setDoubleParam (ADSim_TriggerLatency, 0.0);
+  setDoubleParam (ADSim_TriggerLatencyMean, 0.0);
+  setDoubleParam (ADSim_TriggerLatencyMax, 0.0);
+  setStringParam (ADSim_AcqCPUs,     "");
+  setIntegerParam(ADSim_AcqPriority, 0);
+  setStringParam (ADSim_WorkerCPUs,  "");
+  setIntegerParam(ADSim_WorkerPriority, 0);
+  setIntegerParam(ADSim_NumaNode,    -1);
+  setStringParam (ADSim_PlacementStatus, "");
+  setIntegerParam(ADSim_MemoryLock,  0);
+  setDoubleParam (ADSim_LockedBytes, 0.0);
+  setStringParam (ADSim_LockStatus,  "");
+  setIntegerParam(ADSim_PrefaultBuffers, 0);
+  setIntegerParam(ADSim_BufferAlign, SimHDF5AlignDefault);
+  setIntegerParam(ADSim_HugePages,   0);
+  setIntegerParam(ADSim_PoolPreallocate, 0);
+  setStringParam (ADSim_BufferStatus, "");
+  setStringParam (ADSim_TimestampDset, "");
+  setDoubleParam (ADSim_TimestampSpeedup, 1.0);
+  setIntegerParam(ADSim_TimestampCount, 0);
+  setStringParam (ADSim_AttributeDsets, "");
+  setIntegerParam(ADSim_AttributeCount, 0);
+  setIntegerParam(ADSim_LoadState,   ADSimLoadIdle);
+  setDoubleParam (ADSim_LoadProgress, 0.0);
+  setDoubleParam (ADSim_LoadRate,    0.0);
+  setIntegerParam(ADSim_LoadCancel,  0);
+  setStringParam (ADSim_SyncGroup,   "");
+  setDoubleParam (ADSim_SyncTimeout, 10.0);
+  setIntegerParam(ADSim_SyncMembers, 0);
+  setDoubleParam (ADSim_SyncSkew,    0.0);
+  setDoubleParam (ADSim_SyncSkewMax, 0.0);
+  setIntegerParam(ADSim_ReaderWorkers, 0);
+  setIntegerParam(ADSim_ShardRank,   0);
+  setIntegerParam(ADSim_ShardSize,   1);
+  for (int addr = 0; addr <= SIMHDF5_MAX_ROIS; addr++){
+    setIntegerParam(addr, ADSim_RoiEnable, 0);
+    setIntegerParam(addr, ADSim_RoiMinX,   0);
+    setIntegerParam(addr, ADSim_RoiMinY,   0);
+    setIntegerParam(addr, ADSim_RoiSizeX,  0);
+    setIntegerParam(addr, ADSim_RoiSizeY,  0);
+    setIntegerParam(addr, ADSim_RoiView,   0);
+    if (addr > 0){
+      setIntegerParam(addr, NDArraySizeX, 0);
+      setIntegerParam(addr, NDArraySizeY, 0);
+    }
+  }
 
   // Set standard parameter values
   setStringParam (ADManufacturer, "Simulated detector");
   setStringParam (ADModel, "HDF5 reader");
 
+  // Fork the reader workers now, before any thread of this driver uses HDF5
+  if (readerWorkers > 0){
+    this->processReader = std::tr1::shared_ptr<SimHDF5ProcessReader>(new SimHDF5ProcessReader(readerWorkers));
+    setIntegerParam(ADSim_ReaderWorkers, this->processReader->getWorkers());
+  }
+
   // Create the file reader object for parsing HDF5 simulated source files
-  fileReader = std::tr1::shared_ptr<SimHDF5FileReader>(new SimHDF5FileReader());
-  //fileReader = std::tr1::shared_ptr<SimHDF5MemoryReader>(new SimHDF5MemoryReader());
+  createReader();
+
+  // Create the pool of views used to publish regions without copying them
+  this->viewPool = new SimHDF5ViewPool(this);
 
   // Create the epicsEvents for signalling to the acq task when acquisition starts and stops
   this->startEventId = epicsEventCreate(epicsEventEmpty);
@@ -117,11 +379,38 @@ SimHDF5Detector::SimHDF5Detector(const char *portName,
       printf("%s:%s epicsEventCreate failure for stop event\n", driverName, functionName);
       return;
   }
+  this->triggerEventId = epicsEventCreate(epicsEventEmpty);
+  if (!this->triggerEventId){
+      printf("%s:%s epicsEventCreate failure for trigger event\n", driverName, functionName);
+      return;
+  }
+  this->loadEventId = epicsEventCreate(epicsEventEmpty);
+  if (!this->loadEventId){
+      printf("%s:%s epicsEventCreate failure for load event\n", driverName, functionName);
+      return;
+  }
+  this->statusEventId = epicsEventCreate(epicsEventEmpty);
+  if (!this->statusEventId){
+      printf("%s:%s epicsEventCreate failure for status event\n", driverName, functionName);
+      return;
+  }
+  this->triggerMutex = epicsMutexCreate();
+  if (!this->triggerMutex){
+      printf("%s:%s epicsMutexCreate failure for trigger mutex\n", driverName, functionName);
+      return;
+  }
 
-  // Create the thread that serves the images
+  // Create the thread that serves the images, with the priority and stack
+  // size given to the constructor or the defaults if they are 0
+  if (priority == 0){
+    priority = epicsThreadPriorityMedium;
+  }
+  if (stackSize == 0){
+    stackSize = epicsThreadGetStackSize(epicsThreadStackMedium);
+  }
   status = (epicsThreadCreate("SimHDF5DetectorTask",
-                              epicsThreadPriorityMedium,
-                              epicsThreadGetStackSize(epicsThreadStackMedium),
+                              priority,
+                              stackSize,
                               (EPICSTHREADFUNC)SimHDF5DetectorTaskC,
                               this) == NULL);
   if (status) {
@@ -129,6 +418,28 @@ SimHDF5Detector::SimHDF5Detector(const char *portName,
       return;
   }
 
+  // Create the thread that loads files, so that a long load does not block the port
+  status = (epicsThreadCreate("SimHDF5LoaderTask",
+                              epicsThreadPriorityLow,
+                              epicsThreadGetStackSize(epicsThreadStackMedium),
+                              (EPICSTHREADFUNC)SimHDF5DetectorLoaderTaskC,
+                              this) == NULL);
+  if (status) {
+      printf("%s:%s epicsThreadCreate failure for loader task\n", driverName, functionName);
+      return;
+  }
+
+  // Create the thread that publishes the status at the status update rate
+  status = (epicsThreadCreate("SimHDF5StatusTask",
+                              epicsThreadPriorityLow,
+                              epicsThreadGetStackSize(epicsThreadStackSmall),
+                              (EPICSTHREADFUNC)SimHDF5DetectorStatusTaskC,
+                              this) == NULL);
+  if (status) {
+      printf("%s:%s epicsThreadCreate failure for status task\n", driverName, functionName);
+      return;
+  }
+
 }
 
 /** Main acquisition task.
@@ -137,16 +448,41 @@ SimHDF5Detector::SimHDF5Detector(const char *portName,
 void SimHDF5Detector::acqTask()
 {
   int status = asynSuccess;
-  int imageCounter;
+  hsize_t imageCounter;
   int numImages, numImagesCounter;
-  int arrayCounter;
+  hsize_t arrayCounter;
   int imageMode;
   int arrayCallbacks;
   int acquire=0;
+  int nframes = 1;
+  int firstId = 0;
+  int backPressure = ADSimBackPressureBlock;
+  bool dropFrame = false;
+  bool exhausted = false;
+  epicsEventWaitStatus waitStatus = epicsEventWaitOK;
+  char attrName[64];
   NDArray *pImage;
   double acquireTime, acquirePeriod, delay;
   epicsTimeStamp startTime, endTime;
   double elapsedTime;
+  hsize_t frameIndex = 0;
+  hsize_t sequence = 0, nextSequence = 0;
+  bool primed = false;
+  int playlistIndex = 0;
+  std::vector<std::string> retired;
+  int triggerMode = ADSimTriggerInternal;
+  int triggerCount = 0;
+  double latency, latencySum = 0.0, latencyMax = 0.0;
+  epicsTimeStamp triggerTime, publishTime;
+  bool replay = false;
+  int replayIndex = -1;
+  double replayOffset = 0.0, replayFirst = 0.0, speedup = 1.0;
+  std::vector<double> replayFrames;
+  epicsTimeStamp replayStart, deadline, now;
+  bool synced = false;
+  bool scheduled = false;
+  size_t syncIndex = 0;
+  epicsTimeStamp syncTime;
   const char *functionName = "simTask";
 
   this->lock();
@@ -155,7 +491,12 @@ void SimHDF5Detector::acqTask()
     // If we are not acquiring then wait for a semaphore that is given when acquisition is started
     if (!acquire){
       setStringParam(ADStatusMessage, "Waiting to start acquisition");
-      callParamCallbacks();
+      publishStatus(true);
+      // Stop accepting triggers
+      epicsMutexLock(this->triggerMutex);
+      this->activeTrigger = ADSimTriggerInternal;
+      this->pendingTriggers.clear();
+      epicsMutexUnlock(this->triggerMutex);
       // Close any previously opened dataset
       fileReader->cleanupDataset();
       // Release the lock while we wait for an event that says acquire has started, then lock again
@@ -167,18 +508,214 @@ void SimHDF5Detector::acqTask()
       acquire = 1;
       setStringParam(ADStatusMessage, "Acquiring data");
       setIntegerParam(ADNumImagesCounter, 0);
-      // Read the dataset index and prepare for reading
-      int dsetIndex = 0;
-      getIntegerParam(ADSim_DsetIndex, &dsetIndex);
-      dsetIndex--;
-      fileReader->prepareToReadDataset(fileReader->getDatasetKeys()[dsetIndex]);
+      // Reset the count of status publications saved
+      this->savedCallbacks = 0;
+      // Reset the back pressure accounting
+      this->droppedFrames = 0;
+      this->lateFrames = 0;
+      this->poolExhaustedCount = 0;
+      this->throttle = 0.0;
+      setIntegerParam(ADSim_DroppedFrames, 0);
+      setIntegerParam(ADSim_LateFrames, 0);
+      setIntegerParam(ADSim_PoolExhausted, 0);
+      setDoubleParam(ADSim_Throttle, 0.0);
+      // Capture the read settings and prepare the dataset for reading
+      this->configChanged = false;
+      this->configReady = false;
+      this->configLoading = false;
+      this->configSwaps = 0;
+      setIntegerParam(ADSim_ConfigSwaps, 0);
+      if (!captureConfig(this->readConfig)){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: No valid dataset or playlist selected, acquisition not started\n",
+                  driverName, functionName);
+        acquire = 0;
+        setIntegerParam(ADAcquire, acquire);
+        continue;
+      }
+      int readEngine = SimHDF5EngineHDF5;
+      int queueDepth = 1;
+      int directIO = 0;
+      getIntegerParam(ADSim_ReadEngine, &readEngine);
+      getIntegerParam(ADSim_QueueDepth, &queueDepth);
+      getIntegerParam(ADSim_DirectIO, &directIO);
+      fileReader->setReadEngine(readEngine, queueDepth, directIO != 0, this->readConfig.readahead);
+      // Every dataset in the playlist is kept open for the whole acquisition
+      for (size_t entry = 0; entry < this->readConfig.playlist.size(); entry++){
+        fileReader->prepareToReadDataset(this->readConfig.playlist[entry].dname);
+      }
+      fileReader->prepareToReadDataset(this->readConfig.dname);
+      loadFrameAttributes();
+      setIntegerParam(ADSim_ReadEngineActive, fileReader->getReadEngine());
+      this->playPosition.step = 0;
+      this->playPosition.count = 0;
+      this->playPosition.frames.clear();
+      setIntegerParam(ADSim_PlaylistEntry, 0);
+      primed = false;
+      // Accept triggers from now on if a triggered mode is selected
+      getIntegerParam(ADTriggerMode, &triggerMode);
+      triggerCount = 0;
+      latencySum = 0.0;
+      latencyMax = 0.0;
+      setIntegerParam(ADSim_TriggerCount, 0);
+      setIntegerParam(ADSim_TriggersMissed, 0);
+      setDoubleParam(ADSim_TriggerLatency, 0.0);
+      setDoubleParam(ADSim_TriggerLatencyMean, 0.0);
+      setDoubleParam(ADSim_TriggerLatencyMax, 0.0);
+      epicsEventTryWait(this->triggerEventId);
+      // Place this task and the workers before any buffers are allocated
+      applyPlacement();
+      applyBufferPolicy();
+      int prefaultBuffers = 0;
+      int preallocate = 0;
+      getIntegerParam(ADSim_PrefaultBuffers, &prefaultBuffers);
+      getIntegerParam(ADSim_PoolPreallocate, &preallocate);
+      prefaultPool(prefaultBuffers, preallocate != 0);
+      updateBufferStatus();
+      updateLockStatus();
+      epicsMutexLock(this->triggerMutex);
+      this->activeTrigger = triggerMode;
+      this->missedTriggers = 0;
+      epicsMutexUnlock(this->triggerMutex);
+      // Internally timed frames follow the recorded schedule if one is given
+      replay = (triggerMode == ADSimTriggerInternal && loadFrameTimes());
+      replayIndex = -1;
+      replayOffset = 0.0;
+      epicsTimeGetCurrent(&replayStart);
+      // Internally timed members of a sync group start together and pace
+      // their frames from the start time they share
+      synced = false;
+      syncIndex = 0;
+      this->syncSkewMax = 0.0;
+      setDoubleParam(ADSim_SyncSkew, 0.0);
+      setDoubleParam(ADSim_SyncSkewMax, 0.0);
+      if (this->syncGroup && triggerMode == ADSimTriggerInternal){
+        setIntegerParam(ADSim_SyncMembers, this->syncGroup->getMembers());
+        setStringParam(ADStatusMessage, "Waiting for sync group");
+        publishStatus(true);
+        status = waitForSyncStart(&syncTime);
+        if (status != asynSuccess){
+          if (status == asynTimeout){
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: Sync group did not start in time, acquisition not started\n",
+                      driverName, functionName);
+          }
+          acquire = 0;
+          setIntegerParam(ADAcquire, acquire);
+          continue;
+        }
+        setStringParam(ADStatusMessage, "Acquiring data");
+        synced = true;
+        replayStart = syncTime;
+      }
+      // A shard emits every shardSize'th frame of the sequence, starting at
+      // its rank, stamped and paced at the time of that frame in the whole
+      // sequence
+      scheduled = synced;
+      if (this->readConfig.shardSize > 1){
+        if (triggerMode == ADSimTriggerInternal && !replay){
+          if (!synced){
+            epicsTimeGetCurrent(&syncTime);
+          }
+          getDoubleParam(ADAcquirePeriod, &acquirePeriod);
+          epicsTimeAddSeconds(&syncTime, this->readConfig.shardRank * acquirePeriod);
+          scheduled = true;
+        }
+        if (replay && this->readConfig.shardRank > 0){
+          // Measure the first frame from the start of the recorded schedule
+          replayIndex = 0;
+        }
+        if (!this->readConfig.playlist.empty()){
+          advancePlaylist(this->readConfig, this->playPosition, this->readConfig.shardRank);
+        }
+      }
     }
 
     // We are acquiring.
     // Get the current time
     epicsTimeGetCurrent(&startTime);
     getIntegerParam(ADImageMode, &imageMode);
-    getIntegerParam(NDArrayCounter, &arrayCounter);
+    arrayCounter = getArrayCount();
+    getIntegerParam(ADNumImages, &numImages);
+    getIntegerParam(ADNumImagesCounter, &numImagesCounter);
+    if (this->readConfig.shardSize > 1){
+      // The number of images counts the whole sequence
+      numImages = shardFrames(numImages, this->readConfig.shardRank, this->readConfig.shardSize);
+      if (imageMode == ADImageMultiple && numImages == 0){
+        // None of the frames requested belong to this shard
+        acquire = 0;
+        setIntegerParam(ADAcquire, acquire);
+        setIntegerParam(ADStatus, ADStatusIdle);
+        publishStatus(true);
+        continue;
+      }
+    }
+
+    // Work out how many frames to stack into this array, never going
+    // beyond the number of images requested
+    nframes = framesPerArray();
+    if (imageMode == ADImageSingle){
+      nframes = 1;
+    } else if (imageMode == ADImageMultiple && (numImages - numImagesCounter) < nframes){
+      nframes = numImages - numImagesCounter;
+      if (nframes < 1){
+        nframes = 1;
+      }
+    }
+
+    // Switch to any new read settings at this frame boundary, they have
+    // already been prepared so the frame is not delayed
+    if (this->configReady){
+      // Release the datasets that are no longer read once this frame is read
+      std::set<std::string> oldNames = configDatasets(this->readConfig);
+      std::set<std::string> newNames = configDatasets(this->nextConfig);
+      for (std::set<std::string>::iterator iter = oldNames.begin(); iter != oldNames.end(); ++iter){
+        if (newNames.count(*iter) == 0){
+          retired.push_back(*iter);
+        }
+      }
+      this->readConfig = this->nextConfig;
+      this->playPosition.step = 0;
+      this->playPosition.count = 0;
+      this->playPosition.frames.clear();
+      if (!this->readConfig.playlist.empty()){
+        advancePlaylist(this->readConfig, this->playPosition, this->readConfig.shardRank);
+      }
+      this->configReady = false;
+      this->configSwaps++;
+      setIntegerParam(ADSim_ConfigSwaps, this->configSwaps);
+      setIntegerParam(ADSim_ReadEngineActive, fileReader->getReadEngine());
+      updateLockStatus();
+    }
+    getIntegerParam(ADSim_ReadaheadFrames, &this->readConfig.readahead);
+    int outputThreads = 1;
+    getIntegerParam(ADSim_OutputThreads, &outputThreads);
+    if (outputThreads != this->geometry.getThreads()){
+      this->geometry.setThreads(outputThreads);
+      reportWorkerPlacement();
+    }
+    if (this->readConfig.planes == 3 || this->readConfig.shardSize > 1){
+      // Colour images and the frames of a shard are never stacked
+      nframes = 1;
+    }
+    // Dropped frames are not counted but still use up their place in the sequence
+    sequence = arrayCounter + this->droppedFrames;
+    frameIndex = sequence * this->readConfig.shardSize + this->readConfig.shardRank;
+    playlistIndex = 0;
+    if (!this->readConfig.playlist.empty()){
+      // Read from the dataset of the current playlist entry, which is already open
+      int entry = playlistEntry(this->readConfig, this->playPosition.step);
+      const ADSimPlaylistEntry& current = this->readConfig.playlist[entry];
+      this->readConfig.dname = current.dname;
+      this->readConfig.dims = current.dims;
+      frameIndex = this->playPosition.frames[current.dname];
+      if (nframes > current.repeats - this->playPosition.count){
+        // A stacked array never spans two playlist entries
+        nframes = current.repeats - this->playPosition.count;
+      }
+      playlistIndex = entry + 1;
+      setIntegerParam(ADSim_PlaylistEntry, playlistIndex);
+    }
 
     // Get the exposure parameters
     getDoubleParam(ADAcquireTime, &acquireTime);
@@ -187,7 +724,7 @@ void SimHDF5Detector::acqTask()
     setIntegerParam(ADStatus, ADStatusAcquire);
 
     // Call the callbacks to update any changes
-    callParamCallbacks();
+    publishStatus(false);
 
     this->unlock();
     status = epicsEventTryWait(this->stopEventId);
@@ -199,59 +736,297 @@ void SimHDF5Detector::acqTask()
       } else {
         setIntegerParam(ADStatus, ADStatusAborted);
       }
-      callParamCallbacks();
+      publishStatus(true);
     }
 
     // Update the image
     this->unlock();
-    status = readImage(arrayCounter);
+    if (this->readConfig.readahead > 0 && (!primed || sequence != nextSequence)){
+      // Reading has started or the sequence has jumped, for example by
+      // writing NDArrayCounter, so hint the whole readahead window.  After
+      // this readImage only hints the frames entering the window.
+      for (int frame = nframes; frame < nframes + this->readConfig.readahead; frame++){
+        prefetchFrame(this->readConfig, this->playPosition, frameIndex, frame);
+      }
+    }
+    primed = true;
+    nextSequence = sequence + nframes;
+    status = readImage(frameIndex, nframes);
+    for (size_t name = 0; name < retired.size(); name++){
+      // The datasets switched away from are no longer needed
+      fileReader->releaseDataset(retired[name]);
+    }
+    retired.clear();
     this->lock();
-    if (status) continue;
+    dropFrame = false;
+    exhausted = (status && this->pRaw == NULL && acquire);
+    if (exhausted){
+      // The NDArrayPool has no free buffers, apply the back pressure policy.
+      // Each frame that finds the pool exhausted is counted once.
+      this->poolExhaustedCount++;
+      setIntegerParam(ADSim_PoolExhausted, this->poolExhaustedCount);
+      getIntegerParam(ADSim_BackPressure, &backPressure);
+      if (backPressure == ADSimBackPressureDrop){
+        // Drop this frame but keep to the schedule
+        dropFrame = true;
+        status = asynSuccess;
+      } else if (backPressure == ADSimBackPressureAdaptive){
+        // Slow down, doubling the extra delay for every frame held up
+        this->throttle = (this->throttle < SIMHDF5_MIN_THROTTLE) ? SIMHDF5_MIN_THROTTLE : this->throttle * 2.0;
+        if (this->throttle > SIMHDF5_MAX_THROTTLE){
+          this->throttle = SIMHDF5_MAX_THROTTLE;
+        }
+        setDoubleParam(ADSim_Throttle, this->throttle);
+      }
+      while (status && this->pRaw == NULL && acquire){
+        // Wait for downstream to release a buffer and then try this frame
+        // again.  The frame keeps its start time, so a frame held up past
+        // its period is counted as late.
+        publishStatus(false);
+        this->unlock();
+        waitStatus = epicsEventWaitWithTimeout(this->stopEventId,
+                                               backPressure == ADSimBackPressureAdaptive ? this->throttle : SIMHDF5_MIN_THROTTLE);
+        if (waitStatus != epicsEventWaitOK){
+          status = readImage(frameIndex, nframes);
+        }
+        this->lock();
+        if (waitStatus == epicsEventWaitOK){
+          acquire = 0;
+          if (imageMode == ADImageContinuous){
+            setIntegerParam(ADStatus, ADStatusIdle);
+          } else {
+            setIntegerParam(ADStatus, ADStatusAborted);
+          }
+          publishStatus(true);
+        }
+      }
+    }
+    if (status && this->pRaw == NULL){
+      continue;
+    } else if (status && this->pRaw != NULL && acquire){
+      // The frame could not be read, stop rather than publish whatever is in the buffer
+      acquire = 0;
+      setIntegerParam(ADAcquire, acquire);
+      setIntegerParam(ADStatus, ADStatusError);
+      setStringParam(ADStatusMessage, "Failed to read frame");
+      publishStatus(true);
+      continue;
+    } else if (status){
+      continue;
+    }
 
     if (!acquire) continue;
 
+    if (!this->readConfig.playlist.empty()){
+      // Skip the frames emitted by the other shards
+      advancePlaylist(this->readConfig, this->playPosition, nframes * this->readConfig.shardSize);
+    }
+
+    if (replay){
+      // Move the schedule on to the last frame of the array
+      getDoubleParam(ADSim_TimestampSpeedup, &speedup);
+      replayFrames.clear();
+      for (int frame = 0; frame < nframes; frame++){
+        replayOffset = replayStep(frameIndex + frame, &replayIndex, replayOffset, speedup, acquirePeriod);
+        replayFrames.push_back(replayOffset);
+      }
+      replayFirst = replayFrames[0];
+    }
+
+    if (!exhausted && this->throttle > 0.0){
+      // Downstream is keeping up again, so reduce any adaptive slow down
+      this->throttle = (this->throttle < SIMHDF5_MIN_THROTTLE) ? 0.0 : this->throttle * 0.5;
+      setDoubleParam(ADSim_Throttle, this->throttle);
+    }
+
     setIntegerParam(ADStatus, ADStatusReadout);
     // Call the callbacks to update any changes
-    callParamCallbacks();
+    publishStatus(false);
 
     pImage = this->pRaw;
 
     // Get the current parameters
-    getIntegerParam(NDArrayCounter, &imageCounter);
+    imageCounter = getArrayCount();
     getIntegerParam(ADNumImages, &numImages);
     getIntegerParam(ADNumImagesCounter, &numImagesCounter);
     getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
-    imageCounter++;
-    numImagesCounter++;
-    setIntegerParam(NDArrayCounter, imageCounter);
-    setIntegerParam(ADNumImagesCounter, numImagesCounter);
-
-    // Put the frame number and time stamp into the buffer
-    pImage->uniqueId = imageCounter;
-    pImage->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
-
-    // Get any attributes that have been defined for this driver
-    this->getAttributes(pImage->pAttributeList);
-
-    if (arrayCallbacks){
-      // Call the NDArray callback
-      // Must release the lock here, or we can get into a deadlock, because we can
-      // block on the plugin lock, and the plugin can be calling us
+    numImages = shardFrames(numImages, this->readConfig.shardRank, this->readConfig.shardSize);
+    // The array counter counts frames so that stacked arrays keep the
+    // frame numbering of the dataset.  A shard numbers its frames by their
+    // position in the whole sequence.  Dropped frames are not counted as
+    // acquired, so the unique IDs of the frames that follow skip over them.
+    firstId = (int)((imageCounter + this->droppedFrames) * this->readConfig.shardSize + this->readConfig.shardRank + 1);
+
+    if (dropFrame){
+      this->droppedFrames += nframes;
+      setIntegerParam(ADSim_DroppedFrames, this->droppedFrames);
+    } else {
+      imageCounter += nframes;
+      numImagesCounter += nframes;
+      setArrayCount(imageCounter);
+      setIntegerParam(ADNumImagesCounter, numImagesCounter);
+    }
+
+    if (!dropFrame){
+      // Put the frame number and time stamp into the buffer
+      pImage->uniqueId = firstId;
+      pImage->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
+      if (scheduled && !replay){
+        // Stamp the frame with its time on the shared clock or in the whole sequence
+        pImage->epicsTS = syncTime;
+        pImage->timeStamp = syncTime.secPastEpoch + syncTime.nsec / 1.e9;
+      }
+      if (replay){
+        // Stamp the frame with its time on the recorded schedule
+        pImage->epicsTS = replayStart;
+        epicsTimeAddSeconds(&pImage->epicsTS, replayFirst);
+        pImage->timeStamp = pImage->epicsTS.secPastEpoch + pImage->epicsTS.nsec / 1.e9;
+      }
+
+      // Get any attributes that have been defined for this driver
+      this->getAttributes(pImage->pAttributeList);
+      pImage->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &this->rawColorMode);
+      addFrameAttributes(pImage->pAttributeList, frameIndex, nframes);
+      if (playlistIndex > 0){
+        pImage->pAttributeList->add("PlaylistEntry", "Playlist entry the frame was read from", NDAttrInt32, &playlistIndex);
+        pImage->pAttributeList->add("DatasetName", "Dataset the frame was read from", NDAttrString, (void *)this->readConfig.dname.c_str());
+      }
+
+      // Stacked arrays carry the unique ID and time stamp of every frame
+      if (nframes > 1){
+        for (int frame = 0; frame < nframes; frame++){
+          int frameId = firstId + frame;
+          double frameTime = pImage->timeStamp + frame * acquirePeriod;
+          if (replay){
+            frameTime = pImage->timeStamp + replayFrames[frame] - replayFirst;
+          }
+          epicsSnprintf(attrName, sizeof(attrName), "FrameUniqueId%d", frame);
+          pImage->pAttributeList->add(attrName, "Unique ID of frame in stack", NDAttrInt32, &frameId);
+          epicsSnprintf(attrName, sizeof(attrName), "FrameTimeStamp%d", frame);
+          pImage->pAttributeList->add(attrName, "Time stamp of frame in stack", NDAttrFloat64, &frameTime);
+        }
+      }
+
+      if (triggerMode == ADSimTriggerInternal && !replay && arrayCallbacks){
+        // Call the NDArray callback
+        // Must release the lock here, or we can get into a deadlock, because we can
+        // block on the plugin lock, and the plugin can be calling us
+        this->unlock();
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                  "%s:%s: calling imageData callback\n", driverName, functionName);
+        publishFrame(pImage);
+        this->lock();
+        if (synced){
+          publishSkew(syncIndex);
+        }
+      }
+    }
+
+    if (replay){
+      // The frame is read and ready, hold it until the recorded time of its
+      // last frame.  A dropped frame keeps its place in the schedule.
+      deadline = replayStart;
+      epicsTimeAddSeconds(&deadline, replayOffset);
+      epicsTimeGetCurrent(&now);
+      delay = epicsTimeDiffInSeconds(&deadline, &now);
+      status = epicsEventWaitTimeout;
+      if (delay < 0.0){
+        this->lateFrames += nframes;
+        setIntegerParam(ADSim_LateFrames, this->lateFrames);
+      } else {
+        setIntegerParam(ADStatus, ADStatusWaiting);
+        publishStatus(false);
+        this->unlock();
+        status = epicsEventWaitWithTimeout(this->stopEventId, delay);
+        this->lock();
+      }
+      if (status == epicsEventWaitOK){
+        // Stopped while waiting, the frame was never emitted
+        acquire = 0;
+        if (!dropFrame){
+          setArrayCount(imageCounter - nframes);
+          setIntegerParam(ADNumImagesCounter, numImagesCounter - nframes);
+        }
+        if (imageMode == ADImageContinuous){
+          setIntegerParam(ADStatus, ADStatusIdle);
+        } else {
+          setIntegerParam(ADStatus, ADStatusAborted);
+        }
+        publishStatus(true);
+        continue;
+      }
+      if (!dropFrame && arrayCallbacks){
+        this->unlock();
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                  "%s:%s: calling imageData callback\n", driverName, functionName);
+        publishFrame(pImage);
+        this->lock();
+        if (synced){
+          publishSkew(syncIndex);
+        }
+      }
+    }
+
+    if (triggerMode != ADSimTriggerInternal){
+      // The frame is read and ready, so only the callback is left to do once
+      // the trigger arrives.  A dropped frame uses up its trigger.
+      setIntegerParam(ADStatus, ADStatusWaiting);
+      publishStatus(false);
       this->unlock();
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
-                "%s:%s: calling imageData callback\n", driverName, functionName);
-      doCallbacksGenericPointer(pImage, NDArrayData, 0);
+      bool triggered = waitForTrigger(&triggerTime);
+      if (triggered && !dropFrame){
+        pImage->epicsTS = triggerTime;
+        pImage->timeStamp = triggerTime.secPastEpoch + triggerTime.nsec / 1.e9;
+        if (arrayCallbacks){
+          publishFrame(pImage);
+        }
+        // The latency runs until the frame has been handed to the plugins
+        epicsTimeGetCurrent(&publishTime);
+      }
       this->lock();
+      if (!triggered){
+        // Stopped while waiting, the frame was never emitted
+        acquire = 0;
+        if (!dropFrame){
+          setArrayCount(imageCounter - nframes);
+          setIntegerParam(ADNumImagesCounter, numImagesCounter - nframes);
+        }
+        if (imageMode == ADImageContinuous){
+          setIntegerParam(ADStatus, ADStatusIdle);
+        } else {
+          setIntegerParam(ADStatus, ADStatusAborted);
+        }
+        publishStatus(true);
+        continue;
+      }
+      if (!dropFrame){
+        latency = epicsTimeDiffInSeconds(&publishTime, &triggerTime);
+        triggerCount++;
+        latencySum += latency;
+        if (latency > latencyMax){
+          latencyMax = latency;
+        }
+        setIntegerParam(ADSim_TriggerCount, triggerCount);
+        setDoubleParam(ADSim_TriggerLatency, latency);
+        setDoubleParam(ADSim_TriggerLatencyMean, latencySum / triggerCount);
+        setDoubleParam(ADSim_TriggerLatencyMax, latencyMax);
+      }
+      epicsMutexLock(this->triggerMutex);
+      setIntegerParam(ADSim_TriggersMissed, this->missedTriggers);
+      epicsMutexUnlock(this->triggerMutex);
     }
 
-    // See if acquisition is done
-    if ((imageMode == ADImageSingle) ||
+    // Frames keep their index on the shared clock even when dropped
+    syncIndex += nframes;
+
+    // See if acquisition is done, a dropped frame does not count
+    if ((imageMode == ADImageSingle && !dropFrame) ||
         ((imageMode == ADImageMultiple) &&
         (numImagesCounter >= numImages))){
 
       // First do callback on ADStatus.
       setIntegerParam(ADStatus, ADStatusIdle);
-      callParamCallbacks();
+      publishStatus(true);
 
       acquire = 0;
       setIntegerParam(ADAcquire, acquire);
@@ -260,20 +1035,56 @@ void SimHDF5Detector::acqTask()
     }
 
     // Call the callbacks to update any changes
-    callParamCallbacks();
+    publishStatus(!acquire);
+
+    // New read settings are passed to the loader task, which loads their
+    // datasets while frames are read with the current settings
+    if (acquire && this->configChanged){
+      this->configChanged = false;
+      if (captureConfig(this->loadConfig)){
+        this->configLoading = true;
+        this->configRequests++;
+        epicsEventSignal(this->loadEventId);
+      }
+    }
+
+    // Once loaded, prepare the new settings in the time left before the next
+    // frame.  The current settings stay in use until the next frame boundary.
+    if (acquire && this->configLoading && this->configLoads == this->configRequests){
+      ADSimReadConfig config = this->loadConfig;
+      this->configLoading = false;
+      this->unlock();
+      warmConfig(config, (imageCounter + this->droppedFrames) * config.shardSize + config.shardRank, nframes);
+      this->lock();
+      this->nextConfig = config;
+      this->configReady = true;
+    }
 
     // If we are acquiring then sleep for the acquire period minus elapsed time.
-    if (acquire){
+    // Triggered modes are paced by the triggers and replays by the recorded
+    // frame times instead.
+    if (acquire && triggerMode == ADSimTriggerInternal && !replay){
       epicsTimeGetCurrent(&endTime);
       elapsedTime = epicsTimeDiffInSeconds(&endTime, &startTime);
-      delay = acquirePeriod - elapsedTime;
+      delay = acquirePeriod * nframes + this->throttle - elapsedTime;
+      if (scheduled){
+        // The next frame is due at a fixed time on the shared clock, so
+        // members do not drift apart, and a shard skips the frames of the others
+        epicsTimeAddSeconds(&syncTime, acquirePeriod * nframes * this->readConfig.shardSize + this->throttle);
+        delay = epicsTimeDiffInSeconds(&syncTime, &endTime);
+      }
       asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
                 "%s:%s: delay=%f\n",
                 driverName, functionName, delay);
+      if (delay < 0.0){
+        // We could not keep up with the requested period
+        this->lateFrames += nframes;
+        setIntegerParam(ADSim_LateFrames, this->lateFrames);
+      }
       if (delay >= 0.0){
         // We set the status to waiting to indicate we are in the period delay
         setIntegerParam(ADStatus, ADStatusWaiting);
-        callParamCallbacks();
+        publishStatus(false);
         this->unlock();
         status = epicsEventWaitWithTimeout(this->stopEventId, delay);
         this->lock();
@@ -284,13 +1095,709 @@ void SimHDF5Detector::acqTask()
           } else {
             setIntegerParam(ADStatus, ADStatusAborted);
           }
-          callParamCallbacks();
+          publishStatus(true);
         }
       }
     }
   }
 }
 
+/** File loading task.
+ *
+ * Waits for a load to be requested, then opens and scans the file and
+ * preloads the selected dataset.  The datasets of read settings changed
+ * during an acquisition are loaded here too, before the acquisition task
+ * switches to them.  The reader is only called with the lock released, so
+ * the port stays responsive however long the load takes.
+ */
+void SimHDF5Detector::loaderTask()
+{
+  int loadState = ADSimLoadIdle;
+
+  this->lock();
+  while (1){
+    this->unlock();
+    epicsEventWait(this->loadEventId);
+    this->lock();
+    while (this->configLoads != this->configRequests){
+      preloadConfig();
+    }
+    getIntegerParam(ADSim_LoadState, &loadState);
+    if (loadState != ADSimLoadOpening){
+      continue;
+    }
+    if (loadFile() == asynSuccess){
+      preloadFile();
+    }
+    this->cancelLoad = false;
+    callParamCallbacks();
+  }
+}
+
+/** Status publication task.
+ *
+ * Publishes the status and counter parameters changed by the acquisition
+ * task, then waits for the status update period before publishing again.
+ * Changes made during the period are published together at its end.
+ */
+void SimHDF5Detector::statusTask()
+{
+  double rate = 0.0;
+
+  this->lock();
+  while (1){
+    this->unlock();
+    epicsEventWait(this->statusEventId);
+    this->lock();
+    if (this->statusPending){
+      publishStatus(true);
+    }
+    getDoubleParam(ADSim_StatusRate, &rate);
+    if (rate > 0.0){
+      this->unlock();
+      epicsThreadSleep(1.0 / rate);
+      this->lock();
+    }
+  }
+}
+
+/** Return the number of frames counted by NDArrayCounter.
+  *
+  * The parameter is 32 bits and wraps on long runs, so the full count is
+  * kept alongside it.  If the parameter no longer matches the low bits of
+  * the count it has been set by a client, and counting starts again from
+  * the value set.  Called with the lock held.
+  */
+hsize_t SimHDF5Detector::getArrayCount()
+{
+  int counter = 0;
+  getIntegerParam(NDArrayCounter, &counter);
+  if ((epicsUInt32)counter != (epicsUInt32)this->arrayCount){
+    this->arrayCount = (epicsUInt32)counter;
+  }
+  return this->arrayCount;
+}
+
+/** Set the number of frames counted by NDArrayCounter.
+  * \param[in] count the full count, of which the low 32 bits are published.
+  */
+void SimHDF5Detector::setArrayCount(hsize_t count)
+{
+  this->arrayCount = count;
+  setIntegerParam(NDArrayCounter, (int)(epicsUInt32)count);
+}
+
+/** Publish the status and counter parameters.
+  * \param[in] force publish at once regardless of the status update rate.
+  *
+  * Called with the lock held.  Unless forced, or the status update rate
+  * <b>ADSim_StatusRate</b> is 0, the acquisition task only marks the
+  * parameters as changed and the status task publishes them at that rate,
+  * so that high frame rates do not flood clients with updates.  A change
+  * replaced by the next one before it is published counts as a saved
+  * callback.  State changes are always forced so clients see exact final
+  * counts and transitions.  The number of callbacks saved, and an estimate
+  * of the time that would have been spent making them, are published along
+  * with the other parameters.
+  */
+void SimHDF5Detector::publishStatus(bool force)
+{
+  epicsTimeStamp start, done;
+  double rate = 0.0;
+
+  if (!force){
+    getDoubleParam(ADSim_StatusRate, &rate);
+    if (rate > 0.0){
+      if (this->statusPending){
+        this->savedCallbacks++;
+      } else {
+        this->statusPending = true;
+        epicsEventSignal(this->statusEventId);
+      }
+      return;
+    }
+  }
+  epicsTimeGetCurrent(&start);
+  setIntegerParam(ADSim_PoolFreeBuffers, this->pNDArrayPool->getNumFree());
+  setIntegerParam(ADSim_PoolUsedBuffers, this->pNDArrayPool->getNumBuffers() - this->pNDArrayPool->getNumFree());
+  setIntegerParam(ADSim_CallbacksSaved, this->savedCallbacks);
+  setDoubleParam(ADSim_CallbackTimeSaved, this->savedCallbacks * this->callbackCost);
+  callParamCallbacks();
+  epicsTimeGetCurrent(&done);
+  // Keep a running average of the cost of a callback
+  double cost = epicsTimeDiffInSeconds(&done, &start);
+  if (this->callbackCost == 0.0){
+    this->callbackCost = cost;
+  } else {
+    this->callbackCost = 0.9 * this->callbackCost + 0.1 * cost;
+  }
+  this->statusPending = false;
+}
+
+/** Publish a frame on address 0 and its regions on their own addresses.
+  * \param[in] pImage the frame.
+  *
+  * Called from the acquisition task without the lock held, so that plugins
+  * calling the driver do not deadlock.  Every region is taken from the frame
+  * that was read once for address 0.  Regions that are contiguous in memory
+  * are published as views that share the memory of the frame, and the rest
+  * are copied into NDArrays of their own.
+  */
+void SimHDF5Detector::publishFrame(NDArray *pImage)
+{
+  const ADSimReadConfig& config = this->readConfig;
+  const char *functionName = "publishFrame";
+
+  doCallbacksGenericPointer(pImage, NDArrayData, 0);
+  if (config.regions.empty()){
+    return;
+  }
+
+  // Work out the layout of the frame in memory
+  NDArrayInfo_t info;
+  pImage->getInfo(&info);
+  int planes = 1;
+  int xIndex = 0;
+  int yIndex = 1;
+  size_t pixelBytes = info.bytesPerElement;
+  size_t subRows = 1;
+  if (config.planes == 3){
+    if (config.colorMode == NDColorModeRGB1){
+      xIndex = 1;
+      yIndex = 2;
+      pixelBytes *= 3;
+    } else if (config.colorMode == NDColorModeRGB2){
+      yIndex = 2;
+      subRows = 3;
+    } else {
+      planes = 3;
+    }
+  } else if (pImage->ndims == 3){
+    planes = (int)pImage->dims[2].size;
+  }
+  size_t rowBytes = (size_t)config.width * pixelBytes * subRows;
+  size_t planeBytes = rowBytes * config.height;
+
+  for (size_t index = 0; index < config.regions.size(); index++){
+    const ADSimRegion& region = config.regions[index];
+    size_t dims[ND_ARRAY_MAX_DIMS];
+    for (int dim = 0; dim < pImage->ndims; dim++){
+      dims[dim] = pImage->dims[dim].size;
+    }
+    dims[xIndex] = region.sizeX;
+    dims[yIndex] = region.sizeY;
+
+    NDArray *pRegion = NULL;
+    if (regionContiguous(region, config.width, config.height, config.colorMode, planes)){
+      size_t offset = (size_t)region.minY * rowBytes + (size_t)region.minX * pixelBytes;
+      size_t bytes = (size_t)region.sizeX * pixelBytes;
+      if (region.sizeX == config.width){
+        bytes = (size_t)region.sizeY * rowBytes * planes;
+      }
+      pRegion = this->viewPool->view(pImage, pImage->ndims, dims, offset, bytes);
+    } else {
+      pRegion = this->pNDArrayPool->alloc(pImage->ndims, dims, pImage->dataType, 0, NULL);
+      if (pRegion){
+        // Copy each row of the region from each plane
+        size_t copyBytes = (size_t)region.sizeX * pixelBytes;
+        size_t subRowBytes = (size_t)config.width * pixelBytes;
+        const char *src = (const char *)pImage->pData;
+        char *dst = (char *)pRegion->pData;
+        for (int plane = 0; plane < planes; plane++){
+          for (int y = 0; y < region.sizeY; y++){
+            const char *row = src + plane * planeBytes + (size_t)(region.minY + y) * rowBytes +
+                              (size_t)region.minX * pixelBytes;
+            for (size_t sub = 0; sub < subRows; sub++){
+              memcpy(dst, row + sub * subRowBytes, copyBytes);
+              dst += copyBytes;
+            }
+          }
+        }
+      }
+    }
+    if (!pRegion){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: unable to allocate the region on address %d\n",
+                driverName, functionName, region.addr);
+      continue;
+    }
+
+    // The region carries the identity, time and attributes of the frame
+    for (int dim = 0; dim < pImage->ndims; dim++){
+      pRegion->dims[dim].offset = pImage->dims[dim].offset;
+      pRegion->dims[dim].binning = pImage->dims[dim].binning;
+      pRegion->dims[dim].reverse = pImage->dims[dim].reverse;
+    }
+    pRegion->dims[xIndex].offset += region.minX * pImage->dims[xIndex].binning;
+    pRegion->dims[yIndex].offset += region.minY * pImage->dims[yIndex].binning;
+    pRegion->uniqueId = pImage->uniqueId;
+    pRegion->timeStamp = pImage->timeStamp;
+    pRegion->epicsTS = pImage->epicsTS;
+    pImage->pAttributeList->copy(pRegion->pAttributeList);
+    doCallbacksGenericPointer(pRegion, NDArrayData, region.addr);
+    pRegion->release();
+  }
+}
+
+/** Trigger the emission of the next frame.
+  * \param[in] source the trigger mode that the trigger belongs to.
+  * \return asynError unless acquiring in the trigger mode of the source.
+  *
+  * May be called from any thread, without the driver lock.  The time of the
+  * trigger is recorded and the acquisition task is woken.  The frame is read
+  * before the trigger arrives, so the task only has to make the NDArray
+  * callback.  Triggers that arrive faster than frames can be emitted wait
+  * in turn, and once too many are waiting further triggers are missed.
+  */
+asynStatus SimHDF5Detector::trigger(int source)
+{
+  asynStatus status = asynSuccess;
+  epicsTimeStamp now;
+
+  epicsTimeGetCurrent(&now);
+  epicsMutexLock(this->triggerMutex);
+  if (this->activeTrigger != source || source == ADSimTriggerInternal){
+    status = asynError;
+  } else if (this->pendingTriggers.size() >= SIMHDF5_MAX_PENDING_TRIGGERS){
+    this->missedTriggers++;
+  } else {
+    this->pendingTriggers.push_back(now);
+  }
+  epicsMutexUnlock(this->triggerMutex);
+  if (status == asynSuccess){
+    epicsEventSignal(this->triggerEventId);
+  }
+  return status;
+}
+
+/** Wait for a trigger to emit the next frame.
+  * \param[out] triggerTime the time the trigger arrived.
+  * \return false if the acquisition was stopped while waiting.
+  *
+  * Called by the acquisition task without the driver lock held.
+  */
+bool SimHDF5Detector::waitForTrigger(epicsTimeStamp *triggerTime)
+{
+  while (1){
+    epicsMutexLock(this->triggerMutex);
+    if (!this->pendingTriggers.empty()){
+      *triggerTime = this->pendingTriggers.front();
+      this->pendingTriggers.pop_front();
+      epicsMutexUnlock(this->triggerMutex);
+      return true;
+    }
+    epicsMutexUnlock(this->triggerMutex);
+    if (epicsEventTryWait(this->stopEventId) == epicsEventWaitOK){
+      return false;
+    }
+    epicsEventWait(this->triggerEventId);
+  }
+}
+
+/** Wait at the start barrier of the sync group for the other members to start.
+  * \param[out] start the start time shared by the group.
+  * \return asynSuccess once released, asynTimeout if the group did not start
+  *         within <b>ADSim_SyncTimeout</b> or asynError if stopped while waiting.
+  *
+  * Called by the acquisition task with the lock held, which is released
+  * while waiting.  The barrier wakes members through the trigger event,
+  * which a stop also signals.
+  */
+asynStatus SimHDF5Detector::waitForSyncStart(epicsTimeStamp *start)
+{
+  asynStatus status = asynSuccess;
+  double timeout = 0.0;
+  epicsTimeStamp begin, now;
+
+  getDoubleParam(ADSim_SyncTimeout, &timeout);
+  SimHDF5SyncGroup *group = this->syncGroup;
+  this->unlock();
+  epicsTimeGetCurrent(&begin);
+  int ticket = group->arrive(this);
+  while (!group->released(ticket, start)){
+    if (epicsEventTryWait(this->stopEventId) == epicsEventWaitOK){
+      status = asynError;
+      break;
+    }
+    epicsTimeGetCurrent(&now);
+    double remaining = timeout - epicsTimeDiffInSeconds(&now, &begin);
+    if (remaining <= 0.0){
+      status = asynTimeout;
+      break;
+    }
+    epicsEventWaitWithTimeout(this->triggerEventId, remaining);
+  }
+  if (status != asynSuccess){
+    group->withdraw(this);
+  }
+  this->lock();
+  return status;
+}
+
+/** Publish how far this detector lags the rest of its sync group.
+  * \param[in] frame index of the frame just published, counted from the shared start.
+  *
+  * Called by the acquisition task with the lock held.
+  */
+void SimHDF5Detector::publishSkew(size_t frame)
+{
+  epicsTimeStamp now;
+  epicsTimeGetCurrent(&now);
+  double skew = this->syncGroup->published(frame, now);
+  if (skew > this->syncSkewMax){
+    this->syncSkewMax = skew;
+  }
+  setDoubleParam(ADSim_SyncSkew, skew);
+  setDoubleParam(ADSim_SyncSkewMax, this->syncSkewMax);
+}
+
+/** Place the acquisition task and the frame building workers.
+  *
+  * Called by the acquisition task with the lock held when an acquisition
+  * starts, as a thread can only place itself.  The task is moved onto the
+  * selected CPUs and given its priority, and memory it allocates, such as
+  * NDArrayPool buffers, is preferably taken from the NUMA node of those CPUs.
+  * The workers pick up their placement when they are next started, and a
+  * failure to place them is reported once they are.
+  */
+void SimHDF5Detector::applyPlacement()
+{
+  char cpus[SIMHDF5_MAX_CPU_LIST_LEN];
+  char message[SIMHDF5_MAX_MESSAGE_LEN];
+  int priority = 0;
+  int numaNode = -1;
+  const char *functionName = "applyPlacement";
+
+  cpus[0] = '\0';
+  getStringParam(ADSim_AcqCPUs, SIMHDF5_MAX_CPU_LIST_LEN-1, cpus);
+  cpus[SIMHDF5_MAX_CPU_LIST_LEN-1] = '\0';
+  getIntegerParam(ADSim_AcqPriority, &priority);
+  // Scheduling is left as created unless a real time priority is or was in use
+  int status = SimHDF5Placement::applyToThread(cpus, (priority > 0 || this->acqRealtime) ? priority : -1);
+  if (status == 0){
+    this->acqRealtime = (priority > 0);
+    setStringParam(ADSim_PlacementStatus, "OK");
+  } else {
+    epicsSnprintf(message, sizeof(message), "Placement failed: %s", strerror(status));
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: Unable to place acquisition task on CPUs \"%s\" with priority %d: %s\n",
+              driverName, functionName, cpus, priority, strerror(status));
+    setStringParam(ADSim_PlacementStatus, message);
+  }
+  getIntegerParam(ADSim_NumaNode, &numaNode);
+  SimHDF5Placement::preferNode(numaNode);
+
+  cpus[0] = '\0';
+  getStringParam(ADSim_WorkerCPUs, SIMHDF5_MAX_CPU_LIST_LEN-1, cpus);
+  cpus[SIMHDF5_MAX_CPU_LIST_LEN-1] = '\0';
+  getIntegerParam(ADSim_WorkerPriority, &priority);
+  this->geometry.setPlacement(cpus, priority);
+  // Workers left running keep the placement they failed to get
+  reportWorkerPlacement();
+}
+
+/** Publish a failure to place the frame building workers.
+  *
+  * Called by the acquisition task with the lock held once the workers have
+  * been started.  The workers place themselves, so a failure is only known
+  * after setThreads has waited for them.
+  */
+void SimHDF5Detector::reportWorkerPlacement()
+{
+  char cpus[SIMHDF5_MAX_CPU_LIST_LEN];
+  char message[SIMHDF5_MAX_MESSAGE_LEN];
+  int priority = 0;
+  const char *functionName = "reportWorkerPlacement";
+
+  int status = this->geometry.getPlacementError();
+  if (status == 0){
+    return;
+  }
+  cpus[0] = '\0';
+  getStringParam(ADSim_WorkerCPUs, SIMHDF5_MAX_CPU_LIST_LEN-1, cpus);
+  cpus[SIMHDF5_MAX_CPU_LIST_LEN-1] = '\0';
+  getIntegerParam(ADSim_WorkerPriority, &priority);
+  epicsSnprintf(message, sizeof(message), "Worker placement failed: %s", strerror(status));
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: Unable to place workers on CPUs \"%s\" with priority %d: %s\n",
+            driverName, functionName, cpus, priority, strerror(status));
+  setStringParam(ADSim_PlacementStatus, message);
+}
+
+/** Publish how much of the preloaded frames is locked into memory.
+  *
+  * A failure to lock is reported with the RLIMIT_MEMLOCK limit, which is
+  * the usual cause.  Frames that could not be locked have been prefaulted
+  * instead.
+  */
+void SimHDF5Detector::updateLockStatus()
+{
+  char message[SIMHDF5_MAX_MESSAGE_LEN];
+  int memoryLock = 0;
+  struct rlimit limit;
+  const char *functionName = "updateLockStatus";
+
+  getIntegerParam(ADSim_MemoryLock, &memoryLock);
+  setDoubleParam(ADSim_LockedBytes, (double)fileReader->getLockedBytes());
+  int error = fileReader->getLockError();
+  if (error != 0){
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY){
+      epicsSnprintf(message, sizeof(message), "mlock failed: %s, RLIMIT_MEMLOCK is %lu bytes",
+                    strerror(error), (unsigned long)limit.rlim_cur);
+    } else {
+      epicsSnprintf(message, sizeof(message), "mlock failed: %s", strerror(error));
+    }
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: Unable to lock preloaded frames, they have been prefaulted instead (%s)\n",
+              driverName, functionName, message);
+    setStringParam(ADSim_LockStatus, message);
+  } else if (memoryLock){
+    setStringParam(ADSim_LockStatus, "OK");
+  } else {
+    setStringParam(ADSim_LockStatus, "Not locked");
+  }
+}
+
+/** Load the recorded frame times named by the timestamp dataset parameter.
+  * \return false if no dataset is named or it cannot be read, in which case
+  * frames are paced by the acquire period.
+  *
+  * Called by the acquisition task when an acquisition starts.  The times
+  * are read once and kept until the dataset name or the file changes.
+  */
+bool SimHDF5Detector::loadFrameTimes()
+{
+  char path[MAX_FILENAME_LEN];
+  bool integer = false;
+  const char *functionName = "loadFrameTimes";
+
+  path[0] = '\0';
+  getStringParam(ADSim_TimestampDset, MAX_FILENAME_LEN-1, path);
+  path[MAX_FILENAME_LEN-1] = '\0';
+  if (path[0] == '\0'){
+    this->frameTimes.clear();
+    this->frameTimesPath.clear();
+  } else if (path != this->frameTimesPath || this->frameTimes.empty()){
+    this->frameTimesPath = path;
+    this->frameTimesMean = 0.0;
+    if (!fileReader->readColumn(path, this->frameTimes, &integer)){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: Unable to read frame times from %s, using the acquire period\n",
+                driverName, functionName, path);
+      this->frameTimes.clear();
+    } else if (this->frameTimes.size() > 1 && this->frameTimes.back() > this->frameTimes.front()){
+      this->frameTimesMean = (this->frameTimes.back() - this->frameTimes.front()) / (this->frameTimes.size() - 1);
+    }
+  }
+  setIntegerParam(ADSim_TimestampCount, (int)this->frameTimes.size());
+  return !this->frameTimes.empty();
+}
+
+/** Advance the replay schedule by one frame.
+  * \param[in] frame index of the frame in the dataset
+  * \param[in,out] lastIndex index of the previous recorded time, -1 for the first frame
+  * \param[in] offset time (s) of the previous frame since the replay started
+  * \param[in] speedup factor by which the recorded intervals are shortened, 1 if not positive
+  * \param[in] period interval (s) used when the recorded interval is unknown
+  * \return the time (s) of this frame since the replay started.
+  *
+  * The schedule is built from the recorded intervals rather than the time
+  * that frames were actually emitted, so late frames do not cause drift.
+  * When the dataset wraps around the mean recorded interval is used.
+  */
+double SimHDF5Detector::replayStep(hsize_t frame, int *lastIndex, double offset, double speedup, double period)
+{
+  int index = (int)(frame % this->frameTimes.size());
+  if (*lastIndex >= 0){
+    double interval = this->frameTimes[index] - this->frameTimes[*lastIndex];
+    if (index <= *lastIndex){
+      interval = this->frameTimesMean > 0.0 ? this->frameTimesMean : period;
+    }
+    if (interval > 0.0){
+      offset += interval / (speedup > 0.0 ? speedup : 1.0);
+    }
+  }
+  *lastIndex = index;
+  return offset;
+}
+
+/** Load the per-frame values named by the attribute datasets parameter.
+  *
+  * The parameter is a comma separated list of datasets, each optionally
+  * preceded by the attribute name and "=", for example
+  * "Exposure=/entry/instrument/detector/count_time,/entry/sample/temperature".
+  * Without a name the last part of the dataset path is used.  Called by the
+  * acquisition task when the datasets are prepared for reading.  The values
+  * are read once and kept until the list or the file changes, so attaching
+  * them to a frame costs only an array lookup for each attribute.
+  */
+void SimHDF5Detector::loadFrameAttributes()
+{
+  char list[SIMHDF5_MAX_ATTRIBUTE_LIST_LEN];
+  const char *functionName = "loadFrameAttributes";
+
+  list[0] = '\0';
+  getStringParam(ADSim_AttributeDsets, SIMHDF5_MAX_ATTRIBUTE_LIST_LEN-1, list);
+  list[SIMHDF5_MAX_ATTRIBUTE_LIST_LEN-1] = '\0';
+  if (list == this->frameAttributesList){
+    return;
+  }
+  this->frameAttributesList = list;
+  this->frameAttributes.clear();
+  std::stringstream ss(this->frameAttributesList);
+  std::string item;
+  while (std::getline(ss, item, ',')){
+    // Trim surrounding white space
+    size_t first = item.find_first_not_of(" \t");
+    size_t last = item.find_last_not_of(" \t");
+    if (first == std::string::npos){
+      continue;
+    }
+    item = item.substr(first, last - first + 1);
+    ADSimFrameAttribute attribute;
+    size_t equals = item.find('=');
+    if (equals != std::string::npos){
+      attribute.name = item.substr(0, equals);
+      attribute.path = item.substr(equals + 1);
+    } else {
+      attribute.path = item;
+      attribute.name = item.substr(item.find_last_of('/') + 1);
+    }
+    if (attribute.name.empty() || !fileReader->readColumn(attribute.path, attribute.values, &attribute.integer)){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: Unable to read per-frame attribute %s from %s\n",
+                driverName, functionName, attribute.name.c_str(), attribute.path.c_str());
+      continue;
+    }
+    this->frameAttributes.push_back(attribute);
+  }
+  setIntegerParam(ADSim_AttributeCount, (int)this->frameAttributes.size());
+}
+
+/** Attach the per-frame values of the frames in an array as NDAttributes.
+  * \param[in] pList attribute list of the array
+  * \param[in] frameIndex index in the dataset of the first frame in the array
+  * \param[in] nframes number of frames stacked into the array
+  *
+  * Each attribute carries the value of the first frame.  Stacked arrays
+  * also carry the value of every frame, with the frame number appended to
+  * the attribute name.  Values are looked up modulo the length of the
+  * dataset they were read from.
+  */
+void SimHDF5Detector::addFrameAttributes(NDAttributeList *pList, hsize_t frameIndex, int nframes)
+{
+  char attrName[64];
+
+  for (size_t index = 0; index < this->frameAttributes.size(); index++){
+    const ADSimFrameAttribute& attribute = this->frameAttributes[index];
+    for (int frame = 0; frame < nframes; frame++){
+      double value = attribute.values[(frameIndex + frame) % attribute.values.size()];
+      int64_t integer = (int64_t)value;
+      if (frame == 0){
+        if (attribute.integer){
+          pList->add(attribute.name.c_str(), attribute.path.c_str(), NDAttrInt64, &integer);
+        } else {
+          pList->add(attribute.name.c_str(), attribute.path.c_str(), NDAttrFloat64, &value);
+        }
+      }
+      if (nframes > 1){
+        epicsSnprintf(attrName, sizeof(attrName), "%s%d", attribute.name.c_str(), frame);
+        if (attribute.integer){
+          pList->add(attrName, attribute.path.c_str(), NDAttrInt64, &integer);
+        } else {
+          pList->add(attrName, attribute.path.c_str(), NDAttrFloat64, &value);
+        }
+      }
+    }
+  }
+}
+
+/** Apply the selected alignment and huge page policy to NDArray buffers.
+  *
+  * Called by the acquisition task when an acquisition starts.  If the
+  * policy has changed the free buffers of the pool are released, so that
+  * the buffers used for this acquisition are allocated with the new policy.
+  */
+void SimHDF5Detector::applyBufferPolicy()
+{
+  int align = SimHDF5AlignDefault;
+  int huge = 0;
+
+  getIntegerParam(ADSim_BufferAlign, &align);
+  getIntegerParam(ADSim_HugePages, &huge);
+  if (align != this->bufferAlign || (huge != 0) != this->hugePages){
+    SimHDF5Allocator::setPolicy(align, huge != 0);
+    this->pNDArrayPool->emptyFreeList();
+    this->bufferAlign = align;
+    this->hugePages = (huge != 0);
+  }
+}
+
+/** Touch NDArrayPool buffers before the first frame is acquired.
+  * \param[in] count number of buffers to touch
+  * \param[in] fill touch as many buffers as the pool allows, if more than count
+  *
+  * Buffers the size of the arrays about to be produced are allocated and
+  * written to, so that their pages are mapped on the node of the calling
+  * thread, then released back to the pool, which reuses them for frames.
+  * The pool is filled up to the maximum number of buffers given when the
+  * driver was created, or to its memory limit if there is no buffer limit.
+  * Stops early if the pool is exhausted.
+  */
+void SimHDF5Detector::prefaultPool(int count, bool fill)
+{
+  int ndims = 0;
+  size_t dims[3];
+  NDArrayInfo_t arrayInfo;
+  std::vector<NDArray *> arrays;
+  const char *functionName = "prefaultPool";
+
+  arrayDims(this->readConfig, framesPerArray(), &ndims, dims);
+  if (fill){
+    if (this->poolBuffers > count){
+      count = this->poolBuffers;
+    } else if (this->poolBuffers <= 0 && this->pNDArrayPool->getMaxMemory() > 0){
+      // Without a buffer limit, fill the pool until its memory limit is reached
+      count = INT_MAX;
+    }
+  }
+  if (count <= 0){
+    return;
+  }
+  for (int index = 0; index < count; index++){
+    NDArray *pArray = this->pNDArrayPool->alloc(ndims, dims, this->readConfig.dataType, 0, NULL);
+    if (!pArray){
+      break;
+    }
+    pArray->getInfo(&arrayInfo);
+    memset(pArray->pData, 0, arrayInfo.totalBytes);
+    arrays.push_back(pArray);
+  }
+  for (size_t index = 0; index < arrays.size(); index++){
+    arrays[index]->release();
+  }
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+            "%s:%s: Prefaulted %d NDArrayPool buffers\n",
+            driverName, functionName, (int)arrays.size());
+}
+
+/** Publish whether NDArray buffers were allocated as requested.
+  *
+  */
+void SimHDF5Detector::updateBufferStatus()
+{
+  char message[SIMHDF5_MAX_MESSAGE_LEN];
+  int fallbacks = SimHDF5Allocator::hugePageFallbacks();
+
+  if (this->hugePages && fallbacks > 0){
+    epicsSnprintf(message, sizeof(message),
+                  "No huge pages for %d buffers, using 2 MiB aligned pages", fallbacks);
+    setStringParam(ADSim_BufferStatus, message);
+  } else {
+    setStringParam(ADSim_BufferStatus, "OK");
+  }
+}
+
 /** Sets an int32 parameter.
   * \param[in] pasynUser asynUser structure that contains the function code in pasynUser->reason.
   * \param[in] value The value for this parameter
@@ -300,6 +1807,34 @@ void SimHDF5Detector::acqTask()
   * ADSim_DsetIndex - Select the dataset required for processing.
   * ADSim_XDim - Select which dataset dimension should be used for the width.
   * ADSim_YDim - Select which dataset dimension should be used for the height.
+  * ADSim_ColorDim - Select which dataset dimension should be used for the colour planes.
+  * NDColorMode - Select the layout of colour images.
+  * ADSim_FramesPerArray - Select the number of frames stacked into each NDArray.
+  * ADSim_DropCache - Drop the source file from the page cache.
+  * ADSim_QueueDepth - Select the number of raw chunk reads kept in flight.
+  * ADSim_FileDriver - Select the HDF5 file driver and reload the file.
+  * ADSim_ReaderType - Select the file, memory or process reader and reload the file.
+  * ADSim_SharedStore - Select whether preloaded frames are shared and reload the file.
+  * ADSim_PlaylistOrder - Select the order in which playlist entries are cycled through.
+  * ADTriggerMode - Select internal timing, software triggers or external triggers.
+  * ADSim_SoftTrigger - Emit the staged frame when acquiring in software trigger mode.
+  * ADSim_AcqPriority - Select the SCHED_FIFO priority of the acquisition task.
+  * ADSim_WorkerPriority - Select the SCHED_FIFO priority of the frame building workers.
+  * ADSim_MemoryLock - Lock or unlock preloaded frames.
+  * ADSim_PrefaultBuffers - Select the number of NDArrayPool buffers touched before acquisition.
+  * ADSim_BufferAlign - Select the alignment of NDArray buffers, applied when an acquisition starts.
+  * ADSim_HugePages - Select huge page NDArray buffers, applied when an acquisition starts.
+  * ADSim_OutputMode - Select how frames are mapped onto the output frame.
+  * ADSim_OutputSizeX - Select the width of the synthetic output frame.
+  * ADSim_OutputSizeY - Select the height of the synthetic output frame.
+  * ADSim_OutputThreads - Select the number of threads that build synthetic frames.
+  * ADSim_RoiEnable, ADSim_RoiMinX, ADSim_RoiMinY, ADSim_RoiSizeX, ADSim_RoiSizeY - Define
+  * the region published on addresses 1 to SIMHDF5_MAX_ROIS.
+  * ADSim_ShardRank, ADSim_ShardSize - Select the shard of the frame sequence this detector emits.
+  *
+  * Changes to the dataset, image dimensions, ROI, regions, colour, playlist or output geometry made
+  * during an acquisition are prepared by the acquisition task and switched
+  * to at the next frame boundary.
   */
 asynStatus SimHDF5Detector::writeInt32(asynUser *pasynUser, epicsInt32 value)
 {
@@ -314,17 +1849,32 @@ asynStatus SimHDF5Detector::writeInt32(asynUser *pasynUser, epicsInt32 value)
 
   status = getAddress(pasynUser, &addr);
   if (status == asynSuccess){
-    getIntegerParam(function, &oldvalue);
+    getIntegerParam(addr, function, &oldvalue);
 
     // By default we set the value in the parameter library. If problems occur we set the old value back.
-    setIntegerParam(function, value);
+    setIntegerParam(addr, function, value);
 
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
               "%s:%s: function=%d, value=%d old=%d\n",
               driverName, functionName, function, value, oldvalue);
 
-    if (function == ADAcquire){
-      if (value && !acquiring){
+    if (loadBlocks(function)){
+      asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                "%s:%s: Cannot change this setting while a file is loading\n",
+                driverName, functionName);
+      status = asynError;
+      setIntegerParam(function, oldvalue);
+    } else if (function == ADAcquire){
+      int loadState = ADSimLoadIdle;
+      getIntegerParam(ADSim_LoadState, &loadState);
+      if (value && !acquiring && (loadState == ADSimLoadOpening || this->cancelLoad)){
+        // Frames can be read once the file is open and the preload is not being released
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Cannot start an acquisition while the file is opening or its load is being cancelled\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else if (value && !acquiring){
         if (validFile){
           // Send an event to wake up the simulation task.
           // It won't actually start generating new images until we release the lock below
@@ -340,8 +1890,9 @@ asynStatus SimHDF5Detector::writeInt32(asynUser *pasynUser, epicsInt32 value)
       }
       if (!value && acquiring){
         // This was a command to stop acquisition
-        // Send the stop event
+        // Send the stop event, and wake the task if it is waiting for a trigger
         epicsEventSignal(this->stopEventId);
+        epicsEventSignal(this->triggerEventId);
       }
     } else if (function == ADSim_DsetIndex){
       // Call the updateSourceImage function
@@ -373,6 +1924,196 @@ asynStatus SimHDF5Detector::writeInt32(asynUser *pasynUser, epicsInt32 value)
       } else {
         setArraySizes();
       }
+    } else if (function == ADSim_RoiEnable || function == ADSim_RoiMinX || function == ADSim_RoiMinY ||
+               function == ADSim_RoiSizeX || function == ADSim_RoiSizeY){
+      // Regions are defined on addresses 1 to SIMHDF5_MAX_ROIS
+      if (addr < 1 || addr > SIMHDF5_MAX_ROIS || value < 0){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: invalid region setting %d on address %d\n",
+                  driverName, functionName, value, addr);
+        setIntegerParam(addr, function, oldvalue);
+        status = asynError;
+      } else {
+        updateRegions();
+      }
+    } else if (function == ADTriggerMode){
+      if (acquiring){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Cannot change the trigger mode during an acquisition\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else if (value < ADSimTriggerInternal || value > ADSimTriggerExternal){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Invalid trigger mode %d\n",
+                  driverName, functionName, value);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      }
+    } else if (function == ADSim_SoftTrigger){
+      if (value){
+        status = trigger(ADSimTriggerSoftware);
+        if (status == asynError){
+          asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                    "%s:%s: Not acquiring in software trigger mode, trigger ignored\n",
+                    driverName, functionName);
+        }
+        setIntegerParam(function, 0);
+      }
+    } else if (function == ADSim_DropCache){
+      if (value){
+        fileReader->dropCache();
+        setIntegerParam(function, 0);
+      }
+    } else if (function == ADSim_FileDriver){
+      if (acquiring){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Cannot change the file driver during an acquisition\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else if (validFile){
+        // Reopen the file with the new driver
+        status = requestLoad();
+      }
+    } else if (function == ADSim_ReaderType || function == ADSim_SharedStore){
+      if (acquiring){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Cannot change the reader during an acquisition\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else {
+        // Replace the reader and load the file into it
+        status = createReader();
+        if (status == asynError){
+          setIntegerParam(function, oldvalue);
+          createReader();
+        }
+        if (validFile){
+          status = requestLoad();
+        }
+      }
+    } else if (function == ADSim_LoadCancel){
+      if (value){
+        int loadState = ADSimLoadIdle;
+        getIntegerParam(ADSim_LoadState, &loadState);
+        if (acquiring && loadState == ADSimLoadPreloading){
+          // The acquisition is reading the frames that would be released
+          asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                    "%s:%s: Cannot cancel a preload during an acquisition\n",
+                    driverName, functionName);
+          status = asynError;
+        } else if (loadState == ADSimLoadOpening || loadState == ADSimLoadPreloading){
+          // The loader task stops at its next opportunity
+          this->cancelLoad = true;
+        }
+        setIntegerParam(function, 0);
+      }
+    } else if (function == ADSim_QueueDepth){
+      if (value < 1){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Queue depth must be at least 1\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      }
+    } else if (function == ADSim_OutputMode || function == ADSim_OutputSizeX || function == ADSim_OutputSizeY){
+      if (value < 0){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Output mode and size cannot be negative\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else if (validFile){
+        // The sensor size follows the output geometry
+        status = updateSourceImage();
+        if (status == asynError){
+          // If a bad value is set then revert it to the original
+          setIntegerParam(function, oldvalue);
+          updateSourceImage();
+        }
+      }
+    } else if (function == ADSim_AcqPriority || function == ADSim_WorkerPriority){
+      if (value < 0 || value > 99){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Priority must be 0 for normal scheduling or 1 to 99 for SCHED_FIFO\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      }
+    } else if (function == ADSim_MemoryLock){
+      if (acquiring){
+        // Frames may be loaded by the acquisition task at any time
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Cannot change memory locking during an acquisition\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else {
+        fileReader->setLockMemory(value != 0);
+        updateLockStatus();
+      }
+    } else if (function == ADSim_PrefaultBuffers){
+      if (value < 0){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Prefault buffers cannot be negative\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      }
+    } else if (function == ADSim_BufferAlign){
+      if (value < SimHDF5AlignDefault || value > SimHDF5Align2M){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Unknown buffer alignment %d\n",
+                  driverName, functionName, value);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      }
+    } else if (function == ADSim_OutputThreads){
+      if (value < 1){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Output threads must be at least 1\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      }
+    } else if (function == ADSim_FramesPerArray){
+      if (value < 1){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Frames per array must be at least 1\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else {
+        setArraySizes();
+      }
+    } else if (function == ADSim_ShardRank || function == ADSim_ShardSize){
+      if (acquiring){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Cannot change the shard while acquiring\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else if (value < (function == ADSim_ShardSize ? 1 : 0)){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:%s: Shard size must be at least 1 and shard rank at least 0\n",
+                  driverName, functionName);
+        status = asynError;
+        setIntegerParam(function, oldvalue);
+      } else {
+        // Frames of a shard are never stacked
+        setArraySizes();
+      }
+    } else if (function == ADSim_ColorDim || function == NDColorMode){
+      // Verify the colour dimension can be used with the selected dataset
+      status = verifyColor();
+      if (status == asynError){
+        // If a bad value is set then revert it to the original
+        setIntegerParam(function, oldvalue);
+      } else {
+        setArraySizes();
+      }
     } else {
       if (function < FIRST_ADSIM_DETECTOR_PARAM){
         // If this parameter belongs to a base class call its method
@@ -382,6 +2123,16 @@ asynStatus SimHDF5Detector::writeInt32(asynUser *pasynUser, epicsInt32 value)
         status = ADDriver::writeInt32(pasynUser, value);
       }
     }
+    if (acquiring && status == asynSuccess &&
+        (function == ADSim_DsetIndex || function == ADSim_XDim || function == ADSim_YDim ||
+         function == ADMinX || function == ADMinY || function == ADSizeX || function == ADSizeY ||
+         function == ADSim_ColorDim || function == NDColorMode || function == ADSim_PlaylistOrder ||
+         function == ADSim_OutputMode || function == ADSim_OutputSizeX || function == ADSim_OutputSizeY ||
+         function == ADSim_RoiEnable || function == ADSim_RoiMinX || function == ADSim_RoiMinY ||
+         function == ADSim_RoiSizeX || function == ADSim_RoiSizeY)){
+      // The acquisition task picks up the new read settings between frames
+      this->configChanged = true;
+    }
     // Do callbacks so higher layers see any changes
     callParamCallbacks(addr, addr);
   }
@@ -406,11 +2157,22 @@ asynStatus SimHDF5Detector::writeInt32(asynUser *pasynUser, epicsInt32 value)
   *
   * For all parameters it sets the value in the parameter library and calls any registered
   * callbacks.  The following parameters are supported:
-  * ADSim_Filename - Load the HDF5 data file ready for an acquisition.
+  * ADSim_Filename - Load the HDF5 data file in the background ready for an acquisition.
+  * ADSim_SnapshotDir - Select the directory used for snapshots of preloaded frames.
+  * ADSim_Playlist - Select the datasets and repeat counts to cycle through.
+  * ADSim_AcqCPUs - Select the CPUs and NUMA node of the acquisition task.
+  * ADSim_WorkerCPUs - Select the CPUs of the frame building workers.
+  * ADSim_TimestampDset - Select the dataset of recorded frame times to replay.
+  * ADSim_AttributeDsets - Select the datasets of per-frame values attached as NDAttributes.
+  * ADSim_SyncGroup - Join the named group of detectors that start together on a shared clock.
+  *
+  * Placement, recorded frame times and per-frame attributes are applied when
+  * the next acquisition starts.
   */
 asynStatus SimHDF5Detector::writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual)
 {
   int addr=0;
+  int acquiring = 0;
   int function = pasynUser->reason;
   asynStatus status = asynSuccess;
   char *fileName = new char[MAX_FILENAME_LEN];
@@ -418,6 +2180,19 @@ asynStatus SimHDF5Detector::writeOctet(asynUser *pasynUser, const char *value, s
   const char *functionName = "writeOctet";
 
   status = getAddress(pasynUser, &addr); if (status != asynSuccess) return(status);
+  if (loadBlocks(function)){
+    epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: Cannot change this setting while a file is loading, function=%d, value=%s",
+                  driverName, functionName, function, value);
+    return asynError;
+  }
+  getIntegerParam(ADAcquire, &acquiring);
+  if (function == ADSim_SyncGroup && acquiring){
+    epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: Cannot change the sync group while acquiring, value=%s",
+                  driverName, functionName, value);
+    return asynError;
+  }
   // Set the parameter in the parameter library.
   status = (asynStatus)setStringParam(addr, function, (char *)value);
   if (status != asynSuccess) return(status);
@@ -426,24 +2201,46 @@ asynStatus SimHDF5Detector::writeOctet(asynUser *pasynUser, const char *value, s
 
     // Read the filename parameter
     getStringParam(ADSim_Filename, MAX_FILENAME_LEN-1, fileName);
-    // Set the filename of the file reader
-    fileReader->setFilename(fileName);
-
-    // Now validate the filename
-    if (fileReader->validateFilename()){
-      setIntegerParam(ADSim_FileValid, 1);
-      // Call the loadFile function
-      status = loadFile();
-      if (status == asynError){
-        // Set the valid flag to false so we do not start bad acquisitions
-        validFile = false;
-      } else {
-        // Set the valid flag to true, we can start acquisitions
-        validFile = true;
-      }
-    } else {
-      setIntegerParam(ADSim_FileValid, 0);
+    getIntegerParam(ADAcquire, &acquiring);
+    if (!acquiring){
+      // Set the filename of the file reader
+      fileReader->setFilename(fileName);
+    }
+    // The loader task validates and loads the file
+    status = requestLoad();
+  } else if (function == ADSim_SnapshotDir){
+    // Applies to datasets loaded from now on
+    fileReader->setSnapshotDir(value);
+  } else if (function == ADSim_Playlist){
+    // Check that every entry can be read with the current settings
+    std::vector<ADSimPlaylistEntry> entries;
+    status = parsePlaylist(entries);
+    getIntegerParam(ADAcquire, &acquiring);
+    if (status == asynSuccess && acquiring){
+      // The acquisition task switches to the new playlist between frames
+      this->configChanged = true;
+    }
+  } else if (function == ADSim_SyncGroup){
+    // Leave the current group and join the new one, if any
+    if (this->syncGroup){
+      this->syncGroup->leave(this);
+      this->syncGroup = NULL;
+    }
+    if (strlen(value) > 0){
+      this->syncGroup = SimHDF5SyncGroup::join(value, this, this->triggerEventId);
+    }
+    setIntegerParam(ADSim_SyncMembers, this->syncGroup ? this->syncGroup->getMembers() : 0);
+  } else if (function == ADSim_AcqCPUs || function == ADSim_WorkerCPUs){
+    if (!SimHDF5Placement::validCPUs(value)){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: Invalid CPU list %s\n",
+                driverName, functionName, value);
       status = asynError;
+    } else if (function == ADSim_AcqCPUs){
+      // Preloaded frames are placed on the node of the acquisition task
+      int numaNode = SimHDF5Placement::nodeOfCPUs(value);
+      setIntegerParam(ADSim_NumaNode, numaNode);
+      fileReader->setNumaNode(numaNode);
     }
   }
 
@@ -466,54 +2263,52 @@ asynStatus SimHDF5Detector::writeOctet(asynUser *pasynUser, const char *value, s
 /** Read an image from the HDF5 file into the NDArray pointer.
   * \param[in] index used to determine which array within the selected dataset
   *            will be used as the image for this frame.
+  * \param[in] nframes number of consecutive frames to stack into the NDArray.
+  *            When greater than 1 a 3-D NDArray of [x, y, nframes] is produced.
+  *
+  * This is called by the acquisition task without the driver lock held, so
+  * the image is read using the settings captured in readConfig rather than
+  * from the parameter library.  Returns asynError with pRaw set to NULL if
+  * no buffer could be allocated, and with pRaw allocated if the frame could
+  * not be read.
   */
-asynStatus SimHDF5Detector::readImage(int index)
+asynStatus SimHDF5Detector::readImage(hsize_t index, int nframes)
 {
   int status = asynSuccess;
   int ndims=0;
-  size_t dims[2];
-  int itype;
-  int width, height;
-  int minX, minY;
-  NDDataType_t dataType;
-  int dsetIndex = 0;
-  int xdim, ydim;
+  size_t dims[3];
+  const ADSimReadConfig& config = this->readConfig;
+  int width = config.width;
+  int height = config.height;
+  int minX = config.minX;
+  int minY = config.minY;
+  int xdim = config.xdim;
+  int ydim = config.ydim;
+  int cdim = config.cdim;
+  int colorMode = config.colorMode;
+  int planes = config.planes;
   const char *functionName = "readImage";
 
-  // Get the datatype
-  status |= getIntegerParam(NDDataType, &itype);
-  dataType = (NDDataType_t)itype;
-  // Get the dimensions
-  status |= getIntegerParam(NDArraySizeX, &width);
-  status |= getIntegerParam(NDArraySizeY, &height);
-  // Get the offsets
-  status |= getIntegerParam(ADMinX, &minX);
-  status |= getIntegerParam(ADMinY, &minY);
-
-  ndims = 2;
-  dims[0] = width;
-  dims[1] = height;
+  arrayDims(config, nframes, &ndims, dims);
+  this->rawColorMode = colorMode;
 
   // Release the previous array if necessary
   if (this->pRaw != NULL){
     this->pRaw->release();
   }
   // Allocate the new array
-  this->pRaw = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
+  this->pRaw = this->pNDArrayPool->alloc(ndims, dims, config.dataType, 0, NULL);
 
   if (!this->pRaw){
-    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+    // This is counted and handled by the back pressure policy of the acquisition task
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
               "%s:%s: error allocating raw buffer\n",
               driverName, functionName);
     status = asynError;
   }
 
   if (status == asynSuccess){
-    // First read the dataset index, selected dims and get the dataset info
-    getIntegerParam(ADSim_DsetIndex, &dsetIndex);
-    dsetIndex--;
-
-    std::vector<int> dims = fileReader->getDatasetDimensions(fileReader->getDatasetKeys()[dsetIndex]);
+    const std::vector<hsize_t>& dims = config.dims;
     std::stringstream ss;
     ss << "%s:%s: Dimensions [";
     for (unsigned int i = 0; i < dims.size(); i++){
@@ -527,34 +2322,17 @@ asynStatus SimHDF5Detector::readImage(int index)
               ss.str().c_str(),
               driverName, functionName);
 
-    getIntegerParam(ADSim_XDim, &xdim);
-    getIntegerParam(ADSim_YDim, &ydim);
-    // The xdim and ydim values need to be converted to zero indexed
-    xdim--;
-    ydim--;
+    int nframedims = dims.size() - 2 - (planes == 3 ? 1 : 0);
 
     // We need to calculate the offsets in the non-image dimensions
     if (dims.size() > 2){
-      int cindex = index;
-      int indexes[dims.size()-2];
-      int ci = 0;
-      int remainder = 0;
-      int quotient = 0;
-      for (int i = dims.size()-1; i >= 0; i--){
-        if (i != xdim && i != ydim){
-          quotient = cindex / dims[i];
-          remainder = cindex - (quotient * dims[i]);
-          cindex = quotient;
-          // Work out the index in this dimension
-          indexes[dims.size() - 3 - ci] = remainder;
-          ci++;
-        }
-      }
+      hsize_t indexes[dims.size()-2];
+      calculateIndexes(index, dims, xdim, ydim, cdim, indexes);
       ss.str("");
       ss << "%s:%s: Indexes [";
-      for (unsigned int i = 0; i < (dims.size()-2); i++){
+      for (int i = 0; i < nframedims; i++){
         ss << indexes[i];
-        if (i != dims.size()-3){
+        if (i != nframedims-1){
           ss << ", ";
         }
       }
@@ -563,59 +2341,753 @@ asynStatus SimHDF5Detector::readImage(int index)
                 ss.str().c_str(),
                 driverName, functionName);
 
-      // Read out the image into the array
-      fileReader->readFromDataset(fileReader->getDatasetKeys()[dsetIndex], minX, minY, width, height, xdim, ydim, indexes, this->pRaw->pData);
+      // A synthetic output frame is built from a source frame read into a scratch buffer
+      int srcMinX, srcMinY, srcWidth, srcHeight;
+      readRegion(config, dims, &srcMinX, &srcMinY, &srcWidth, &srcHeight);
+      NDArrayInfo_t arrayInfo;
+      this->pRaw->getInfo(&arrayInfo);
+      void *pData = this->pRaw->pData;
+      bool readOk = true;
+      if (config.outputMode != SimHDF5GeometryDirect){
+        size_t bytes = (size_t)srcWidth * srcHeight * arrayInfo.bytesPerElement * (planes == 3 ? 3 : nframes);
+        if (sourceBuffer.size() < bytes){
+          sourceBuffer.resize(bytes);
+        }
+        pData = &sourceBuffer[0];
+      }
+
+      if (planes == 3){
+        // Read all three colours in one go, then rearrange them into the
+        // requested layout unless the dataset already matches it
+        ptrdiff_t srcStrides[3];
+        ptrdiff_t dstStrides[3];
+        SimHDF5Layout::fileStrides(xdim, ydim, cdim, srcWidth, srcHeight, srcStrides);
+        SimHDF5Layout::colorStrides(colorMode, srcWidth, srcHeight, dstStrides);
+        if (SimHDF5Layout::sameStrides(srcStrides, dstStrides)){
+          readOk = fileReader->readColorFromDataset(config.dname, srcMinX, srcMinY, srcWidth, srcHeight, xdim, ydim, cdim, indexes, pData);
+        } else {
+          size_t bytes = (size_t)srcWidth * srcHeight * 3 * arrayInfo.bytesPerElement;
+          if (colorBuffer.size() < bytes){
+            colorBuffer.resize(bytes);
+          }
+          readOk = fileReader->readColorFromDataset(config.dname, srcMinX, srcMinY, srcWidth, srcHeight, xdim, ydim, cdim, indexes, &colorBuffer[0]);
+          SimHDF5Layout::convertColor(&colorBuffer[0], srcStrides, pData, dstStrides, srcWidth, srcHeight, arrayInfo.bytesPerElement);
+        }
+      } else if (nframes > 1){
+        // Read out the stack of frames into the array
+        readOk = fileReader->readFramesFromDataset(config.dname, srcMinX, srcMinY, srcWidth, srcHeight, xdim, ydim, indexes, nframes, pData);
+      } else {
+        // Read out the image into the array
+        readOk = fileReader->readFromDataset(config.dname, srcMinX, srcMinY, srcWidth, srcHeight, xdim, ydim, indexes, pData);
+      }
+
+      if (!readOk){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: Failed to read frame %llu of dataset %s\n",
+                  driverName, functionName, (unsigned long long)index, config.dname.c_str());
+        return asynError;
+      }
+
+      if (config.outputMode != SimHDF5GeometryDirect){
+        // Expand the source frame into the ROI of the synthetic frame.  Pixel
+        // interleaved colour is expanded a pixel at a time, row interleaved
+        // colour three rows per line and planar colour a plane at a time.
+        size_t elementSize = arrayInfo.bytesPerElement;
+        int rowsPerLine = 1;
+        int count = nframes;
+        if (planes == 3){
+          count = 1;
+          if (colorMode == NDColorModeRGB1){
+            elementSize *= 3;
+          } else if (colorMode == NDColorModeRGB2){
+            rowsPerLine = 3;
+          } else {
+            count = 3;
+          }
+        }
+        this->geometry.expand(config.outputMode, pData, srcWidth, srcHeight, this->pRaw->pData,
+                              minX, minY, width, height, config.sensorWidth, config.sensorHeight,
+                              elementSize, rowsPerLine, count);
+      }
+
+      // Hint to the reader which frames will be needed next
+      if (config.readahead > 0){
+        for (int frame = 0; frame < nframes; frame++){
+          prefetchFrame(config, this->playPosition, index, config.readahead + frame);
+        }
+      }
     }
   }
   return (asynStatus)status;
 }
 
+/** Work out the dimensions of the NDArray that frames are read into.
+  * \param[in] config the settings the frames are read with.
+  * \param[in] nframes number of consecutive frames stacked into the NDArray.
+  * \param[out] ndims number of dimensions.
+  * \param[out] dims size of each dimension.
+  */
+void SimHDF5Detector::arrayDims(const ADSimReadConfig& config, int nframes, int *ndims, size_t *dims)
+{
+  // Colour images are three dimensional, with the colour axis placed according to the mode
+  if (config.planes == 3){
+    *ndims = 3;
+    switch (config.colorMode){
+      case NDColorModeRGB1:
+        dims[0] = 3;
+        dims[1] = config.width;
+        dims[2] = config.height;
+        break;
+      case NDColorModeRGB2:
+        dims[0] = config.width;
+        dims[1] = 3;
+        dims[2] = config.height;
+        break;
+      default:
+        dims[0] = config.width;
+        dims[1] = config.height;
+        dims[2] = 3;
+        break;
+    }
+  } else if (nframes > 1){
+    *ndims = 3;
+    dims[0] = config.width;
+    dims[1] = config.height;
+    dims[2] = nframes;
+  } else {
+    *ndims = 2;
+    dims[0] = config.width;
+    dims[1] = config.height;
+  }
+}
+
+/** Capture the settings used to read frames from the parameter library.
+  * \param[out] config the captured settings.
+  * \return false if no valid dataset is selected.
+  *
+  * Must be called with the driver lock held.
+  */
+bool SimHDF5Detector::captureConfig(ADSimReadConfig& config)
+{
+  int dsetIndex = 0;
+  int itype = 0;
+
+  getIntegerParam(ADSim_DsetIndex, &dsetIndex);
+  std::vector<std::string> keys = fileReader->getDatasetKeys();
+  if (dsetIndex < 1 || dsetIndex > (int)keys.size()){
+    return false;
+  }
+  config.dname = keys[dsetIndex-1];
+  config.dims = fileReader->getDatasetDimensions(config.dname);
+
+  // The xdim, ydim and cdim values need to be converted to zero indexed
+  getIntegerParam(ADSim_XDim, &config.xdim);
+  getIntegerParam(ADSim_YDim, &config.ydim);
+  getIntegerParam(ADSim_ColorDim, &config.cdim);
+  config.xdim--;
+  config.ydim--;
+  config.cdim--;
+
+  getIntegerParam(NDArraySizeX, &config.width);
+  getIntegerParam(NDArraySizeY, &config.height);
+  getIntegerParam(ADMinX, &config.minX);
+  getIntegerParam(ADMinY, &config.minY);
+  getIntegerParam(NDDataType, &itype);
+  config.dataType = (NDDataType_t)itype;
+
+  config.planes = colorPlanes();
+  config.colorMode = NDColorModeMono;
+  if (config.planes == 3){
+    getIntegerParam(NDColorMode, &config.colorMode);
+  } else {
+    // The colour dimension is treated as any other frame dimension
+    config.cdim = -1;
+  }
+  getIntegerParam(ADSim_ReadaheadFrames, &config.readahead);
+  getIntegerParam(ADSim_OutputMode, &config.outputMode);
+  getIntegerParam(ADMaxSizeX, &config.sensorWidth);
+  getIntegerParam(ADMaxSizeY, &config.sensorHeight);
+  getIntegerParam(ADSim_ShardRank, &config.shardRank);
+  getIntegerParam(ADSim_ShardSize, &config.shardSize);
+  if (config.shardSize < 1 || config.shardRank < 0 || config.shardRank >= config.shardSize){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:captureConfig: Shard rank %d must be less than the shard size %d\n",
+              driverName, config.shardRank, config.shardSize);
+    return false;
+  }
+
+  // Regions are clipped to the frame, and regions entirely outside it are not published
+  config.regions.clear();
+  for (int addr = 1; addr <= SIMHDF5_MAX_ROIS; addr++){
+    ADSimRegion region;
+    if (clipRegion(addr, config.width, config.height, &region)){
+      config.regions.push_back(region);
+    }
+  }
+
+  // A playlist replaces the selected dataset
+  if (parsePlaylist(config.playlist) != asynSuccess){
+    return false;
+  }
+  getIntegerParam(ADSim_PlaylistOrder, &config.playlistOrder);
+  if (!config.playlist.empty()){
+    const ADSimPlaylistEntry& first = config.playlist[playlistEntry(config, 0)];
+    config.dname = first.dname;
+    config.dims = first.dims;
+  }
+  return true;
+}
+
+/** Prepare the reader for new read settings before they are switched to.
+  * \param[in] config the new settings.
+  * \param[in] index index of the first frame that will be read with them.
+  * \param[in] nframes number of frames read into each NDArray.
+  *
+  * Called by the acquisition task without the driver lock held, in the time
+  * left before the next frame is due, once the loader task has loaded the
+  * datasets.  The datasets are opened alongside the ones currently being
+  * read and the first frames are hinted to the reader, so that the switch
+  * at the next frame boundary does not delay the frame.
+  */
+void SimHDF5Detector::warmConfig(const ADSimReadConfig& config, hsize_t index, int nframes)
+{
+  ADSimPlaylistPosition position;
+  position.step = 0;
+  position.count = 0;
+  if (!config.playlist.empty()){
+    advancePlaylist(config, position, config.shardRank);
+  }
+  for (size_t entry = 0; entry < config.playlist.size(); entry++){
+    fileReader->prepareToReadDataset(config.playlist[entry].dname);
+  }
+  fileReader->prepareToReadDataset(config.dname);
+  for (int frame = 0; frame < nframes + config.readahead; frame++){
+    prefetchFrame(config, position, index, frame);
+  }
+}
+
+/** Return the region of each frame read from a dataset.
+  * \param[in] config the settings the frame is read with.
+  * \param[in] dims dimensions of the dataset.
+  * \param[out] minX offset of the region in X.
+  * \param[out] minY offset of the region in Y.
+  * \param[out] width size of the region in X.
+  * \param[out] height size of the region in Y.
+  *
+  * In direct mode only the ROI is read.  A synthetic output frame is built
+  * from the whole of the much smaller source frame, which is read instead.
+  */
+void SimHDF5Detector::readRegion(const ADSimReadConfig& config, const std::vector<hsize_t>& dims, int *minX, int *minY, int *width, int *height)
+{
+  if (config.outputMode == SimHDF5GeometryDirect){
+    *minX = config.minX;
+    *minY = config.minY;
+    *width = config.width;
+    *height = config.height;
+  } else {
+    *minX = 0;
+    *minY = 0;
+    *width = (int)dims[config.xdim];
+    *height = (int)dims[config.ydim];
+  }
+}
+
+/** Hint to the reader that a frame will be needed soon.
+  * \param[in] config the settings the frame will be read with.
+  * \param[in] position position in the playlist of the next frame to be read.
+  * \param[in] index index of the next frame to be read when there is no playlist.
+  * \param[in] ahead number of frames after the next frame.
+  *
+  * With a playlist the frame is found by stepping through the playlist, so
+  * frames at the start of the next entry are hinted before it is reached.
+  */
+void SimHDF5Detector::prefetchFrame(const ADSimReadConfig& config, const ADSimPlaylistPosition& position, hsize_t index, int ahead)
+{
+  std::string dname = config.dname;
+  const std::vector<hsize_t> *dims = &config.dims;
+  // A shard only reads every shardSize'th frame
+  ahead *= config.shardSize;
+  if (config.playlist.empty()){
+    index += ahead;
+  } else {
+    ADSimPlaylistPosition future = position;
+    advancePlaylist(config, future, ahead);
+    const ADSimPlaylistEntry& entry = config.playlist[playlistEntry(config, future.step)];
+    dname = entry.dname;
+    dims = &entry.dims;
+    index = future.frames[entry.dname];
+  }
+  if (dims->size() > 2){
+    hsize_t indexes[dims->size()-2];
+    int minX, minY, width, height;
+    calculateIndexes(index, *dims, config.xdim, config.ydim, config.cdim, indexes);
+    readRegion(config, *dims, &minX, &minY, &width, &height);
+    if (config.planes == 3){
+      fileReader->prefetchColorFromDataset(dname, minX, minY, width, height, config.xdim, config.ydim, config.cdim, indexes);
+    } else {
+      fileReader->prefetchFromDataset(dname, minX, minY, width, height, config.xdim, config.ydim, indexes);
+    }
+  }
+}
+
+/** Parse the playlist parameter.
+  * \param[out] entries the playlist entries, empty if no playlist is set.
+  * \return asynError if any entry cannot be read with the current settings.
+  *
+  * The playlist is a list of entries separated by commas, semicolons or
+  * spaces.  Each entry is a dataset path, or a dataset index as used by
+  * ADSim_DsetIndex, optionally followed by a colon and the number of
+  * consecutive frames to read from it.  For example "/dark:10, /flat:10,
+  * /data:100".  The repeat count defaults to 1.  Every dataset must hold the
+  * selected image dimensions and ROI and have the same data type as the
+  * selected dataset, so that all frames have the same shape.  With a
+  * synthetic output geometry the datasets may have any image size.
+  */
+asynStatus SimHDF5Detector::parsePlaylist(std::vector<ADSimPlaylistEntry>& entries)
+{
+  char text[SIMHDF5_MAX_PLAYLIST_LEN];
+  int xdim = 0;
+  int ydim = 0;
+  int cdim = 0;
+  int minX = 0;
+  int minY = 0;
+  int sizeX = 0;
+  int sizeY = 0;
+  int type = 0;
+  int outputMode = SimHDF5GeometryDirect;
+  const char *functionName = "parsePlaylist";
+
+  entries.clear();
+  text[0] = '\0';
+  getStringParam(ADSim_Playlist, SIMHDF5_MAX_PLAYLIST_LEN-1, text);
+  for (char *ptr = text; *ptr != '\0'; ptr++){
+    if (*ptr == ',' || *ptr == ';'){
+      *ptr = ' ';
+    }
+  }
+  getIntegerParam(ADSim_XDim, &xdim);
+  getIntegerParam(ADSim_YDim, &ydim);
+  getIntegerParam(ADSim_ColorDim, &cdim);
+  getIntegerParam(ADMinX, &minX);
+  getIntegerParam(ADMinY, &minY);
+  getIntegerParam(ADSizeX, &sizeX);
+  getIntegerParam(ADSizeY, &sizeY);
+  getIntegerParam(NDDataType, &type);
+  getIntegerParam(ADSim_OutputMode, &outputMode);
+  if (colorPlanes() == 1){
+    cdim = 0;
+  }
+  if (outputMode != SimHDF5GeometryDirect){
+    // The ROI is taken from the synthetic frame, which any source frame can fill
+    minX = 0;
+    minY = 0;
+    sizeX = 0;
+    sizeY = 0;
+  }
+  std::vector<std::string> keys = fileReader->getDatasetKeys();
+
+  std::stringstream ss(text);
+  std::string token;
+  while (ss >> token){
+    ADSimPlaylistEntry entry;
+    entry.repeats = 1;
+    size_t colon = token.rfind(':');
+    if (colon != std::string::npos){
+      entry.repeats = atoi(token.substr(colon+1).c_str());
+      token = token.substr(0, colon);
+    }
+    if (!token.empty() && token.find_first_not_of("0123456789") == std::string::npos){
+      // A dataset index counting from 1
+      int index = atoi(token.c_str());
+      if (index >= 1 && index <= (int)keys.size()){
+        token = keys[index-1];
+      }
+    }
+    if (std::find(keys.begin(), keys.end(), token) == keys.end()){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: Unknown dataset %s in playlist\n",
+                driverName, functionName, token.c_str());
+      entries.clear();
+      return asynError;
+    }
+    if (entry.repeats < 1){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: Repeat count for dataset %s must be at least 1\n",
+                driverName, functionName, token.c_str());
+      entries.clear();
+      return asynError;
+    }
+    entry.dname = token;
+    entry.dims = fileReader->getDatasetDimensions(token);
+    int ndims = entry.dims.size();
+    if (xdim < 1 || xdim > ndims || ydim < 1 || ydim > ndims || cdim > ndims ||
+        entry.dims[xdim-1] < (hsize_t)(minX + sizeX) || entry.dims[ydim-1] < (hsize_t)(minY + sizeY) ||
+        (cdim > 0 && entry.dims[cdim-1] != 3) ||
+        fileReader->getDatasetType(token) != (NDDataType_t)type){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: Dataset %s in playlist does not match the selected image size or type\n",
+                driverName, functionName, token.c_str());
+      entries.clear();
+      return asynError;
+    }
+    entries.push_back(entry);
+  }
+  return asynSuccess;
+}
+
+/** Return the playlist entry read at a step through the playlist.
+  * \param[in] config the settings holding the playlist.
+  * \param[in] step number of entries completed since the start of the playlist.
+  * \return index of the playlist entry.
+  */
+int SimHDF5Detector::playlistEntry(const ADSimReadConfig& config, int step)
+{
+  int entries = config.playlist.size();
+  if (entries < 2){
+    return 0;
+  }
+  switch (config.playlistOrder){
+    case ADSimPlaylistReverse:
+      return entries - 1 - step % entries;
+    case ADSimPlaylistPingPong:
+      if (entries > 2){
+        // Forwards then backwards, the end entries are only played once per cycle
+        int cycle = 2 * entries - 2;
+        step = step % cycle;
+        return step < entries ? step : cycle - step;
+      }
+      return step % entries;
+    default:
+      return step % entries;
+  }
+}
+
+/** Move a playlist position on by a number of frames.
+  * \param[in] config the settings holding the playlist.
+  * \param[in,out] position the position to move on.
+  * \param[in] nframes number of frames to move on by.
+  */
+void SimHDF5Detector::advancePlaylist(const ADSimReadConfig& config, ADSimPlaylistPosition& position, int nframes)
+{
+  int entries = config.playlist.size();
+  // Number of steps before the order repeats, which keeps the step small
+  int cycle = (config.playlistOrder == ADSimPlaylistPingPong && entries > 2) ? 2 * entries - 2 : entries;
+  for (int frame = 0; frame < nframes; frame++){
+    const ADSimPlaylistEntry& entry = config.playlist[playlistEntry(config, position.step)];
+    position.frames[entry.dname]++;
+    position.count++;
+    if (position.count >= entry.repeats){
+      position.count = 0;
+      position.step = (position.step + 1) % cycle;
+    }
+  }
+}
+
+/** Calculate the indexes in the non-image dimensions for a frame.
+  * \param[in] index frame number, frames beyond the end of the dataset wrap around.
+  * \param[in] dims dimensions of the dataset.
+  * \param[in] xdim zero indexed dimension used for the image width.
+  * \param[in] ydim zero indexed dimension used for the image height.
+  * \param[in] cdim zero indexed dimension used for colour, or -1 for none.
+  * \param[out] indexes index for each of the remaining dimensions, slowest first.
+  */
+void SimHDF5Detector::calculateIndexes(hsize_t index, const std::vector<hsize_t>& dims, int xdim, int ydim, int cdim, hsize_t *indexes)
+{
+  int nframedims = dims.size() - 2 - (cdim >= 0 ? 1 : 0);
+  hsize_t cindex = index;
+  int ci = 0;
+  hsize_t remainder = 0;
+  hsize_t quotient = 0;
+  for (int i = dims.size()-1; i >= 0; i--){
+    if (i != xdim && i != ydim && i != cdim){
+      quotient = cindex / dims[i];
+      remainder = cindex - (quotient * dims[i]);
+      cindex = quotient;
+      // Work out the index in this dimension
+      indexes[nframedims - 1 - ci] = remainder;
+      ci++;
+    }
+  }
+}
+
+/** Create the reader selected by the reader type parameter.
+  *
+  * Any previously loaded file is released with the old reader.  The new
+  * reader is given the current filename but the file is not loaded.
+  */
+asynStatus SimHDF5Detector::createReader()
+{
+  int readerType = ADSimReaderFile;
+  int sharedStore = 0;
+  char fileName[MAX_FILENAME_LEN];
+  char snapshotDir[MAX_FILENAME_LEN];
+  asynStatus status = asynSuccess;
+  const char *functionName = "createReader";
+
+  getIntegerParam(ADSim_ReaderType, &readerType);
+  getIntegerParam(ADSim_SharedStore, &sharedStore);
+  fileName[0] = '\0';
+  getStringParam(ADSim_Filename, MAX_FILENAME_LEN-1, fileName);
+  fileName[MAX_FILENAME_LEN-1] = '\0';
+  snapshotDir[0] = '\0';
+  getStringParam(ADSim_SnapshotDir, MAX_FILENAME_LEN-1, snapshotDir);
+  snapshotDir[MAX_FILENAME_LEN-1] = '\0';
+
+  if (fileReader){
+    fileReader->cleanupDataset();
+    fileReader->unloadFile();
+  }
+  switch (readerType){
+    case ADSimReaderFile:
+      fileReader = std::tr1::shared_ptr<SimHDF5Reader>(new SimHDF5FileReader());
+      break;
+    case ADSimReaderMemory:
+      fileReader = std::tr1::shared_ptr<SimHDF5Reader>(new SimHDF5MemoryReader());
+      break;
+    case ADSimReaderProcess:
+      // The workers can only be forked when the driver is created
+      if (!this->processReader){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: No reader workers were started, set readerWorkers in SimHDF5DetectorConfig\n",
+                  driverName, functionName);
+        return asynError;
+      }
+      fileReader = this->processReader;
+      setIntegerParam(ADSim_ReaderWorkers, this->processReader->getWorkers());
+      break;
+    default:
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: Unknown reader type %d\n",
+                driverName, functionName, readerType);
+      return asynError;
+  }
+  fileReader->setSharedStore(sharedStore != 0);
+  fileReader->setSnapshotDir(snapshotDir);
+  int numaNode = -1;
+  getIntegerParam(ADSim_NumaNode, &numaNode);
+  fileReader->setNumaNode(numaNode);
+  int memoryLock = 0;
+  getIntegerParam(ADSim_MemoryLock, &memoryLock);
+  fileReader->setLockMemory(memoryLock != 0);
+  updateLockStatus();
+  fileReader->setFilename(fileName);
+  return status;
+}
+
+/** Ask the loader task to load the file specified by the filename parameter.
+  * \return asynError if an acquisition is running.
+  *
+  * Returns at once.  Acquisition cannot start until the loader task has
+  * opened the file, and the load state, progress and rate parameters
+  * follow the load from then on.
+  */
+asynStatus SimHDF5Detector::requestLoad()
+{
+  int acquiring = 0;
+  const char *functionName = "requestLoad";
+
+  getIntegerParam(ADAcquire, &acquiring);
+  if (acquiring){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: Cannot load a file during an acquisition\n",
+              driverName, functionName);
+    return asynError;
+  }
+  this->validFile = false;
+  this->cancelLoad = false;
+  setIntegerParam(ADSim_LoadState, ADSimLoadOpening);
+  setDoubleParam(ADSim_LoadProgress, 0.0);
+  setDoubleParam(ADSim_LoadRate, 0.0);
+  epicsEventSignal(this->loadEventId);
+  return asynSuccess;
+}
+
+/** Check whether a parameter cannot be written while a file is loading.
+  * \param[in] function index of the parameter.
+  * \return true if the write must be rejected.
+  *
+  * The reader and the file it holds cannot be changed until the load has
+  * finished or been cancelled.  The dataset selection cannot be changed
+  * until the file has been opened, after which it can be changed while
+  * frames are preloaded.
+  */
+bool SimHDF5Detector::loadBlocks(int function)
+{
+  int loadState = ADSimLoadIdle;
+
+  getIntegerParam(ADSim_LoadState, &loadState);
+  if (loadState != ADSimLoadOpening && loadState != ADSimLoadPreloading){
+    return false;
+  }
+  if (function == ADSim_Filename || function == ADSim_FileDriver || function == ADSim_ReaderType ||
+      function == ADSim_SharedStore || function == ADSim_SnapshotDir || function == ADSim_MemoryLock ||
+      function == ADSim_DropCache){
+    return true;
+  }
+  return loadState == ADSimLoadOpening &&
+         (function == ADSim_DsetIndex || function == ADSim_XDim || function == ADSim_YDim ||
+          function == ADMinX || function == ADMinY || function == ADSizeX || function == ADSizeY ||
+          function == ADSim_ColorDim || function == NDColorMode || function == ADSim_Playlist ||
+          function == ADSim_OutputMode || function == ADSim_OutputSizeX || function == ADSim_OutputSizeY);
+}
+
 /** Load the HDF5 file specified by the filename parameter.
  *
- * Validation checks are carried out before the file is loaded.
+ * Called by the loader task with the lock held.  The lock is released
+ * while the file is validated and loaded by the reader, during which no
+ * other thread uses the reader.  Validation checks are carried out before
+ * the file is loaded.
   */
 asynStatus SimHDF5Detector::loadFile()
 {
-  // Retrieve the filename
-  // Check the file exists
-  // Open the file
-  char *fileName = new char[MAX_FILENAME_LEN];
-  fileName[MAX_FILENAME_LEN - 1] = '\0';
-  asynStatus status = asynSuccess;
+  int driver = SimHDF5DriverSec2;
+  epicsTimeStamp loadStart, loadEnd;
+  bool valid = false;
+  bool loaded = false;
+  std::tr1::shared_ptr<SimHDF5Reader> reader = fileReader;
   const char *functionName = "loadFile";
 
-  // Validate once more the filename
-  if (fileReader->validateFilename()){
-    setIntegerParam(ADSim_FileValid, 1);
-  } else {
+  getIntegerParam(ADSim_FileDriver, &driver);
+  callParamCallbacks();
+  this->unlock();
+  // Validate once more the filename, then read in the file with the
+  // selected driver, timing the load
+  valid = reader->validateFilename();
+  if (valid){
+    reader->setFileDriver(driver);
+    epicsTimeGetCurrent(&loadStart);
+    loaded = reader->loadFile();
+    epicsTimeGetCurrent(&loadEnd);
+  }
+  this->lock();
+
+  if (!valid){
     setIntegerParam(ADSim_FileValid, 0);
-    status = asynError;
+    setIntegerParam(ADSim_LoadState, ADSimLoadFailed);
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
               "%s:%s: could not validate the file, is it in HDF5 format?\n",
               driverName, functionName);
+    return asynError;
   }
+  if (!loaded){
+    setIntegerParam(ADSim_FileValid, 0);
+    setIntegerParam(ADSim_NumOfDsets, 0);
+    setIntegerParam(ADSim_LoadState, ADSimLoadFailed);
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: could not open the file\n",
+              driverName, functionName);
+    return asynError;
+  }
+  setIntegerParam(ADSim_FileValid, 1);
+  if (this->cancelLoad){
+    reader->unloadFile();
+    setIntegerParam(ADSim_NumOfDsets, 0);
+    setIntegerParam(ADSim_LoadState, ADSimLoadCancelled);
+    return asynError;
+  }
+  // Recorded frame times and attributes are read again from the new file
+  this->frameTimes.clear();
+  this->frameTimesPath.clear();
+  this->frameAttributes.clear();
+  this->frameAttributesList.clear();
+  setDoubleParam(ADSim_FileLoadTime, epicsTimeDiffInSeconds(&loadEnd, &loadStart));
+
+  // Verify there are datasets present
+  std::vector<std::string> datasets = fileReader->getDatasetKeys();
+
+  // Set the number of datasets parameter
+  setIntegerParam(ADSim_NumOfDsets, datasets.size());
+
+  // Set the current dataset index to 1
+  // Note the parameter is not zero indexed!
+  setIntegerParam(ADSim_DsetIndex, 1);
+
+  if (datasets.size() > 0){
+    // Update the dataset information
+    readDatasetInfo();
+  }
+  // Set the valid flag to true, we can start acquisitions
+  this->validFile = true;
+  return asynSuccess;
+}
 
-  // If the file is valid then read it in
-  if (status == asynSuccess){
-    // Read in the file
-    fileReader->loadFile();
-
-    // Verify there are datasets present
-    std::vector<std::string> datasets = fileReader->getDatasetKeys();
-
-    // Set the number of datasets parameter
-    setIntegerParam(ADSim_NumOfDsets, datasets.size());
-
-    // Set the current dataset index to 1
-    // Note the parameter is not zero indexed!
-    setIntegerParam(ADSim_DsetIndex, 1);
+/** Preload the selected dataset into memory.
+ *
+ * Called by the loader task with the lock held once the file is open.  The
+ * lock is released while each part of the dataset is loaded, and the
+ * progress and rate are published between parts.  Acquisition may start
+ * once the first part is resident, and its reads wait for any frames that
+ * are not.  A cancel stops the preload between parts and releases the
+ * frames loaded so far.  Readers that do not keep frames in memory have
+ * nothing to preload.
+  */
+void SimHDF5Detector::preloadFile()
+{
+  char dname[MAX_FILENAME_LEN];
+  size_t done = 0, total = 0;
+  bool more = true;
+  epicsTimeStamp start, now;
+  double elapsed;
+  std::tr1::shared_ptr<SimHDF5Reader> reader = fileReader;
+  const char *functionName = "preloadFile";
+
+  dname[0] = '\0';
+  getStringParam(ADSim_DsetName, MAX_FILENAME_LEN-1, dname);
+  dname[MAX_FILENAME_LEN-1] = '\0';
+  epicsTimeGetCurrent(&start);
+  while (more && !this->cancelLoad){
+    this->unlock();
+    more = reader->preloadDataset(dname, &done, &total);
+    this->lock();
+    epicsTimeGetCurrent(&now);
+    elapsed = epicsTimeDiffInSeconds(&now, &start);
+    if (more){
+      setIntegerParam(ADSim_LoadState, ADSimLoadPreloading);
+    }
+    setDoubleParam(ADSim_LoadProgress, total > 0 ? 100.0 * done / total : 100.0);
+    setDoubleParam(ADSim_LoadRate, elapsed > 0.0 ? done / elapsed / 1.0e6 : 0.0);
+    callParamCallbacks();
+  }
+  if (more){
+    // Cancelled, the frames are loaded when an acquisition next starts
+    reader->cancelPreload();
+    setDoubleParam(ADSim_LoadProgress, 0.0);
+    setIntegerParam(ADSim_LoadState, ADSimLoadCancelled);
+  } else if (done < total){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: Failed to preload dataset %s\n",
+              driverName, functionName, dname);
+    setIntegerParam(ADSim_LoadState, ADSimLoadFailed);
+  } else {
+    setIntegerParam(ADSim_LoadState, ADSimLoadDone);
+  }
+  updateLockStatus();
+}
 
-    if (datasets.size() > 0){
-      // Update the dataset information
-      readDatasetInfo();
+/** Load the datasets of read settings changed during an acquisition.
+ *
+ * Called by the loader task with the lock held.  The lock is released while
+ * each dataset is loaded, under the HDF5 mutex of the reader as for a
+ * preload, so the acquisition task is never held up by the load.  It keeps
+ * reading with its current settings until configLoads reaches the request
+ * number, and only then switches.  Settings replaced while they load are
+ * loaded again by the next call.
+  */
+void SimHDF5Detector::preloadConfig()
+{
+  size_t done = 0, total = 0;
+  int request = this->configRequests;
+  std::set<std::string> names = configDatasets(this->loadConfig);
+  std::tr1::shared_ptr<SimHDF5Reader> reader = fileReader;
+
+  this->unlock();
+  for (std::set<std::string>::iterator iter = names.begin(); iter != names.end(); ++iter){
+    while (reader->preloadDataset(*iter, &done, &total)){
     }
   }
-  return status;
+  this->lock();
+  this->configLoads = request;
+  updateLockStatus();
 }
 
 /** Read dataset information from the loaded HDF5 file.
@@ -642,37 +3114,37 @@ asynStatus SimHDF5Detector::readDatasetInfo()
     // Set the dataset name
     setStringParam(ADSim_DsetName, fileReader->getDatasetKeys()[dsetIndex].c_str());
 
-    std::vector<int> dims = fileReader->getDatasetDimensions(fileReader->getDatasetKeys()[dsetIndex]);
+    std::vector<hsize_t> dims = fileReader->getDatasetDimensions(fileReader->getDatasetKeys()[dsetIndex]);
     // Set the number of available dimensions
     setIntegerParam(ADSim_DsetNumDims, dims.size());
     // For each dimension set the size of the dimension
     if (dims.size() > 0){
-      setIntegerParam(ADSim_DsetDim1, dims[0]);
+      setIntegerParam(ADSim_DsetDim1, (int)dims[0]);
     } else {
       setIntegerParam(ADSim_DsetDim1, -1);
     }
     if (dims.size() > 1){
-      setIntegerParam(ADSim_DsetDim2, dims[1]);
+      setIntegerParam(ADSim_DsetDim2, (int)dims[1]);
     } else {
       setIntegerParam(ADSim_DsetDim2, -1);
     }
     if (dims.size() > 2){
-      setIntegerParam(ADSim_DsetDim3, dims[2]);
+      setIntegerParam(ADSim_DsetDim3, (int)dims[2]);
     } else {
       setIntegerParam(ADSim_DsetDim3, -1);
     }
     if (dims.size() > 3){
-      setIntegerParam(ADSim_DsetDim4, dims[3]);
+      setIntegerParam(ADSim_DsetDim4, (int)dims[3]);
     } else {
       setIntegerParam(ADSim_DsetDim4, -1);
     }
     if (dims.size() > 4){
-      setIntegerParam(ADSim_DsetDim5, dims[4]);
+      setIntegerParam(ADSim_DsetDim5, (int)dims[4]);
     } else {
       setIntegerParam(ADSim_DsetDim5, -1);
     }
     if (dims.size() > 5){
-      setIntegerParam(ADSim_DsetDim6, dims[5]);
+      setIntegerParam(ADSim_DsetDim6, (int)dims[5]);
     } else {
       setIntegerParam(ADSim_DsetDim6, -1);
     }
@@ -681,6 +3153,8 @@ asynStatus SimHDF5Detector::readDatasetInfo()
     // Note the parameters are not zero indexed but one!
     setIntegerParam(ADSim_XDim, dims.size());
     setIntegerParam(ADSim_YDim, dims.size()-1);
+    // Colour is only produced once a colour dimension has been selected
+    setIntegerParam(ADSim_ColorDim, 0);
 
     status = updateSourceImage();
   }
@@ -711,10 +3185,12 @@ asynStatus SimHDF5Detector::updateSourceImage()
   } else {
     dsetIndex--;
 
-    std::vector<int> dims = fileReader->getDatasetDimensions(fileReader->getDatasetKeys()[dsetIndex]);
+    std::vector<hsize_t> dims = fileReader->getDatasetDimensions(fileReader->getDatasetKeys()[dsetIndex]);
     getIntegerParam(ADSim_XDim, &xdim);
     getIntegerParam(ADSim_YDim, &ydim);
-    if (xdim > (int)dims.size() || ydim > (int)dims.size() || xdim == ydim || xdim < 1 || ydim < 1){
+    int cdim = 0;
+    getIntegerParam(ADSim_ColorDim, &cdim);
+    if (xdim > (int)dims.size() || ydim > (int)dims.size() || xdim == ydim || xdim < 1 || ydim < 1 || xdim == cdim || ydim == cdim){
       status = asynError;
       asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                 "%s:%s: Invalid dimension indexes given\n",
@@ -724,11 +3200,28 @@ asynStatus SimHDF5Detector::updateSourceImage()
       xdim--;
       ydim--;
 
-      // Set the sensor size to the selected dimensions
-      setIntegerParam(ADMaxSizeX, dims[xdim]);
-      setIntegerParam(ADMaxSizeY, dims[ydim]);
-      setIntegerParam(ADSizeX, dims[xdim]);
-      setIntegerParam(ADSizeY, dims[ydim]);
+      // Set the sensor size to the selected dimensions, or to the size of
+      // the synthetic frame when the output geometry is not direct
+      int sensorX = (int)dims[xdim];
+      int sensorY = (int)dims[ydim];
+      int outputMode = SimHDF5GeometryDirect;
+      getIntegerParam(ADSim_OutputMode, &outputMode);
+      if (outputMode != SimHDF5GeometryDirect){
+        int outputX = 0;
+        int outputY = 0;
+        getIntegerParam(ADSim_OutputSizeX, &outputX);
+        getIntegerParam(ADSim_OutputSizeY, &outputY);
+        if (outputX > 0){
+          sensorX = outputX;
+        }
+        if (outputY > 0){
+          sensorY = outputY;
+        }
+      }
+      setIntegerParam(ADMaxSizeX, sensorX);
+      setIntegerParam(ADMaxSizeY, sensorY);
+      setIntegerParam(ADSizeX, sensorX);
+      setIntegerParam(ADSizeY, sensorY);
       setIntegerParam(ADMinX, 0);
       setIntegerParam(ADMinY, 0);
 
@@ -737,8 +3230,8 @@ asynStatus SimHDF5Detector::updateSourceImage()
       setIntegerParam(NDDataType, type);
 
       // Read the number of bytes for the datatype and set the NDArray parameters accordingly
-      setIntegerParam(NDArraySizeX, dims[xdim]);
-      setIntegerParam(NDArraySizeY, dims[ydim]);
+      setIntegerParam(NDArraySizeX, sensorX);
+      setIntegerParam(NDArraySizeY, sensorY);
       int bytes = 0;
       switch (type)
       {
@@ -758,7 +3251,9 @@ asynStatus SimHDF5Detector::updateSourceImage()
         case NDFloat64:
           bytes = 8;
       }
-      setIntegerParam(NDArraySize, dims[xdim]*dims[ydim]*bytes);
+      int depth = colorPlanes() * framesPerArray();
+      setIntegerParam(NDArraySizeZ, depth > 1 ? depth : 0);
+      setIntegerParam(NDArraySize, sensorX*sensorY*bytes*depth);
     }
   }
   return status;
@@ -855,10 +3350,153 @@ asynStatus SimHDF5Detector::setArraySizes()
             "%s:%s: Calculating array sizeX: %d sizeY: %d bytes: %d\n",
             driverName, functionName, sizeX, sizeY, bytes);
 
-  setIntegerParam(NDArraySize, sizeX*sizeY*bytes);
+  int depth = colorPlanes() * framesPerArray();
+  setIntegerParam(NDArraySizeZ, depth > 1 ? depth : 0);
+  setIntegerParam(NDArraySize, sizeX*sizeY*bytes*depth);
+  updateRegions();
+  return status;
+}
+
+/** Read the region defined on an address and clip it to the frame.
+  * \param[in] addr the address, from 1 to SIMHDF5_MAX_ROIS.
+  * \param[in] width width of the frame.
+  * \param[in] height height of the frame.
+  * \param[out] region the clipped region.
+  * \return false if the region is disabled or lies outside the frame.
+  *
+  * A size of 0 extends the region to the edge of the frame.  Must be called
+  * with the driver lock held.
+  */
+bool SimHDF5Detector::clipRegion(int addr, int width, int height, ADSimRegion *region)
+{
+  int enable = 0;
+
+  getIntegerParam(addr, ADSim_RoiEnable, &enable);
+  getIntegerParam(addr, ADSim_RoiMinX, &region->minX);
+  getIntegerParam(addr, ADSim_RoiMinY, &region->minY);
+  getIntegerParam(addr, ADSim_RoiSizeX, &region->sizeX);
+  getIntegerParam(addr, ADSim_RoiSizeY, &region->sizeY);
+  region->addr = addr;
+  if (!enable || region->minX >= width || region->minY >= height){
+    return false;
+  }
+  if (region->sizeX == 0 || region->sizeX > width - region->minX){
+    region->sizeX = width - region->minX;
+  }
+  if (region->sizeY == 0 || region->sizeY > height - region->minY){
+    region->sizeY = height - region->minY;
+  }
+  return true;
+}
+
+/** Publish the size of each region and whether it is published as a view.
+  *
+  * Called whenever a region or the size of the frame changes.
+  */
+void SimHDF5Detector::updateRegions()
+{
+  int width = 0;
+  int height = 0;
+  int colorMode = NDColorModeMono;
+  int planes = framesPerArray();
+
+  getIntegerParam(NDArraySizeX, &width);
+  getIntegerParam(NDArraySizeY, &height);
+  if (colorPlanes() == 3){
+    getIntegerParam(NDColorMode, &colorMode);
+    planes = (colorMode == NDColorModeRGB3) ? 3 : 1;
+  }
+  for (int addr = 1; addr <= SIMHDF5_MAX_ROIS; addr++){
+    ADSimRegion region;
+    if (clipRegion(addr, width, height, &region)){
+      setIntegerParam(addr, NDArraySizeX, region.sizeX);
+      setIntegerParam(addr, NDArraySizeY, region.sizeY);
+      setIntegerParam(addr, ADSim_RoiView, regionContiguous(region, width, height, colorMode, planes) ? 1 : 0);
+    } else {
+      setIntegerParam(addr, NDArraySizeX, 0);
+      setIntegerParam(addr, NDArraySizeY, 0);
+      setIntegerParam(addr, ADSim_RoiView, 0);
+    }
+    callParamCallbacks(addr, addr);
+  }
+}
+
+/** Verify the selected colour dimension can be used with the current dataset.
+ *
+ * A colour dimension of 0 disables colour.  Otherwise the dimension must
+ * exist, must not be one of the image dimensions and must be of size 3.
+ */
+asynStatus SimHDF5Detector::verifyColor()
+{
+  asynStatus status = asynSuccess;
+  int dsetIndex = 0;
+  int xdim = 0;
+  int ydim = 0;
+  int cdim = 0;
+  const char *functionName = "verifyColor";
+
+  getIntegerParam(ADSim_ColorDim, &cdim);
+  if (cdim == 0){
+    return status;
+  }
+  getIntegerParam(ADSim_DsetIndex, &dsetIndex);
+  if (!validFile || dsetIndex > (int)fileReader->getDatasetKeys().size() || dsetIndex < 1){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: No dataset selected for colour dimension\n",
+              driverName, functionName);
+    return asynError;
+  }
+  dsetIndex--;
+  std::vector<hsize_t> dims = fileReader->getDatasetDimensions(fileReader->getDatasetKeys()[dsetIndex]);
+  getIntegerParam(ADSim_XDim, &xdim);
+  getIntegerParam(ADSim_YDim, &ydim);
+  if (cdim < 1 || cdim > (int)dims.size() || cdim == xdim || cdim == ydim){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: Invalid colour dimension %d\n",
+              driverName, functionName, cdim);
+    status = asynError;
+  } else if (dims[cdim-1] != 3){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s: Colour dimension %d has size %d, it must be 3\n",
+              driverName, functionName, cdim, (int)dims[cdim-1]);
+    status = asynError;
+  }
   return status;
 }
 
+/** Return the number of colour planes in each output image.
+ *
+ * Three planes are produced when a colour dimension is selected and
+ * the colour mode is one of the RGB modes, otherwise images are mono.
+ */
+int SimHDF5Detector::colorPlanes()
+{
+  int cdim = 0;
+  int colorMode = NDColorModeMono;
+  getIntegerParam(ADSim_ColorDim, &cdim);
+  getIntegerParam(NDColorMode, &colorMode);
+  if (cdim > 0 && (colorMode == NDColorModeRGB1 || colorMode == NDColorModeRGB2 || colorMode == NDColorModeRGB3)){
+    return 3;
+  }
+  return 1;
+}
+
+/** Return the number of frames stacked into each output NDArray.
+ *
+ * Colour images are never stacked, so this is always 1 when colour is enabled.
+ */
+int SimHDF5Detector::framesPerArray()
+{
+  int frames = 1;
+  int shardSize = 1;
+  getIntegerParam(ADSim_FramesPerArray, &frames);
+  getIntegerParam(ADSim_ShardSize, &shardSize);
+  if (frames < 1 || colorPlanes() == 3 || shardSize > 1){
+    frames = 1;
+  }
+  return frames;
+}
+
 /** Destructor.
  */
 SimHDF5Detector::~SimHDF5Detector()
@@ -868,11 +3506,28 @@ SimHDF5Detector::~SimHDF5Detector()
 // Code required for iocsh registration of the SimHDF5Detector driver
 extern "C"
 {
-  int SimHDF5DetectorConfig(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize)
+  int SimHDF5DetectorConfig(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize, int readerWorkers)
   {
-    new SimHDF5Detector(portName, maxBuffers, maxMemory, priority, stackSize);
+    new SimHDF5Detector(portName, maxBuffers, maxMemory, priority, stackSize, readerWorkers);
     return asynSuccess;
   }
+
+  /** Emit the next frame of a detector acquiring in external trigger mode.
+    * \param[in] portName asyn port name of the detector.
+    *
+    * Can be called from the IOC shell or from other code in the IOC, such
+    * as device support handling a hardware trigger.  Returns asynError if
+    * there is no such port or it is not acquiring in external trigger mode.
+    */
+  int SimHDF5DetectorTrigger(const char *portName)
+  {
+    SimHDF5Detector *pDetector = dynamic_cast<SimHDF5Detector *>((asynPortDriver *)findAsynPortDriver(portName));
+    if (!pDetector){
+      errlogPrintf("SimHDF5DetectorTrigger: no SimHDF5Detector port named %s\n", portName);
+      return asynError;
+    }
+    return pDetector->trigger(ADSimTriggerExternal);
+  }
 }
 
 static const iocshArg SimHDF5DetectorConfigArg0 = {"portName", iocshArgString};
@@ -880,23 +3535,41 @@ static const iocshArg SimHDF5DetectorConfigArg1 = {"Max number of NDArray buffer
 static const iocshArg SimHDF5DetectorConfigArg2 = {"maxMemory", iocshArgInt};
 static const iocshArg SimHDF5DetectorConfigArg3 = {"priority", iocshArgInt};
 static const iocshArg SimHDF5DetectorConfigArg4 = {"stackSize", iocshArgInt};
+static const iocshArg SimHDF5DetectorConfigArg5 = {"readerWorkers", iocshArgInt};
 
 static const iocshArg * const SimHDF5DetectorConfigArgs[] =  {&SimHDF5DetectorConfigArg0,
                                                               &SimHDF5DetectorConfigArg1,
                                                               &SimHDF5DetectorConfigArg2,
                                                               &SimHDF5DetectorConfigArg3,
-                                                              &SimHDF5DetectorConfigArg4};
+                                                              &SimHDF5DetectorConfigArg4,
+                                                              &SimHDF5DetectorConfigArg5};
 
-static const iocshFuncDef configSimHDF5Detector = {"SimHDF5DetectorConfig", 5, SimHDF5DetectorConfigArgs};
+static const iocshFuncDef configSimHDF5Detector = {"SimHDF5DetectorConfig", 6, SimHDF5DetectorConfigArgs};
 
 static void configSimHDF5DetectorCallFunc(const iocshArgBuf *args)
 {
-    SimHDF5DetectorConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival);
+    SimHDF5DetectorConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival, args[5].ival);
+}
+
+static const iocshArg SimHDF5DetectorTriggerArg0 = {"portName", iocshArgString};
+
+static const iocshArg * const SimHDF5DetectorTriggerArgs[] = {&SimHDF5DetectorTriggerArg0};
+
+static const iocshFuncDef triggerSimHDF5Detector = {"SimHDF5DetectorTrigger", 1, SimHDF5DetectorTriggerArgs};
+
+static void triggerSimHDF5DetectorCallFunc(const iocshArgBuf *args)
+{
+    int status = SimHDF5DetectorTrigger(args[0].sval);
+#if defined(EPICS_VERSION_INT) && EPICS_VERSION_INT >= VERSION_INT(7,0,3,1)
+    // Lets a script run with iocsh -e stop on the failure
+    iocshSetError(status);
+#endif
 }
 
 static void SimHDF5DetectorRegister(void)
 {
     iocshRegister(&configSimHDF5Detector, configSimHDF5DetectorCallFunc);
+    iocshRegister(&triggerSimHDF5Detector, triggerSimHDF5DetectorCallFunc);
 }
 
 epicsExportRegistrar(SimHDF5DetectorRegister);
@@ -8,11 +8,18 @@
 #ifndef ADSIMAPP_SRC_SimHDF5Detector_H_
 #define ADSIMAPP_SRC_SimHDF5Detector_H_
 
+#include <deque>
 #include <epicsEvent.h>
+#include <epicsMutex.h>
 #include "ADDriver.h"
 #include "SimHDF5FileReader.h"
 #include "SimHDF5MemoryReader.h"
+#include "SimHDF5ProcessReader.h"
 #include "SimHDF5Reader.h"
+#include "SimHDF5Geometry.h"
+#include "SimHDF5Allocator.h"
+#include "SimHDF5ViewPool.h"
+#include "SimHDF5SyncGroup.h"
 
 #define str_ADSim_Filename        "ADSim_Filename"
 #define str_ADSim_FileValid       "ADSim_FileValid"
@@ -29,6 +36,212 @@
 #define str_ADSim_XDim            "ADSim_XDim"
 #define str_ADSim_YDim            "ADSim_YDim"
 #define str_ADSim_DsetPath        "ADSim_DsetPath"
+#define str_ADSim_ColorDim        "ADSim_ColorDim"
+#define str_ADSim_FramesPerArray  "ADSim_FramesPerArray"
+#define str_ADSim_StatusRate      "ADSim_StatusRate"
+#define str_ADSim_CallbacksSaved  "ADSim_CallbacksSaved"
+#define str_ADSim_CallbackTimeSaved "ADSim_CallbackTimeSaved"
+#define str_ADSim_BackPressure    "ADSim_BackPressure"
+#define str_ADSim_DroppedFrames   "ADSim_DroppedFrames"
+#define str_ADSim_LateFrames      "ADSim_LateFrames"
+#define str_ADSim_PoolExhausted   "ADSim_PoolExhausted"
+#define str_ADSim_PoolFreeBuffers "ADSim_PoolFreeBuffers"
+#define str_ADSim_PoolUsedBuffers "ADSim_PoolUsedBuffers"
+#define str_ADSim_Throttle        "ADSim_Throttle"
+#define str_ADSim_ReadaheadFrames "ADSim_ReadaheadFrames"
+#define str_ADSim_DropCache       "ADSim_DropCache"
+#define str_ADSim_ReadEngine      "ADSim_ReadEngine"
+#define str_ADSim_ReadEngineActive "ADSim_ReadEngineActive"
+#define str_ADSim_QueueDepth      "ADSim_QueueDepth"
+#define str_ADSim_DirectIO        "ADSim_DirectIO"
+#define str_ADSim_FileDriver      "ADSim_FileDriver"
+#define str_ADSim_FileLoadTime    "ADSim_FileLoadTime"
+#define str_ADSim_ReaderType      "ADSim_ReaderType"
+#define str_ADSim_SharedStore     "ADSim_SharedStore"
+#define str_ADSim_SnapshotDir     "ADSim_SnapshotDir"
+#define str_ADSim_ConfigSwaps     "ADSim_ConfigSwaps"
+#define str_ADSim_Playlist        "ADSim_Playlist"
+#define str_ADSim_PlaylistOrder   "ADSim_PlaylistOrder"
+#define str_ADSim_PlaylistEntry   "ADSim_PlaylistEntry"
+#define str_ADSim_OutputMode      "ADSim_OutputMode"
+#define str_ADSim_OutputSizeX     "ADSim_OutputSizeX"
+#define str_ADSim_OutputSizeY     "ADSim_OutputSizeY"
+#define str_ADSim_OutputThreads   "ADSim_OutputThreads"
+#define str_ADSim_SoftTrigger     "ADSim_SoftTrigger"
+#define str_ADSim_TriggerCount    "ADSim_TriggerCount"
+#define str_ADSim_TriggersMissed  "ADSim_TriggersMissed"
+#define str_ADSim_TriggerLatency  "ADSim_TriggerLatency"
+#define str_ADSim_TriggerLatencyMean "ADSim_TriggerLatencyMean"
+#define str_ADSim_TriggerLatencyMax "ADSim_TriggerLatencyMax"
+#define str_ADSim_AcqCPUs         "ADSim_AcqCPUs"
+#define str_ADSim_AcqPriority     "ADSim_AcqPriority"
+#define str_ADSim_WorkerCPUs      "ADSim_WorkerCPUs"
+#define str_ADSim_WorkerPriority  "ADSim_WorkerPriority"
+#define str_ADSim_NumaNode        "ADSim_NumaNode"
+#define str_ADSim_PlacementStatus "ADSim_PlacementStatus"
+#define str_ADSim_MemoryLock      "ADSim_MemoryLock"
+#define str_ADSim_LockedBytes     "ADSim_LockedBytes"
+#define str_ADSim_LockStatus      "ADSim_LockStatus"
+#define str_ADSim_PrefaultBuffers "ADSim_PrefaultBuffers"
+#define str_ADSim_BufferAlign     "ADSim_BufferAlign"
+#define str_ADSim_HugePages       "ADSim_HugePages"
+#define str_ADSim_PoolPreallocate "ADSim_PoolPreallocate"
+#define str_ADSim_BufferStatus    "ADSim_BufferStatus"
+#define str_ADSim_TimestampDset   "ADSim_TimestampDset"
+#define str_ADSim_TimestampSpeedup "ADSim_TimestampSpeedup"
+#define str_ADSim_TimestampCount  "ADSim_TimestampCount"
+#define str_ADSim_AttributeDsets  "ADSim_AttributeDsets"
+#define str_ADSim_AttributeCount  "ADSim_AttributeCount"
+#define str_ADSim_LoadState       "ADSim_LoadState"
+#define str_ADSim_LoadProgress    "ADSim_LoadProgress"
+#define str_ADSim_LoadRate        "ADSim_LoadRate"
+#define str_ADSim_LoadCancel      "ADSim_LoadCancel"
+#define str_ADSim_RoiEnable       "ADSim_RoiEnable"
+#define str_ADSim_RoiMinX         "ADSim_RoiMinX"
+#define str_ADSim_RoiMinY         "ADSim_RoiMinY"
+#define str_ADSim_RoiSizeX        "ADSim_RoiSizeX"
+#define str_ADSim_RoiSizeY        "ADSim_RoiSizeY"
+#define str_ADSim_RoiView         "ADSim_RoiView"
+#define str_ADSim_SyncGroup       "ADSim_SyncGroup"
+#define str_ADSim_SyncTimeout     "ADSim_SyncTimeout"
+#define str_ADSim_SyncMembers     "ADSim_SyncMembers"
+#define str_ADSim_SyncSkew        "ADSim_SyncSkew"
+#define str_ADSim_SyncSkewMax     "ADSim_SyncSkewMax"
+#define str_ADSim_ReaderWorkers   "ADSim_ReaderWorkers"
+#define str_ADSim_ShardRank       "ADSim_ShardRank"
+#define str_ADSim_ShardSize       "ADSim_ShardSize"
+
+// Shortest and longest waits (s) used when the NDArrayPool is exhausted.  The
+// pool gives no notice when a buffer is released, so the Block policy polls
+// for a free buffer every SIMHDF5_MIN_THROTTLE and Adaptive every throttle.
+#define SIMHDF5_MIN_THROTTLE      0.001
+#define SIMHDF5_MAX_THROTTLE      1.0
+
+// Longest playlist that can be set
+#define SIMHDF5_MAX_PLAYLIST_LEN  1024
+
+// Longest list of attribute datasets that can be set
+#define SIMHDF5_MAX_ATTRIBUTE_LIST_LEN 1024
+
+// Longest CPU list that can be set
+#define SIMHDF5_MAX_CPU_LIST_LEN  256
+
+// Longest status message that can be published
+#define SIMHDF5_MAX_MESSAGE_LEN   256
+
+// Most regions that can be published, each on its own asyn address from 1
+#define SIMHDF5_MAX_ROIS          8
+
+// Most triggers that can wait for a frame, further triggers are missed
+#define SIMHDF5_MAX_PENDING_TRIGGERS 64
+
+/** Enumeration of the readers used to obtain frames */
+typedef enum
+{
+  ADSimReaderFile,            // Frames are read from the file as they are needed
+  ADSimReaderMemory,          // Every frame is preloaded into memory
+  ADSimReaderProcess          // Frames are read from the file by worker processes
+} ADSimReader_t;
+
+/** Enumeration of the stages of loading a file */
+typedef enum
+{
+  ADSimLoadIdle,              // No file has been loaded
+  ADSimLoadOpening,           // The file is being validated, opened and scanned
+  ADSimLoadPreloading,        // Frames are being loaded into memory, acquisition may start
+  ADSimLoadDone,              // The file is loaded
+  ADSimLoadCancelled,         // The load was cancelled
+  ADSimLoadFailed             // The file could not be loaded
+} ADSimLoadState_t;
+
+/** Enumeration of the sources that time the emission of frames */
+typedef enum
+{
+  ADSimTriggerInternal,       // Frames are emitted every acquire period
+  ADSimTriggerSoftware,       // A frame is emitted for each write to ADSim_SoftTrigger
+  ADSimTriggerExternal        // A frame is emitted for each call to SimHDF5DetectorTrigger
+} ADSimTriggerMode_t;
+
+/** Enumeration of policies applied when the NDArrayPool has no free buffers */
+typedef enum
+{
+  ADSimBackPressureBlock,     // Wait for a free buffer and then emit the frame late
+  ADSimBackPressureDrop,      // Drop the frame and stay on schedule
+  ADSimBackPressureAdaptive   // Wait for a free buffer and slow the frame rate down
+} ADSimBackPressure_t;
+
+/** Enumeration of the orders in which playlist entries are cycled through */
+typedef enum
+{
+  ADSimPlaylistForward,       // First to last entry, then start again
+  ADSimPlaylistReverse,       // Last to first entry, then start again
+  ADSimPlaylistPingPong       // First to last and back again without repeating the end entries
+} ADSimPlaylistOrder_t;
+
+/** Dataset read for one entry of a playlist */
+struct ADSimPlaylistEntry
+{
+  std::string dname;          // Name of the dataset
+  std::vector<hsize_t> dims;  // Dimensions of the dataset
+  int repeats;                // Number of consecutive frames read from the dataset
+};
+
+/** Position reached in a playlist */
+struct ADSimPlaylistPosition
+{
+  int step;                   // Number of entries completed since the start of the playlist
+  int count;                  // Number of frames read from the current entry
+  std::map<std::string, hsize_t> frames; // Index of the next frame to read from each dataset
+};
+
+/** Per-frame values attached to frames as an NDAttribute */
+struct ADSimFrameAttribute
+{
+  std::string name;           // Name of the NDAttribute
+  std::string path;           // Dataset the values are read from
+  bool integer;               // Are the values integers
+  std::vector<double> values; // Value for each frame of the image dataset
+};
+
+/** Region of each frame published on its own asyn address */
+struct ADSimRegion
+{
+  int addr;                   // Asyn address the region is published on
+  int minX;                   // Offset of the region in X
+  int minY;                   // Offset of the region in Y
+  int sizeX;                  // Size of the region in X
+  int sizeY;                  // Size of the region in Y
+};
+
+/** Settings used to read frames.  These are captured together under the
+  * driver lock so that a frame is never read with a mix of old and new
+  * settings, and so that the acquisition task can read frames without
+  * holding the lock.
+  */
+struct ADSimReadConfig
+{
+  std::string dname;          // Name of the dataset to read
+  std::vector<hsize_t> dims;  // Dimensions of the dataset
+  int xdim;                   // Zero indexed dimension used for the image X
+  int ydim;                   // Zero indexed dimension used for the image Y
+  int cdim;                   // Zero indexed colour dimension, -1 for mono images
+  int minX;                   // ROI offset in X
+  int minY;                   // ROI offset in Y
+  int width;                  // ROI size in X
+  int height;                 // ROI size in Y
+  NDDataType_t dataType;      // Data type of the output NDArray
+  int colorMode;              // Colour mode of the output NDArray
+  int planes;                 // Number of colour planes, 1 or 3
+  int readahead;              // Number of frames ahead to hint to the reader
+  std::vector<ADSimPlaylistEntry> playlist; // Datasets to cycle through, empty to read dname only
+  int playlistOrder;          // Order in which the playlist entries are cycled through
+  int outputMode;             // How the frame read is mapped onto the output frame
+  int shardRank;              // Position of this detector among the shards of the frame sequence
+  int shardSize;              // Number of shards the frame sequence is split between
+  int sensorWidth;            // Width of the output frame that the ROI is taken from
+  int sensorHeight;           // Height of the output frame that the ROI is taken from
+  std::vector<ADSimRegion> regions; // Regions of the frame published on their own addresses
+};
 
 class SimHDF5Detector : public ADDriver
 {
@@ -37,12 +250,16 @@ public:
               int maxBuffers,
               size_t maxMemory,
               int priority,
-              int stackSize);
+              int stackSize,
+              int readerWorkers);
   virtual ~SimHDF5Detector();
 
   void acqTask();
+  void loaderTask();
+  void statusTask();
   virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
   virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
+  asynStatus trigger(int source);
 
 protected:
   int ADSim_Filename;         // Filename of HDF5 file to use for data source
@@ -61,22 +278,175 @@ protected:
   int ADSim_XDim;             // Selected dimension to represent the image X
   int ADSim_YDim;             // Selected dimension to represent the image Y
   int ADSim_DsetPath;         // Path of currently selected dataset
-  #define LAST_ADSIM_DETECTOR_PARAM ADSim_DsetPath
+  int ADSim_ColorDim;         // Selected dimension to represent the colour planes (0 for none)
+  int ADSim_FramesPerArray;   // Number of consecutive frames stacked into each NDArray
+  int ADSim_StatusRate;       // Rate (Hz) at which status and counters are published during acquisition, 0 for every frame
+  int ADSim_CallbacksSaved;   // Number of parameter callbacks skipped during this acquisition
+  int ADSim_CallbackTimeSaved; // Estimated time (s) saved by skipping parameter callbacks
+  int ADSim_BackPressure;     // Policy applied when the NDArrayPool is exhausted
+  int ADSim_DroppedFrames;    // Number of frames dropped during this acquisition
+  int ADSim_LateFrames;       // Number of frames emitted later than the acquire period
+  int ADSim_PoolExhausted;    // Number of times an NDArray could not be allocated
+  int ADSim_PoolFreeBuffers;  // Number of free buffers in the NDArrayPool
+  int ADSim_PoolUsedBuffers;  // Number of buffers in use from the NDArrayPool
+  int ADSim_Throttle;         // Extra delay (s) added to each frame by the adaptive policy
+  int ADSim_ReadaheadFrames;  // Number of frames ahead of the current frame to hint to the reader
+  int ADSim_DropCache;        // Drop the source file from the page cache
+  int ADSim_ReadEngine;       // Requested engine used to read frames from the file
+  int ADSim_ReadEngineActive; // Engine actually used to read frames during this acquisition
+  int ADSim_QueueDepth;       // Maximum number of raw chunk reads in flight
+  int ADSim_DirectIO;         // Open the file with O_DIRECT for raw chunk reads
+  int ADSim_FileDriver;       // HDF5 virtual file driver used to open the file
+  int ADSim_FileLoadTime;     // Time (s) taken to load the file
+  int ADSim_ReaderType;       // Read frames from the file or preload them into memory
+  int ADSim_SharedStore;      // Share preloaded frames with other IOCs on the host
+  int ADSim_SnapshotDir;      // Directory for snapshots of preloaded frames
+  int ADSim_ConfigSwaps;      // Number of times new read settings were switched to during this acquisition
+  int ADSim_Playlist;         // List of datasets and repeat counts to cycle through
+  int ADSim_PlaylistOrder;    // Order in which the playlist entries are cycled through
+  int ADSim_PlaylistEntry;    // Playlist entry the last frame was read from, 0 without a playlist
+  int ADSim_OutputMode;       // How the frame read from the dataset is mapped onto the output frame
+  int ADSim_OutputSizeX;      // Width of the synthetic output frame, 0 for the dataset width
+  int ADSim_OutputSizeY;      // Height of the synthetic output frame, 0 for the dataset height
+  int ADSim_OutputThreads;    // Number of threads used to build synthetic output frames
+  int ADSim_SoftTrigger;      // Emit the staged frame when in software trigger mode
+  int ADSim_TriggerCount;     // Number of frames emitted by triggers during this acquisition
+  int ADSim_TriggersMissed;   // Number of triggers discarded because too many were waiting
+  int ADSim_TriggerLatency;   // Time (s) from the last trigger until its frame was published
+  int ADSim_TriggerLatencyMean; // Mean time (s) from trigger to NDArray callback
+  int ADSim_TriggerLatencyMax; // Longest time (s) from trigger to NDArray callback
+  int ADSim_AcqCPUs;          // CPUs the acquisition task runs on, empty for any
+  int ADSim_AcqPriority;      // SCHED_FIFO priority of the acquisition task, 0 for normal scheduling
+  int ADSim_WorkerCPUs;       // CPUs the frame building workers run on, empty for any
+  int ADSim_WorkerPriority;   // SCHED_FIFO priority of the frame building workers, 0 for normal scheduling
+  int ADSim_NumaNode;         // NUMA node that frames and buffers are placed on, -1 for none
+  int ADSim_PlacementStatus;  // Result of placing the acquisition task and workers
+  int ADSim_MemoryLock;       // Lock preloaded frames into memory
+  int ADSim_LockedBytes;      // Number of bytes of preloaded frames locked into memory
+  int ADSim_LockStatus;       // Result of locking preloaded frames
+  int ADSim_PrefaultBuffers;  // Number of NDArrayPool buffers touched before acquisition, 0 for none
+  int ADSim_BufferAlign;      // Alignment of NDArray buffers
+  int ADSim_HugePages;        // Map NDArray buffers with MAP_HUGETLB
+  int ADSim_PoolPreallocate;  // Fill the NDArrayPool to its limit before acquisition
+  int ADSim_BufferStatus;     // Result of allocating NDArray buffers
+  int ADSim_TimestampDset;    // Dataset of recorded frame times to replay, empty for a fixed period
+  int ADSim_TimestampSpeedup; // Factor by which recorded frame times are sped up
+  int ADSim_TimestampCount;   // Number of recorded frame times loaded, 0 if the fixed period is used
+  int ADSim_AttributeDsets;   // Datasets of per-frame values attached to frames as NDAttributes
+  int ADSim_AttributeCount;   // Number of per-frame attribute datasets loaded
+  int ADSim_LoadState;        // Stage reached in loading the file
+  int ADSim_LoadProgress;     // Percentage of the selected dataset loaded into memory
+  int ADSim_LoadRate;         // Rate (MB/s) at which frames are being loaded into memory
+  int ADSim_LoadCancel;       // Cancel the file load in progress
+  int ADSim_RoiEnable;        // Publish the region defined on this address
+  int ADSim_RoiMinX;          // Offset in X of the region defined on this address
+  int ADSim_RoiMinY;          // Offset in Y of the region defined on this address
+  int ADSim_RoiSizeX;         // Size in X of the region defined on this address, 0 to the edge of the frame
+  int ADSim_RoiSizeY;         // Size in Y of the region defined on this address, 0 to the edge of the frame
+  int ADSim_RoiView;          // Is the region published as a view of the frame rather than a copy
+  int ADSim_SyncGroup;        // Name of the group of detectors that start together, empty for none
+  int ADSim_SyncTimeout;      // Time (s) to wait for the rest of the sync group to start
+  int ADSim_SyncMembers;      // Number of detectors in the sync group
+  int ADSim_SyncSkew;         // Time (s) the last frame was published after the first member published it
+  int ADSim_SyncSkewMax;      // Largest skew (s) since the acquisition started
+  int ADSim_ReaderWorkers;    // Number of reader worker processes running
+  int ADSim_ShardRank;        // Emit only frames rank + k * size of the frame sequence
+  int ADSim_ShardSize;        // Number of detectors the frame sequence is split between
+  #define LAST_ADSIM_DETECTOR_PARAM ADSim_ShardSize
 
 private:
 
-  asynStatus readImage(int index);
+  asynStatus readImage(hsize_t index, int nframes);
+  void arrayDims(const ADSimReadConfig& config, int nframes, int *ndims, size_t *dims);
+  bool waitForTrigger(epicsTimeStamp *triggerTime);
+  asynStatus waitForSyncStart(epicsTimeStamp *start);
+  void publishSkew(size_t frame);
+  bool captureConfig(ADSimReadConfig& config);
+  void warmConfig(const ADSimReadConfig& config, hsize_t index, int nframes);
+  void readRegion(const ADSimReadConfig& config, const std::vector<hsize_t>& dims, int *minX, int *minY, int *width, int *height);
+  void prefetchFrame(const ADSimReadConfig& config, const ADSimPlaylistPosition& position, hsize_t index, int ahead);
+  asynStatus parsePlaylist(std::vector<ADSimPlaylistEntry>& entries);
+  int playlistEntry(const ADSimReadConfig& config, int step);
+  void advancePlaylist(const ADSimReadConfig& config, ADSimPlaylistPosition& position, int nframes);
+  void calculateIndexes(hsize_t index, const std::vector<hsize_t>& dims, int xdim, int ydim, int cdim, hsize_t *indexes);
+  asynStatus requestLoad();
+  bool loadBlocks(int function);
   asynStatus loadFile();
+  void preloadFile();
+  void preloadConfig();
+  asynStatus createReader();
   asynStatus readDatasetInfo();
   asynStatus updateSourceImage();
   asynStatus verifySizes();
   asynStatus setArraySizes();
+  asynStatus verifyColor();
+  int colorPlanes();
+  int framesPerArray();
+  void publishStatus(bool force);
+  hsize_t getArrayCount();
+  void setArrayCount(hsize_t count);
+  void publishFrame(NDArray *pImage);
+  bool clipRegion(int addr, int width, int height, ADSimRegion *region);
+  void updateRegions();
+  void applyPlacement();
+  void reportWorkerPlacement();
+  void updateLockStatus();
+  void applyBufferPolicy();
+  void prefaultPool(int count, bool fill);
+  void updateBufferStatus();
+  bool loadFrameTimes();
+  double replayStep(hsize_t frame, int *lastIndex, double offset, double speedup, double period);
+  void loadFrameAttributes();
+  void addFrameAttributes(NDAttributeList *pList, hsize_t frameIndex, int nframes);
 
   std::tr1::shared_ptr<SimHDF5Reader> fileReader;      // Filereader used for importing HDF5 datasets
+  std::tr1::shared_ptr<SimHDF5ProcessReader> processReader; // Reader using worker processes, empty if none were started
   bool validFile;                                      // Is the current file valid?
   epicsEventId startEventId;                           // Event used to signal acquisition start
   epicsEventId stopEventId;                            // Event used to signal acquisition stop
+  epicsEventId triggerEventId;                         // Event used to signal a trigger or stop to the acq task
+  epicsEventId loadEventId;                            // Event used to signal a load request to the loader task
+  epicsEventId statusEventId;                          // Event used to signal changed status to the status task
+  bool cancelLoad;                                     // The load in progress has been cancelled
+  epicsMutexId triggerMutex;                           // Protects the trigger state below
+  int activeTrigger;                                   // Trigger mode of the current acquisition, internal when idle
+  std::deque<epicsTimeStamp> pendingTriggers;          // Times of triggers waiting for a frame
+  int missedTriggers;                                  // Triggers discarded because too many were waiting
   NDArray *pRaw;                                       // Pointer to NDArrays ready to process
+  int rawColorMode;                                    // Colour mode of the NDArray in pRaw
+  std::vector<char> colorBuffer;                       // Scratch buffer for colour layout conversion
+  std::vector<char> sourceBuffer;                      // Scratch buffer for frames expanded to the output geometry
+  SimHDF5Geometry geometry;                            // Expands frames to the output geometry
+  bool statusPending;                                  // Status parameters have changed since they were last published
+  int savedCallbacks;                                  // Number of status publications skipped
+  double callbackCost;                                 // Average time (s) taken by a status publication
+  int droppedFrames;                                   // Frames dropped due to back pressure
+  int lateFrames;                                      // Frames emitted late
+  int poolExhaustedCount;                              // Number of NDArrayPool allocation failures
+  double throttle;                                     // Current adaptive slow down (s)
+  ADSimReadConfig readConfig;                          // Settings used to read the current frame
+  ADSimReadConfig nextConfig;                          // Prepared settings waiting for the next frame boundary
+  bool configChanged;                                  // Read settings have changed during the acquisition
+  bool configReady;                                    // nextConfig is prepared and ready to switch to
+  ADSimReadConfig loadConfig;                          // New read settings whose datasets are being loaded
+  bool configLoading;                                  // loadConfig is waiting for the loader task
+  int configRequests;                                  // Number of read settings passed to the loader task
+  int configLoads;                                     // Request number of the last settings loaded by the loader task
+  int configSwaps;                                     // Number of switches to new read settings
+  ADSimPlaylistPosition playPosition;                  // Position reached in the playlist of readConfig
+  bool acqRealtime;                                    // The acquisition task has been given a SCHED_FIFO priority
+  int poolBuffers;                                     // Most buffers the NDArrayPool may allocate, 0 for no limit
+  int bufferAlign;                                     // Alignment of the buffers in the NDArrayPool
+  bool hugePages;                                      // Are the buffers in the NDArrayPool mapped with huge pages
+  std::vector<double> frameTimes;                      // Recorded frame times (s) being replayed
+  std::string frameTimesPath;                          // Dataset that frameTimes was read from
+  double frameTimesMean;                               // Mean recorded interval (s), 0 if unknown
+  std::vector<ADSimFrameAttribute> frameAttributes;    // Per-frame values attached to every frame
+  std::string frameAttributesList;                     // List of datasets that frameAttributes was read from
+  SimHDF5ViewPool *viewPool;                           // Views of frames published as regions
+  SimHDF5SyncGroup *syncGroup;                         // Group of detectors started together, NULL for none
+  double syncSkewMax;                                  // Largest skew of the current acquisition
+  hsize_t arrayCount;                                  // Frames counted by NDArrayCounter, which wraps at 2^31
 
 };
 
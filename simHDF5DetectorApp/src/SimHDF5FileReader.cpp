@@ -6,10 +6,18 @@
  */
 
 #include "SimHDF5FileReader.h"
+#include "SimHDF5Layout.h"
+#include <hdf5_hl.h>
 #include <iostream>
 #include <string.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Most times larger than a frame the block read for a transposed frame may be
+#define SIMHDF5_BLOCK_SPAN 16
 
 /** C function called when inspecting the HDF5 for datasets.
   * \param[in] loc_id Internal ID of the HDF5 object.
@@ -41,16 +49,18 @@ SimHDF5FileReader::SimHDF5FileReader() :
   file(0),
   filename(""),
   fileLoaded(false),
-  dset_id(0),
-  dspace_id(0),
-  ndims(0),
-  dims(0),
-  type_id(0),
-  ntype_id(0),
   reading(false),
   inMemory(false),
   rawPtr(0),
-  memDatatype(NDUInt8)
+  memDatatype(NDUInt8),
+  adviseFd(-1),
+  engineType(SimHDF5EngineHDF5),
+  engineQueueDepth(32),
+  engineDirectIO(false),
+  engineReadahead(0),
+  fileDriver(SimHDF5DriverSec2),
+  fileImage(0),
+  fileImageSize(0)
 {
 
 }
@@ -123,21 +133,36 @@ int SimHDF5FileReader::fileExists()
 }
 
 /** Load the filename and inspect it.
+  * \return false if the file could not be opened.
   *
   * The file specified by filename is opened and then inspected
   * for datasets.
   */
-void SimHDF5FileReader::loadFile()
+bool SimHDF5FileReader::loadFile()
 {
   if (fileLoaded){
     // If there is already an open file then we need to unload it first
     unloadFile();
   }
-  // Open the file
-  file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  // Open the file with the selected driver
+  file = -1;
+  if (fileDriver == SimHDF5DriverImage){
+    file = openFileImage();
+  }
+  if (file < 0){
+    hid_t fapl = createFileAccess();
+    file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, fapl);
+    H5Pclose(fapl);
+  }
+  if (file < 0){
+    return false;
+  }
   fileLoaded = true;
+  // Open a plain descriptor on the file for page cache hints
+  adviseFd = open(filename.c_str(), O_RDONLY);
   // Iterate through the file structure to obtain all datasets
   H5Giterate(file, "/", NULL, file_info, this);
+  return true;
 }
 
 /** Unload currently loaded file and clear resources.
@@ -146,12 +171,125 @@ void SimHDF5FileReader::loadFile()
 void SimHDF5FileReader::unloadFile()
 {
   if (fileLoaded){
+    // Close any datasets still prepared for reading
+    cleanupDataset();
     // First empty the dataset containers
     datasets.clear();
     // Now force a close of the file, clearing out all references etc
     H5Fclose(this->file);
     this->file = -1;
+    // HDF5 takes ownership of the image and frees it when the file closes
+    fileImage = 0;
+    fileImageSize = 0;
+    if (adviseFd >= 0){
+      close(adviseFd);
+      adviseFd = -1;
+    }
+    fileLoaded = false;
+  }
+}
+
+/** Create the file access property list for the selected driver.
+  * \return property list to pass to H5Fopen, to be closed by the caller.
+  *
+  * The direct driver is only available if HDF5 was built with it, otherwise
+  * the file is dropped from the page cache and opened with sec2 so that the
+  * first pass over the file still comes from the storage.
+  */
+hid_t SimHDF5FileReader::createFileAccess()
+{
+  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+  switch (fileDriver){
+    case SimHDF5DriverDirect:
+#ifdef H5_HAVE_DIRECT
+      // Memory alignment, file system block size and copy buffer size
+      H5Pset_fapl_direct(fapl, 4096, 4096, 16*1024*1024);
+#else
+      printf("HDF5 built without the direct driver, dropping the page cache and using sec2\n");
+      {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd >= 0){
+          posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+          close(fd);
+        }
+      }
+      H5Pset_fapl_sec2(fapl);
+#endif
+      break;
+    case SimHDF5DriverCore:
+    case SimHDF5DriverImage:
+      // Grow in 64 MB steps and never write back to the file
+      H5Pset_fapl_core(fapl, 64*1024*1024, 0);
+      break;
+    default:
+      H5Pset_fapl_sec2(fapl);
+      break;
+  }
+  return fapl;
+}
+
+/** Read the whole file with one sequential pass and open it as a file image.
+  * \return HDF5 file identifier, or negative if the image could not be made.
+  *
+  * HDF5 uses the buffer in place and frees it when the file is closed.
+  * If the read fails the caller falls back to the core driver.
+  */
+hid_t SimHDF5FileReader::openFileImage()
+{
+  struct stat info;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0){
+    return -1;
+  }
+  if (fstat(fd, &info) != 0 || info.st_size <= 0){
+    close(fd);
+    return -1;
+  }
+  fileImageSize = (size_t)info.st_size;
+  fileImage = malloc(fileImageSize);
+  if (!fileImage){
+    printf("Unable to allocate %lu bytes for the file image\n", (unsigned long)fileImageSize);
+    close(fd);
+    fileImageSize = 0;
+    return -1;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  size_t done = 0;
+  while (done < fileImageSize){
+    size_t block = fileImageSize - done;
+    if (block > 64*1024*1024){
+      block = 64*1024*1024;
+    }
+    ssize_t result = pread(fd, (char *)fileImage + done, block, (off_t)done);
+    if (result < 0 && errno == EINTR){
+      continue;
+    }
+    if (result <= 0){
+      break;
+    }
+    done += result;
   }
+  close(fd);
+
+  hid_t fid = -1;
+  if (done == fileImageSize){
+    fid = H5LTopen_file_image(fileImage, fileImageSize, H5LT_FILE_IMAGE_DONT_COPY);
+  }
+  if (fid < 0){
+    printf("Unable to open %s as a file image\n", filename.c_str());
+    free(fileImage);
+    fileImage = 0;
+    fileImageSize = 0;
+  }
+  return fid;
+}
+
+/** Select the virtual file driver used the next time the file is loaded.
+  * \param[in] driver one of the SimHDF5Driver_t values
+  */
+void SimHDF5FileReader::setFileDriver(int driver)
+{
+  fileDriver = driver;
 }
 
 /** Return an array of dataset keys found within the file.
@@ -170,30 +308,59 @@ std::vector<std::string> SimHDF5FileReader::getDatasetKeys()
 
 /** Return the specified dataset dimensions.
   * \param[in] dname Name of the dataset
-  * \return vector of integer dimensions.
+  * \return vector of dimensions.
   *
   * Returns the dimensions of the specified dataset as a vector of
-  * integer values.
+  * 64-bit values.  The dimensions of datasets found when the file was
+  * loaded are returned without touching the file, so this is safe to call
+  * while frames are being read.
   */
-std::vector<int> SimHDF5FileReader::getDatasetDimensions(const std::string& dname)
+std::vector<hsize_t> SimHDF5FileReader::getDatasetDimensions(const std::string& dname)
 {
   if (reading && inMemory){
     return memDims;
   }
-  std::vector<int> dimensions;
+  if (datasets.count(dname) > 0){
+    return datasets[dname]->getDimensions();
+  }
+  std::vector<hsize_t> dimensions;
   hid_t dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
   hid_t dspace = H5Dget_space(dset);
   const int ndims = H5Sget_simple_extent_ndims(dspace);
-  hsize_t dims[ndims];
-  H5Sget_simple_extent_dims(dspace, dims, NULL);
-  for (int i = 0; i < ndims; i++){
-    dimensions.push_back((int)dims[i]);
+  if (ndims > 0){
+    // A dataset that does not exist has no dimensions
+    dimensions.resize(ndims);
+    H5Sget_simple_extent_dims(dspace, &dimensions[0], NULL);
   }
   H5Sclose(dspace);
   H5Dclose(dset);
   return dimensions;
 }
 
+/** Return the chunk dimensions of the specified dataset.
+  * \param[in] dname Name of the dataset
+  * \return vector of chunk dimensions, empty if the dataset is not chunked.
+  */
+std::vector<hsize_t> SimHDF5FileReader::getChunkDimensions(const std::string& dname)
+{
+  std::vector<hsize_t> chunkDims;
+  hid_t dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
+  if (dset < 0){
+    return chunkDims;
+  }
+  hid_t dcpl = H5Dget_create_plist(dset);
+  if (H5Pget_layout(dcpl) == H5D_CHUNKED){
+    int ndims = H5Pget_chunk(dcpl, 0, NULL);
+    if (ndims > 0){
+      chunkDims.resize(ndims);
+      H5Pget_chunk(dcpl, ndims, &chunkDims[0]);
+    }
+  }
+  H5Pclose(dcpl);
+  H5Dclose(dset);
+  return chunkDims;
+}
+
 /** Return the specified dataset type.
   * \param[in] dname Name of the dataset
   * \return data type of the dataset.
@@ -207,6 +374,9 @@ NDDataType_t SimHDF5FileReader::getDatasetType(const std::string& dname)
   if (inMemory){
     return memDatatype;
   }
+  if (datasets.count(dname) > 0){
+    return datasets[dname]->getDataType();
+  }
 
   hid_t dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
   hid_t type = H5Dget_type(dset);
@@ -253,24 +423,47 @@ NDDataType_t SimHDF5FileReader::getDatasetType(const std::string& dname)
   * \param[in] dname Name of the dataset
   *
   * Allocates the required resources ready to read out the data for
-  * the specified dataset.
+  * the specified dataset.  Each dataset prepared keeps its own handles and
+  * read engine until it is released or cleaned up, so a second dataset can
+  * be prepared while the first is still being read.
   */
 void SimHDF5FileReader::prepareToReadDataset(const std::string& dname)
 {
-  if (!reading){
-    dset_id = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
-    dspace_id = H5Dget_space(dset_id);
-    ndims = H5Sget_simple_extent_ndims(dspace_id);
-    dims = (hsize_t *)malloc(sizeof(hsize_t) * ndims);
-    H5Sget_simple_extent_dims(dspace_id, dims, NULL);
-    type_id = H5Dget_type(dset_id);
-    ntype_id = H5Tget_native_type(type_id, H5T_DIR_ASCEND);
+  lastPrepared = dname;
+  if (prepared.count(dname) == 0){
+    std::tr1::shared_ptr<ReadState> state(new ReadState());
+    state->dset_id = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
+    state->dspace_id = H5Dget_space(state->dset_id);
+    state->ndims = H5Sget_simple_extent_ndims(state->dspace_id);
+    state->dims.resize(state->ndims);
+    H5Sget_simple_extent_dims(state->dspace_id, &state->dims[0], NULL);
+    state->type_id = H5Dget_type(state->dset_id);
+    state->ntype_id = H5Tget_native_type(state->type_id, H5T_DIR_ASCEND);
+    // Record the storage layout so that frames can be located in the file
+    hid_t dcpl = H5Dget_create_plist(state->dset_id);
+    state->chunked = (H5Pget_layout(dcpl) == H5D_CHUNKED);
+    state->chunkDims.assign(state->ndims, 1);
+    if (state->chunked){
+      H5Pget_chunk(dcpl, state->ndims, &state->chunkDims[0]);
+      state->dataOffset = HADDR_UNDEF;
+    } else {
+      state->dataOffset = H5Dget_offset(state->dset_id);
+    }
+    H5Pclose(dcpl);
+    if (engineType != SimHDF5EngineHDF5 && !inMemory){
+      // Build the chunk table, falling back to H5Dread if the dataset cannot be decoded
+      state->engine = std::tr1::shared_ptr<SimHDF5ChunkEngine>(new SimHDF5ChunkEngine(engineQueueDepth, engineDirectIO, engineReadahead));
+      if (!state->engine->open(filename, state->dset_id, state->ntype_id)){
+        state->engine.reset();
+      }
+    }
+    prepared[dname] = state;
     if (inMemory){
       // We need to allocate the total memory required for the dataset
-      int totalBytes = 1;
-      hsize_t offset[ndims]; // Hyperslab offset in the file
-      for (int index = 0; index < ndims; index++){
-        totalBytes = totalBytes * dims[index];
+      size_t totalBytes = 1;
+      hsize_t offset[state->ndims]; // Hyperslab offset in the file
+      for (int index = 0; index < state->ndims; index++){
+        totalBytes = totalBytes * state->dims[index];
         offset[index] = 0;
       }
       switch (getDatasetType(dname)){
@@ -292,35 +485,22 @@ void SimHDF5FileReader::prepareToReadDataset(const std::string& dname)
           break;
       }
       // Perform the allocation
-      printf("Allocating %d bytes for dataset storage\n", totalBytes);
+      printf("Allocating %lu bytes for dataset storage\n", (unsigned long)totalBytes);
       rawPtr = malloc(totalBytes);
       // Select the hyperslab
-      herr_t status = H5Sselect_hyperslab(dspace_id, H5S_SELECT_SET, offset, NULL, dims, NULL);
+      herr_t status = H5Sselect_hyperslab(state->dspace_id, H5S_SELECT_SET, offset, NULL, &state->dims[0], NULL);
       // Define the memory dataspace.
-      hid_t memspace = H5Screate_simple(ndims,dims,NULL);
+      hid_t memspace = H5Screate_simple(state->ndims,&state->dims[0],NULL);
       // Select the memory hyperslab
-      status = H5Sselect_hyperslab(memspace, H5S_SELECT_SET, offset, NULL, dims, NULL);
+      status = H5Sselect_hyperslab(memspace, H5S_SELECT_SET, offset, NULL, &state->dims[0], NULL);
       // Read data from hyperslab in the file into the hyperslab in memory and to the data pointer
-      status = H5Dread(dset_id, ntype_id, memspace, dspace_id, H5P_DEFAULT, rawPtr);
+      status = H5Dread(state->dset_id, state->ntype_id, memspace, state->dspace_id, H5P_DEFAULT, rawPtr);
       // Cleanup
       H5Sclose(memspace);
 
-      std::vector<int> dimensions;
-      hid_t dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
-      hid_t dspace = H5Dget_space(dset);
-      const int ndims = H5Sget_simple_extent_ndims(dspace);
-      hsize_t dims[ndims];
-      H5Sget_simple_extent_dims(dspace, dims, NULL);
-      for (int i = 0; i < ndims; i++){
-        dimensions.push_back((int)dims[i]);
-      }
-      H5Sclose(dspace);
-      H5Dclose(dset);
-      memDims = dimensions;
-
-
+      memDims = state->dims;
 
-      dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
+      hid_t dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
       hid_t type = H5Dget_type(dset);
       hid_t ntype = H5Tget_native_type(type, H5T_DIR_ASCEND);
       if (H5Tequal(ntype, H5T_NATIVE_INT8)){
@@ -365,14 +545,26 @@ void SimHDF5FileReader::prepareToReadDataset(const std::string& dname)
       H5Fclose(this->file);
       this->file = -1;
     }
-    reading = true;
   }
+  reading = true;
+}
+
+/** Return the read state of a dataset, preparing it if necessary.
+  * \param[in] dname Name of the dataset
+  * \return read state of the dataset.
+  */
+SimHDF5FileReader::ReadState *SimHDF5FileReader::readState(const std::string& dname)
+{
+  if (prepared.count(dname) == 0){
+    prepareToReadDataset(dname);
+  }
+  return prepared[dname].get();
 }
 
-void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data)
+bool SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data)
 {
-  int indexes[6] = {0,0,0,0,0,0};
-  readFromDataset(dname, minX, minY, sizeX, sizeY, wdim, hdim, indexes, data);
+  hsize_t indexes[6] = {0,0,0,0,0,0};
+  return readFromDataset(dname, minX, minY, sizeX, sizeY, wdim, hdim, indexes, data);
 }
 
 /** Prepare information required to read out dataset data.
@@ -385,12 +577,15 @@ void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int
   * \param[in] hdim specified dimension number for y dimension
   * \param[in] indexes index values for additional dimensions
   * \param[out] data pointer to buffer for storing data
+  * \return false if the frame could not be read.
   *
   * Fills the data buffer with the data required according to the supplied
   * indexes, offsets and ROI parameters.
   */
-void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int *indexes, void *data)
+bool SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, void *data)
 {
+  ReadState *state = readState(dname);
+  int ndims = state->ndims;
   hid_t memspace;    // Memory space ID
   hsize_t dimsm[2];  // Memory space dimensions
   herr_t status;
@@ -401,7 +596,7 @@ void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int
   hsize_t offset_out[2]; // Hyperslab offset in memory
 
   if (inMemory){
-    int totalBytes = 1;
+    size_t totalBytes = 1;
     switch (getDatasetType(dname)){
       case NDInt8:
       case NDUInt8:
@@ -421,8 +616,8 @@ void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int
         break;
     }
       void *ptr = (void *)&(((char *)rawPtr)[0]);
-      memcpy(data, ptr, sizeX*sizeY*totalBytes);
-      return;
+      memcpy(data, ptr, (size_t)sizeX*sizeY*totalBytes);
+      return true;
   }
 
   // Define hyperslab in the dataset.
@@ -448,8 +643,20 @@ void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int
   // dimension sizes for the chosen width, height
   count[wdim] = sizeX;
   count[hdim] = sizeY;
+
+  // The raw chunk engine returns false for anything it cannot read
+  if (state->engine && state->engine->readFrame(offset, count, wdim, hdim, data)){
+    return true;
+  }
+
+  // HDF5 copies a selection in dataset order, one element at a time unless
+  // x is the last dimension, and never transposes it
+  if (wdim != ndims-1 || hdim > wdim){
+    return readBlock(state, offset, count, wdim, hdim, data);
+  }
+
   // Select the hyperslab
-  status = H5Sselect_hyperslab(dspace_id, H5S_SELECT_SET, offset, NULL, count, NULL);
+  status = H5Sselect_hyperslab(state->dspace_id, H5S_SELECT_SET, offset, NULL, count, NULL);
 
   // Define the memory dataspace.
   dimsm[1] = sizeX;
@@ -466,9 +673,381 @@ void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int
   status = H5Sselect_hyperslab(memspace, H5S_SELECT_SET, offset_out, NULL, count_out, NULL);
 
   // Read data from hyperslab in the file into the hyperslab in memory and to the data pointer
-  status = H5Dread(dset_id, ntype_id, memspace, dspace_id, H5P_DEFAULT, data);
+  status = H5Dread(state->dset_id, state->ntype_id, memspace, state->dspace_id, H5P_DEFAULT, data);
 
   H5Sclose(memspace);
+  return status >= 0;
+}
+
+/** Read a frame through a block in dataset order and transpose it.
+  * \param[in] state read state of the dataset
+  * \param[in] offset first element of the frame in each dimension
+  * \param[in] count number of elements of the frame in each dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[out] data pointer to buffer for storing the frame
+  * \return false if the block could not be read.
+  *
+  * Dimensions that vary faster than the frame are read in full, up to
+  * SIMHDF5_BLOCK_SPAN times the size of the frame, so that HDF5 copies long
+  * contiguous runs instead of single elements.  The frame is then picked out
+  * of the block and transposed into [y][x] order in cache sized tiles.
+  */
+bool SimHDF5FileReader::readBlock(ReadState *state, const hsize_t *offset, const hsize_t *count, int wdim, int hdim, void *data)
+{
+  int ndims = state->ndims;
+  int outer = wdim < hdim ? wdim : hdim;
+  size_t bytes = H5Tget_size(state->ntype_id);
+  hsize_t blockOffset[ndims];
+  hsize_t blockCount[ndims];
+  for (int index = 0; index < ndims; index++){
+    blockOffset[index] = offset[index];
+    blockCount[index] = count[index];
+  }
+  hsize_t span = 1;
+  for (int index = ndims-1; index > outer; index--){
+    if (index != wdim && index != hdim){
+      if (span * state->dims[index] > SIMHDF5_BLOCK_SPAN){
+        break;
+      }
+      span *= state->dims[index];
+      blockOffset[index] = 0;
+      blockCount[index] = state->dims[index];
+    }
+  }
+
+  size_t blockBytes = count[wdim] * count[hdim] * span * bytes;
+  if (blockBuffer.size() < blockBytes){
+    blockBuffer.resize(blockBytes);
+  }
+  // A memory space of the same shape lets HDF5 copy the block without
+  // working out how the two selections map onto each other
+  H5Sselect_hyperslab(state->dspace_id, H5S_SELECT_SET, blockOffset, NULL, blockCount, NULL);
+  hid_t memspace = H5Screate_simple(ndims, blockCount, NULL);
+  herr_t status = H5Dread(state->dset_id, state->ntype_id, memspace, state->dspace_id, H5P_DEFAULT, &blockBuffer[0]);
+  H5Sclose(memspace);
+  if (status < 0){
+    return false;
+  }
+
+  // The block is returned in dataset order
+  ptrdiff_t strides[ndims];
+  strides[ndims-1] = 1;
+  for (int index = ndims-2; index >= 0; index--){
+    strides[index] = strides[index+1] * blockCount[index+1];
+  }
+  size_t origin = 0;
+  for (int index = 0; index < ndims; index++){
+    origin += (offset[index] - blockOffset[index]) * strides[index];
+  }
+  ptrdiff_t srcStrides[2] = {strides[wdim], strides[hdim]};
+  SimHDF5Layout::packFrame(&blockBuffer[0] + origin * bytes, srcStrides, data, count[wdim], count[hdim], bytes);
+  return true;
+}
+
+/** Read a three colour image from the dataset in a single hyperslab.
+  * \param[in] dname Name of the dataset
+  * \param[in] minX offset of data in x dimension
+  * \param[in] minY offset of data in y dimension
+  * \param[in] sizeX ROI of data in x dimension
+  * \param[in] sizeY ROI of data in y dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[in] cdim specified dimension number for colour dimension
+  * \param[in] indexes index values for additional dimensions
+  * \param[out] data pointer to buffer for storing 3*sizeX*sizeY elements
+  * \return false if the frame could not be read.
+  *
+  * The data is returned in the order of the dataset dimensions, it is up to
+  * the caller to rearrange it into the required colour layout.
+  */
+bool SimHDF5FileReader::readColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes, void *data)
+{
+  ReadState *state = readState(dname);
+  int ndims = state->ndims;
+  hid_t memspace;    // Memory space ID
+  hsize_t dimsm[1];  // Memory space dimensions
+  herr_t status;
+
+  hsize_t count[ndims];  // Size of the hyperslab in the file
+  hsize_t offset[ndims]; // Hyperslab offset in the file
+
+  // Define hyperslab in the dataset, the colour dimension is read in full
+  int ofsindex = 0;
+  for (int index = 0; index < ndims; index++){
+    if (index == wdim){
+      offset[index] = minX;
+    } else if (index == hdim){
+      offset[index] = minY;
+    } else if (index == cdim){
+      offset[index] = 0;
+    } else {
+      // Set the offset to the specified index
+      offset[index] = indexes[ofsindex];
+      ofsindex++;
+    }
+    count[index]  = 1;
+  }
+  count[wdim] = sizeX;
+  count[hdim] = sizeY;
+  count[cdim] = 3;
+  // Select the hyperslab
+  status = H5Sselect_hyperslab(state->dspace_id, H5S_SELECT_SET, offset, NULL, count, NULL);
+
+  // The memory dataspace is a flat buffer, HDF5 fills it in dataset order
+  dimsm[0] = (hsize_t)3 * sizeX * sizeY;
+  memspace = H5Screate_simple(1, dimsm, NULL);
+
+  // Read data from hyperslab in the file into the hyperslab in memory and to the data pointer
+  status = H5Dread(state->dset_id, state->ntype_id, memspace, state->dspace_id, H5P_DEFAULT, data);
+
+  H5Sclose(memspace);
+  return status >= 0;
+}
+
+/** Read a number of consecutive frames from the dataset.
+  * \param[in] dname Name of the dataset
+  * \param[in] minX offset of data in x dimension
+  * \param[in] minY offset of data in y dimension
+  * \param[in] sizeX ROI of data in x dimension
+  * \param[in] sizeY ROI of data in y dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[in] indexes index values for additional dimensions of the first frame
+  * \param[in] nframes number of frames to read
+  * \param[out] data pointer to buffer for storing nframes*sizeX*sizeY elements
+  * \return false if any of the frames could not be read.
+  *
+  * Frames are counted through the additional dimensions with the last one
+  * varying fastest, wrapping back to the start of the dataset at the end.
+  * Runs of frames along the last additional dimension are combined into a
+  * single selection so that the whole stack is normally read with one
+  * H5Dread call.  If the frame dimensions are not all slower than the image
+  * dimensions the frames would be interleaved in the selection, so each
+  * frame is read individually instead, as they are when the raw chunk
+  * engine is in use or the image dimensions are swapped.
+  */
+bool SimHDF5FileReader::readFramesFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, int nframes, void *data)
+{
+  ReadState *state = readState(dname);
+  int ndims = state->ndims;
+  int nframedims = ndims - 2;
+  int framedims[ndims];
+  hsize_t cur[ndims];
+  size_t frameBytes = (size_t)sizeX * sizeY * H5Tget_size(state->ntype_id);
+  char *out = (char *)data;
+
+  // Build the list of frame dimensions and the starting position
+  int fi = 0;
+  for (int index = 0; index < ndims; index++){
+    if (index != wdim && index != hdim){
+      framedims[fi] = index;
+      cur[fi] = indexes[fi];
+      fi++;
+    }
+  }
+
+  if (state->engine || nframedims < 1 || framedims[nframedims-1] > wdim || framedims[nframedims-1] > hdim || hdim > wdim){
+    for (int frame = 0; frame < nframes; frame++){
+      if (!readFromDataset(dname, minX, minY, sizeX, sizeY, wdim, hdim, cur, out)){
+        return false;
+      }
+      out += frameBytes;
+      // Move to the next frame
+      cur[nframedims-1]++;
+      for (int i = nframedims-1; i > 0 && cur[i] >= state->dims[framedims[i]]; i--){
+        cur[i] = 0;
+        cur[i-1]++;
+      }
+      if (cur[0] >= state->dims[framedims[0]]){
+        cur[0] = 0;
+      }
+    }
+    return true;
+  }
+
+  hsize_t count[ndims];  // Size of the hyperslab in the file
+  hsize_t offset[ndims]; // Hyperslab offset in the file
+  int inner = framedims[nframedims-1];
+  int selected = 0;
+  int remaining = nframes;
+  while (remaining > 0){
+    for (int index = 0; index < ndims; index++){
+      count[index] = 1;
+    }
+    for (int i = 0; i < nframedims; i++){
+      offset[framedims[i]] = cur[i];
+    }
+    offset[wdim] = minX;
+    offset[hdim] = minY;
+    count[wdim] = sizeX;
+    count[hdim] = sizeY;
+    // Take as many frames as possible along the last frame dimension
+    int run = remaining;
+    if (state->dims[inner] - cur[nframedims-1] < (hsize_t)run){
+      run = (int)(state->dims[inner] - cur[nframedims-1]);
+    }
+    count[inner] = run;
+    H5Sselect_hyperslab(state->dspace_id, selected ? H5S_SELECT_OR : H5S_SELECT_SET, offset, NULL, count, NULL);
+    selected += run;
+    remaining -= run;
+
+    // Move to the next frame, noting if we have wrapped to the start of the dataset
+    bool wrapped = false;
+    cur[nframedims-1] += run;
+    for (int i = nframedims-1; i > 0 && cur[i] >= state->dims[framedims[i]]; i--){
+      cur[i] = 0;
+      cur[i-1]++;
+    }
+    if (cur[0] >= state->dims[framedims[0]]){
+      cur[0] = 0;
+      wrapped = true;
+    }
+
+    // The selection is returned in file order, so it must be read out
+    // before any frames from the start of the dataset are added
+    if (wrapped || remaining == 0){
+      hsize_t dimsm[1];
+      dimsm[0] = (hsize_t)selected * sizeX * sizeY;
+      hid_t memspace = H5Screate_simple(1, dimsm, NULL);
+      herr_t status = H5Dread(state->dset_id, state->ntype_id, memspace, state->dspace_id, H5P_DEFAULT, out);
+      H5Sclose(memspace);
+      if (status < 0){
+        return false;
+      }
+      out += frameBytes * selected;
+      selected = 0;
+    }
+  }
+  return true;
+}
+
+/** Ask the kernel to start reading a frame into the page cache.
+  * \param[in] dname Name of the dataset
+  * \param[in] minX offset of data in x dimension
+  * \param[in] minY offset of data in y dimension
+  * \param[in] sizeX ROI of data in x dimension
+  * \param[in] sizeY ROI of data in y dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[in] indexes index values for additional dimensions
+  *
+  * For chunked datasets the file offset and size of every chunk touched by
+  * the frame is looked up and passed to posix_fadvise(POSIX_FADV_WILLNEED),
+  * so that the scattered chunk reads HDF5 makes later are served from the
+  * page cache.  For contiguous datasets the byte range spanned by the frame
+  * is advised instead.  When the raw chunk engine is in use the chunks are
+  * read into its cache instead.
+  */
+void SimHDF5FileReader::prefetchFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes)
+{
+  if (adviseFd < 0 || !reading || inMemory){
+    return;
+  }
+  ReadState *state = readState(dname);
+  int ndims = state->ndims;
+
+  hsize_t start[ndims]; // First element of the frame in each dimension
+  hsize_t last[ndims];  // Last element of the frame in each dimension
+  int ofsindex = 0;
+  for (int index = 0; index < ndims; index++){
+    if (index == wdim){
+      start[index] = minX;
+      last[index] = minX + sizeX - 1;
+    } else if (index == hdim){
+      start[index] = minY;
+      last[index] = minY + sizeY - 1;
+    } else {
+      start[index] = indexes[ofsindex];
+      last[index] = indexes[ofsindex];
+      ofsindex++;
+    }
+  }
+
+  if (state->engine){
+    hsize_t count[ndims];
+    for (int index = 0; index < ndims; index++){
+      count[index] = last[index] - start[index] + 1;
+    }
+    state->engine->prefetchFrame(start, count);
+  } else if (state->chunked){
+    // Walk over every chunk that the frame touches
+    hsize_t coord[ndims];
+    for (int index = 0; index < ndims; index++){
+      coord[index] = (start[index] / state->chunkDims[index]) * state->chunkDims[index];
+    }
+    bool done = false;
+    while (!done){
+      unsigned filterMask = 0;
+      haddr_t addr = HADDR_UNDEF;
+      hsize_t size = 0;
+      if (H5Dget_chunk_info_by_coord(state->dset_id, coord, &filterMask, &addr, &size) >= 0 && addr != HADDR_UNDEF){
+        posix_fadvise(adviseFd, (off_t)addr, (off_t)size, POSIX_FADV_WILLNEED);
+      }
+      // Move on to the next chunk, last dimension fastest
+      done = true;
+      for (int index = ndims-1; index >= 0; index--){
+        coord[index] += state->chunkDims[index];
+        if (coord[index] <= last[index]){
+          done = false;
+          break;
+        }
+        coord[index] = (start[index] / state->chunkDims[index]) * state->chunkDims[index];
+      }
+    }
+  } else if (state->dataOffset != HADDR_UNDEF){
+    // Advise the range between the first and last element of the frame
+    hsize_t first = 0;
+    hsize_t final = 0;
+    for (int index = 0; index < ndims; index++){
+      first = first * state->dims[index] + start[index];
+      final = final * state->dims[index] + last[index];
+    }
+    size_t bytes = H5Tget_size(state->ntype_id);
+    posix_fadvise(adviseFd, (off_t)(state->dataOffset + first * bytes), (off_t)((final - first + 1) * bytes), POSIX_FADV_WILLNEED);
+  }
+}
+
+/** Drop the file from the page cache.
+  *
+  * Uses posix_fadvise(POSIX_FADV_DONTNEED), which does not need root, so
+  * that subsequent reads of the file come from the storage rather than
+  * memory.  HDF5 keeps its own chunk cache for each open dataset, which is
+  * emptied when the dataset is closed at the end of the acquisition.
+  */
+void SimHDF5FileReader::dropCache()
+{
+  if (adviseFd >= 0){
+    posix_fadvise(adviseFd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+}
+
+/** Select the engine used to read frames from the next dataset prepared.
+  * \param[in] engine SimHDF5EngineHDF5 or SimHDF5EngineChunk
+  * \param[in] queueDepth maximum number of chunk reads to keep in flight
+  * \param[in] directIO bypass the page cache with O_DIRECT
+  * \param[in] readahead number of frames prefetched ahead of the reads
+  */
+void SimHDF5FileReader::setReadEngine(int engine, int queueDepth, bool directIO, int readahead)
+{
+  engineType = engine;
+  engineQueueDepth = queueDepth;
+  engineDirectIO = directIO;
+  engineReadahead = readahead;
+}
+
+/** Return the engine actually being used to read frames.
+  *
+  * The engine reported is the one used by the dataset most recently
+  * prepared.  The raw chunk engine falls back to H5Dread for datasets it
+  * cannot decode and to pread if io_uring is not available.
+  */
+int SimHDF5FileReader::getReadEngine()
+{
+  if (prepared.count(lastPrepared) == 0 || !prepared[lastPrepared]->engine){
+    return SimHDF5EngineHDF5;
+  }
+  return prepared[lastPrepared]->engine->usingUring() ? SimHDF5EngineUring : SimHDF5EngineChunk;
 }
 
 /** Cleanup all resources after completion of reading out current dataset.
@@ -477,15 +1056,52 @@ void SimHDF5FileReader::readFromDataset(const std::string& dname, int minX, int
 void SimHDF5FileReader::cleanupDataset()
 {
   if (reading){
-    H5Tclose(ntype_id);
-    H5Tclose(type_id);
-    H5Sclose(dspace_id);
-    H5Dclose(dset_id);
-    free(dims);
+    std::map<std::string, std::tr1::shared_ptr<ReadState> >::iterator iter;
+    for (iter = prepared.begin(); iter != prepared.end(); ++iter){
+      closeReadState(iter->second.get());
+    }
+    prepared.clear();
     reading = false;
   }
 }
 
+/** Release the resources held for one prepared dataset.
+  * \param[in] dname Name of the dataset
+  */
+void SimHDF5FileReader::releaseDataset(const std::string& dname)
+{
+  if (prepared.count(dname) > 0){
+    closeReadState(prepared[dname].get());
+    prepared.erase(dname);
+  }
+}
+
+/** Close the handles and read engine of a prepared dataset.
+  * \param[in] state read state to close
+  */
+void SimHDF5FileReader::closeReadState(ReadState *state)
+{
+  state->engine.reset();
+  H5Tclose(state->ntype_id);
+  H5Tclose(state->type_id);
+  H5Sclose(state->dspace_id);
+  H5Dclose(state->dset_id);
+}
+
+/** Read a one dimensional dataset of numbers, such as frame timestamps.
+  * \param[in] path full path of the dataset in the file
+  * \param[out] values the values, converted to double
+  * \param[out] integer set if the values are integers, such as frame numbers
+  * \return false if the file is not loaded or the dataset cannot be read.
+  */
+bool SimHDF5FileReader::readColumn(const std::string& path, std::vector<double>& values, bool *integer)
+{
+  if (!fileLoaded){
+    return false;
+  }
+  return readColumnFromFile(this->file, path, values, integer);
+}
+
 /** Process an HDF5 object and store the datasets.
   * \param[in] loc_id Internal ID of the HDF5 object.
   * \param[in] name pointer to the name of the HF5 object.
@@ -501,8 +1117,12 @@ void SimHDF5FileReader::process(hid_t loc_id, const char *name, H5G_obj_t type)
   std::string oldname = cname;
   cname = cname + "/" + sname;
   if (type == H5G_DATASET){
-    if (getDatasetDimensions(cname).size() > 2){
-      datasets[cname] = std::tr1::shared_ptr<HDF5Dataset>(new HDF5Dataset(name, loc_id));
+    std::vector<hsize_t> dims = getDatasetDimensions(cname);
+    if (dims.size() > 2){
+      datasets[cname] = std::tr1::shared_ptr<HDF5Dataset>(new HDF5Dataset(name,
+                                                                          loc_id,
+                                                                          dims,
+                                                                          getDatasetType(cname)));
     }
   }
   if (type == H5G_GROUP){
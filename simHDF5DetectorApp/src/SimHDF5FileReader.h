@@ -15,6 +15,7 @@
 #include <tr1/memory>
 #include "NDArray.h"
 #include "SimHDF5Reader.h"
+#include "SimHDF5ChunkEngine.h"
 
 class SimHDF5FileReader : public SimHDF5Reader
 {
@@ -25,16 +26,26 @@ public:
   std::string getFilename();
   bool validateFilename();
   int fileExists();
-  void loadFile();
+  bool loadFile();
   void unloadFile();
 
   std::vector<std::string> getDatasetKeys();
-  std::vector<int> getDatasetDimensions(const std::string& dname);
+  std::vector<hsize_t> getDatasetDimensions(const std::string& dname);
+  std::vector<hsize_t> getChunkDimensions(const std::string& dname);
   NDDataType_t getDatasetType(const std::string& dname);
   void prepareToReadDataset(const std::string& dname);
-  void readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data);
-  void readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int *indexes, void *data);
+  bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data);
+  bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, void *data);
+  bool readColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes, void *data);
+  bool readFramesFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, int nframes, void *data);
   void cleanupDataset();
+  void releaseDataset(const std::string& dname);
+  void prefetchFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes);
+  void dropCache();
+  void setReadEngine(int engine, int queueDepth, bool directIO, int readahead);
+  int getReadEngine();
+  void setFileDriver(int driver);
+  bool readColumn(const std::string& path, std::vector<double>& values, bool *integer);
   void process(hid_t loc_id, const char *name, H5G_obj_t type);
 
 private:
@@ -42,25 +53,53 @@ private:
   std::string filename;
   std::string cname;
   bool fileLoaded;
-  hid_t dset_id;
-  hid_t dspace_id;
-  int ndims;
-  hsize_t *dims;
-  hid_t type_id;
-  hid_t ntype_id;
   bool reading;
   bool inMemory;
   void *rawPtr;
-  std::vector<int> memDims;
+  std::vector<hsize_t> memDims;
   NDDataType_t memDatatype;
+  int adviseFd;                    // Descriptor used for page cache hints
+  int engineType;                  // Requested read engine
+  int engineQueueDepth;            // Queue depth for the raw chunk engine
+  bool engineDirectIO;             // Use O_DIRECT in the raw chunk engine
+  int engineReadahead;             // Frames prefetched ahead, sizes the raw chunk engine cache
+  std::string lastPrepared;        // Dataset most recently prepared for reading
+  int fileDriver;                  // Virtual file driver used to open the file
+  void *fileImage;                 // Contents of the file when opened as a file image, owned by HDF5
+  size_t fileImageSize;            // Size of the file image in bytes
+  std::vector<char> blockBuffer;   // Block read in dataset order for a frame that is transposed
+
+  hid_t createFileAccess();
+  hid_t openFileImage();
+
+  /** Handles and layout of a dataset that has been prepared for reading */
+  struct ReadState
+  {
+    hid_t dset_id;
+    hid_t dspace_id;
+    int ndims;
+    std::vector<hsize_t> dims;
+    hid_t type_id;
+    hid_t ntype_id;
+    bool chunked;                    // Is the dataset chunked
+    std::vector<hsize_t> chunkDims;  // Chunk dimensions of the dataset
+    haddr_t dataOffset;              // File offset of a contiguous dataset
+    std::tr1::shared_ptr<SimHDF5ChunkEngine> engine; // Raw chunk engine, empty when H5Dread is used
+  };
+
+  ReadState *readState(const std::string& dname);
+  bool readBlock(ReadState *state, const hsize_t *offset, const hsize_t *count, int wdim, int hdim, void *data);
+  void closeReadState(ReadState *state);
 
   class HDF5Dataset
   {
   public:
-    HDF5Dataset(const std::string& name, hid_t id)
+    HDF5Dataset(const std::string& name, hid_t id, std::vector<hsize_t> dimensions, NDDataType_t datatype)
     {
       this->name = name;
       this->id = id;
+      this->dimensions = dimensions;
+      this->datatype = datatype;
     };
 
     hid_t getID()
@@ -68,14 +107,27 @@ private:
       return this->id;
     }
 
+    std::vector<hsize_t> getDimensions()
+    {
+      return this->dimensions;
+    }
+
+    NDDataType_t getDataType()
+    {
+      return this->datatype;
+    }
+
     virtual ~HDF5Dataset(){};
 
   private:
     std::string name;
     hid_t id;
+    std::vector<hsize_t> dimensions;
+    NDDataType_t datatype;
   };
 
   std::map<std::string, std::tr1::shared_ptr<HDF5Dataset> > datasets;
+  std::map<std::string, std::tr1::shared_ptr<ReadState> > prepared; // Datasets prepared for reading
 
 };
 
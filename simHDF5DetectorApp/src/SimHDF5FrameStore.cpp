@@ -0,0 +1,777 @@
+/*
+ * SimHDF5FrameStore.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "SimHDF5FrameStore.h"
+#include <epicsExit.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <set>
+
+// Identifies a shared memory segment created by this driver
+#define SIMHDF5_STORE_MAGIC       "SIMHDF5"
+#define SIMHDF5_STORE_VERSION     3
+
+// The frame data starts on the page following the header
+#define SIMHDF5_STORE_HEADER_SIZE 4096
+
+// Number of times to retry attaching while another IOC creates the segment
+#define SIMHDF5_STORE_RETRIES     500
+
+/** States of a shared memory segment */
+typedef enum
+{
+  SimHDF5StoreLoading = 1,   // Being filled by the process named in the header
+  SimHDF5StoreReady,         // Filled and available to attach to
+  SimHDF5StoreRemoved,       // Unlinked by the last IOC to detach, or found abandoned
+  SimHDF5StoreFailed         // The load was abandoned, the next IOC to create the store loads it
+} SimHDF5StoreState_t;
+
+/** Header at the start of a shared memory segment.
+  *
+  * The header is only read and written with pread/pwrite while holding a
+  * record lock on it, so that IOCs that map the data read only can still
+  * update it.  The lock is only held for each access, the loading IOC
+  * publishes its progress in the header as it goes.  Attached IOCs are
+  * counted by the kernel rather than in the header: each holds a shared
+  * flock on the segment for as long as it is attached.
+  */
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t state;
+  uint32_t reserved[2];
+  uint64_t device;
+  uint64_t inode;
+  uint64_t fileSize;
+  int64_t mtimeSec;
+  int64_t mtimeNsec;
+  uint64_t bytes;
+  uint64_t resident;        // Bytes from the start of the data that have been loaded
+  int64_t loaderPid;        // Process filling the segment while it is loading
+  char dataset[256];
+} SimHDF5StoreHeader;
+
+// Shared stores still attached, released when the IOC exits
+static epicsThreadOnceId storesOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId storesMutex = 0;
+static std::set<SimHDF5FrameStore *> sharedStores;
+
+/** Release every shared store still attached when the IOC exits.
+  *
+  * The driver is never destroyed, so without this the last IOC to exit
+  * would leave its segments in /dev/shm.  The mappings are kept, as other
+  * threads may still be reading frames while the IOC shuts down.
+  */
+static void releaseStores(void *arg)
+{
+  epicsMutexLock(storesMutex);
+  for (std::set<SimHDF5FrameStore *>::iterator iter = sharedStores.begin(); iter != sharedStores.end(); ++iter){
+    (*iter)->release();
+  }
+  sharedStores.clear();
+  epicsMutexUnlock(storesMutex);
+}
+
+/** Create the registry of shared stores, run once. */
+static void createStores(void *arg)
+{
+  storesMutex = epicsMutexMustCreate();
+  epicsAtExit(releaseStores, NULL);
+}
+
+/** Lock the header of a shared memory segment.
+  * \param[in] fd descriptor of the segment
+  * \param[in] exclusive take a write lock rather than a read lock
+  *
+  * Open file description locks are used so that they neither conflict with
+  * the flock that marks an IOC as attached nor with the locks of other
+  * stores in the same process.
+  */
+static void lockHeader(int fd, bool exclusive)
+{
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = exclusive ? F_WRLCK : F_RDLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = sizeof(SimHDF5StoreHeader);
+  while (fcntl(fd, F_OFD_SETLKW, &lock) != 0 && errno == EINTR){
+  }
+}
+
+/** Unlock the header of a shared memory segment.
+  * \param[in] fd descriptor of the segment
+  */
+static void unlockHeader(int fd)
+{
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_UNLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = sizeof(SimHDF5StoreHeader);
+  fcntl(fd, F_OFD_SETLK, &lock);
+}
+
+/** 64 bit FNV-1a hash used to name shared memory segments.
+  * \param[in] text string to hash
+  */
+static uint64_t storeHash(const std::string& text)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t index = 0; index < text.size(); index++){
+    hash ^= (unsigned char)text[index];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/** Check whether the process loading a segment is still running.
+  * \param[in] pid process ID recorded in the segment header
+  */
+static bool loaderAlive(int64_t pid)
+{
+  return pid > 0 && (kill((pid_t)pid, 0) == 0 || errno != ESRCH);
+}
+
+/** Fill in a header describing the source of a store.
+  * \param[in] filename full path of the source file
+  * \param[in] dname path of the dataset within the file
+  * \param[in] bytes number of bytes of frame data
+  * \param[out] header header to fill in
+  * \return false if the source file could not be found.
+  */
+static bool describe(const std::string& filename, const std::string& dname, size_t bytes, SimHDF5StoreHeader *header)
+{
+  struct stat info;
+  if (stat(filename.c_str(), &info) != 0){
+    return false;
+  }
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, SIMHDF5_STORE_MAGIC, sizeof(SIMHDF5_STORE_MAGIC));
+  header->version = SIMHDF5_STORE_VERSION;
+  header->device = info.st_dev;
+  header->inode = info.st_ino;
+  header->fileSize = info.st_size;
+  header->mtimeSec = info.st_mtim.tv_sec;
+  header->mtimeNsec = info.st_mtim.tv_nsec;
+  header->bytes = bytes;
+  strncpy(header->dataset, dname.c_str(), sizeof(header->dataset)-1);
+  return true;
+}
+
+/** Check whether two headers describe the same source data.
+  *
+  */
+static bool sameIdentity(const SimHDF5StoreHeader *a, const SimHDF5StoreHeader *b)
+{
+  return memcmp(a->magic, b->magic, sizeof(a->magic)) == 0 && a->version == b->version &&
+         a->device == b->device && a->inode == b->inode && a->fileSize == b->fileSize &&
+         a->mtimeSec == b->mtimeSec && a->mtimeNsec == b->mtimeNsec &&
+         a->bytes == b->bytes && strcmp(a->dataset, b->dataset) == 0;
+}
+
+/** Create a frame store.
+  * \param[in] filename full path of the source file, used to identify a shared store
+  * \param[in] dname path of the dataset within the file
+  * \param[in] bytes number of bytes of frame data
+  * \param[in] shared place the store in shared memory
+  * \return the store, or an empty pointer if no memory could be allocated.
+  *
+  * If a shared store cannot be created or attached to a private one is
+  * returned instead.  Check needsLoad() to find out whether the caller must
+  * fill the store and then call loaded().
+  */
+std::tr1::shared_ptr<SimHDF5FrameStore> SimHDF5FrameStore::create(const std::string& filename, const std::string& dname, size_t bytes, bool shared)
+{
+  std::tr1::shared_ptr<SimHDF5FrameStore> store(new SimHDF5FrameStore());
+  if (shared){
+    if (store->createShared(filename, dname, bytes)){
+      epicsThreadOnce(&storesOnce, createStores, NULL);
+      epicsMutexLock(storesMutex);
+      sharedStores.insert(store.get());
+      epicsMutexUnlock(storesMutex);
+      return store;
+    }
+    printf("Unable to share the frame store for %s, using private memory\n", dname.c_str());
+  }
+  if (!store->createPrivate(bytes)){
+    printf("Unable to allocate %lu bytes for the frame store\n", (unsigned long)bytes);
+    store.reset();
+  }
+  return store;
+}
+
+/** Map a snapshot of a previously loaded store.
+  * \param[in] path full path of the snapshot file
+  * \param[in] filename full path of the source file
+  * \param[in] dname path of the dataset within the file
+  * \param[in] bytes number of bytes of frame data
+  * \return the store, or an empty pointer if there is no snapshot of the
+  * current source file.
+  *
+  * The snapshot is mapped read only and shared, so the page cache holds a
+  * single copy for all IOCs on the host that use the same snapshot.
+  */
+std::tr1::shared_ptr<SimHDF5FrameStore> SimHDF5FrameStore::openSnapshot(const std::string& path, const std::string& filename, const std::string& dname, size_t bytes)
+{
+  std::tr1::shared_ptr<SimHDF5FrameStore> store;
+  SimHDF5StoreHeader wanted;
+  SimHDF5StoreHeader header;
+  struct stat info;
+  if (!describe(filename, dname, bytes, &wanted)){
+    return store;
+  }
+  int sfd = open(path.c_str(), O_RDONLY);
+  if (sfd < 0){
+    return store;
+  }
+  size_t mapSize = SIMHDF5_STORE_HEADER_SIZE + bytes;
+  if (pread(sfd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      header.state != SimHDF5StoreReady || !sameIdentity(&header, &wanted) ||
+      fstat(sfd, &info) != 0 || (size_t)info.st_size < mapSize){
+    printf("Snapshot %s does not match the source file\n", path.c_str());
+    close(sfd);
+    return store;
+  }
+  void *map = mmap(0, mapSize, PROT_READ, MAP_SHARED, sfd, 0);
+  close(sfd);
+  if (map == MAP_FAILED){
+    return store;
+  }
+  store = std::tr1::shared_ptr<SimHDF5FrameStore>(new SimHDF5FrameStore());
+  store->map = map;
+  store->mapSize = mapSize;
+  store->base = (char *)map + SIMHDF5_STORE_HEADER_SIZE;
+  store->bytes = bytes;
+  store->complete = true;
+  return store;
+}
+
+/** Name of the snapshot file for a dataset.
+  * \param[in] filename full path of the source file
+  * \param[in] dname path of the dataset within the file
+  *
+  * The name only depends on the paths so that a snapshot of an older
+  * version of the file is replaced rather than left behind.
+  */
+std::string SimHDF5FrameStore::snapshotName(const std::string& filename, const std::string& dname)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "simhdf5-%016llx.snap", (unsigned long long)storeHash(filename + ":" + dname));
+  return name;
+}
+
+/** Constructor.
+  *
+  */
+SimHDF5FrameStore::SimHDF5FrameStore() :
+  name(""),
+  fd(-1),
+  map(0),
+  mapSize(0),
+  base(0),
+  bytes(0),
+  loader(false),
+  complete(false),
+  locked(false)
+{
+}
+
+/** Destructor.
+  *
+  * Detaches from a shared store, removing it if no other IOC is attached.
+  */
+SimHDF5FrameStore::~SimHDF5FrameStore()
+{
+  if (fd >= 0){
+    epicsMutexLock(storesMutex);
+    sharedStores.erase(this);
+    release();
+    epicsMutexUnlock(storesMutex);
+  }
+  detach();
+}
+
+/** Pointer to the first byte of frame data.
+  *
+  * The data is only writable while needsLoad() is true.
+  */
+char *SimHDF5FrameStore::data()
+{
+  return base;
+}
+
+/** Number of bytes of frame data.
+  *
+  */
+size_t SimHDF5FrameStore::size()
+{
+  return bytes;
+}
+
+/** Must the caller fill the store before reading from it.
+  *
+  */
+bool SimHDF5FrameStore::needsLoad()
+{
+  return loader && !complete;
+}
+
+/** Is the store held in shared memory.
+  *
+  */
+bool SimHDF5FrameStore::isShared()
+{
+  return fd >= 0;
+}
+
+/** Is the store mapped from a snapshot file.
+  *
+  */
+bool SimHDF5FrameStore::isSnapshot()
+{
+  return fd < 0 && map != 0;
+}
+
+/** Mark the store as filled.
+  *
+  * A shared store is made read only and published to other IOCs as ready.
+  */
+void SimHDF5FrameStore::loaded()
+{
+  if (!needsLoad()){
+    return;
+  }
+  if (fd >= 0){
+    SimHDF5StoreHeader header;
+    lockHeader(fd, true);
+    if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)){
+      header.state = SimHDF5StoreReady;
+      header.resident = bytes;
+      pwrite(fd, &header, sizeof(header), 0);
+    }
+    unlockHeader(fd);
+    mprotect(map, mapSize, PROT_READ);
+  }
+  complete = true;
+}
+
+/** Give up filling the store.
+  *
+  * Another IOC attached to a shared store stops waiting for it, and the
+  * next IOC to create the store loads it again.  The data already loaded
+  * stays mapped but the store is never complete.
+  */
+void SimHDF5FrameStore::failed()
+{
+  if (!needsLoad()){
+    return;
+  }
+  if (fd >= 0){
+    SimHDF5StoreHeader header;
+    lockHeader(fd, true);
+    if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)){
+      header.state = SimHDF5StoreFailed;
+      pwrite(fd, &header, sizeof(header), 0);
+    }
+    unlockHeader(fd);
+  }
+  loader = false;
+}
+
+/** Publish how much of a shared store has been filled.
+  * \param[in] resident number of bytes from the start of the data that have been loaded
+  *
+  * Only the IOC filling the store publishes its progress.
+  */
+void SimHDF5FrameStore::publishProgress(size_t resident)
+{
+  if (!needsLoad() || fd < 0){
+    return;
+  }
+  SimHDF5StoreHeader header;
+  lockHeader(fd, true);
+  if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)){
+    header.resident = resident;
+    pwrite(fd, &header, sizeof(header), 0);
+  }
+  unlockHeader(fd);
+}
+
+/** Is the store a shared store being filled by another IOC.
+  *
+  */
+bool SimHDF5FrameStore::isFollowing()
+{
+  return fd >= 0 && !loader && !complete;
+}
+
+/** Follow the load of a shared store by another IOC.
+  * \param[out] failed set if the loading IOC gave up or exited
+  * \return number of bytes from the start of the data that have been loaded.
+  *
+  * Returns the whole size once the store is complete.
+  */
+size_t SimHDF5FrameStore::progress(bool *failed)
+{
+  *failed = false;
+  if (complete){
+    return bytes;
+  }
+  if (!isFollowing()){
+    return 0;
+  }
+  SimHDF5StoreHeader header;
+  size_t resident = 0;
+  lockHeader(fd, false);
+  if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)){
+    *failed = true;
+  } else if (header.state == SimHDF5StoreReady){
+    complete = true;
+    resident = bytes;
+  } else if (header.state == SimHDF5StoreLoading && loaderAlive(header.loaderPid)){
+    resident = header.resident;
+  } else {
+    *failed = true;
+  }
+  unlockHeader(fd);
+  return resident;
+}
+
+/** Write the store to a snapshot file.
+  * \param[in] path full path of the snapshot file
+  * \param[in] filename full path of the source file
+  * \param[in] dname path of the dataset within the file
+  * \return false if the snapshot could not be written.
+  *
+  * The snapshot is written to a temporary file which is renamed into place
+  * once complete, so a partly written snapshot is never mapped.
+  */
+bool SimHDF5FrameStore::writeSnapshot(const std::string& path, const std::string& filename, const std::string& dname)
+{
+  SimHDF5StoreHeader header;
+  if (!complete || !describe(filename, dname, bytes, &header)){
+    return false;
+  }
+  header.state = SimHDF5StoreReady;
+  char page[SIMHDF5_STORE_HEADER_SIZE];
+  memset(page, 0, sizeof(page));
+  memcpy(page, &header, sizeof(header));
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+  std::string temp = path + suffix;
+  int sfd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (sfd < 0){
+    printf("Unable to create snapshot %s\n", temp.c_str());
+    return false;
+  }
+  bool ok = (write(sfd, page, sizeof(page)) == (ssize_t)sizeof(page));
+  size_t done = 0;
+  while (ok && done < bytes){
+    size_t block = bytes - done;
+    if (block > 64*1024*1024){
+      block = 64*1024*1024;
+    }
+    ssize_t result = write(sfd, base + done, block);
+    if (result < 0 && errno == EINTR){
+      continue;
+    }
+    if (result <= 0){
+      ok = false;
+      break;
+    }
+    done += result;
+  }
+  if (ok){
+    ok = (fdatasync(sfd) == 0);
+  }
+  close(sfd);
+  if (!ok || rename(temp.c_str(), path.c_str()) != 0){
+    printf("Unable to write snapshot %s\n", path.c_str());
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+/** Create or attach to a shared memory segment.
+  * \param[in] filename full path of the source file
+  * \param[in] dname path of the dataset within the file
+  * \param[in] bytes number of bytes of frame data
+  * \return false if a private store should be used instead.
+  */
+bool SimHDF5FrameStore::createShared(const std::string& filename, const std::string& dname, size_t bytes)
+{
+  // Describe the segment we want, a changed source file gives a new name
+  SimHDF5StoreHeader wanted;
+  if (!describe(filename, dname, bytes, &wanted)){
+    return false;
+  }
+
+  char identity[512];
+  snprintf(identity, sizeof(identity), "%llu:%llu:%llu:%lld.%09lld:%lu:%s",
+           (unsigned long long)wanted.device, (unsigned long long)wanted.inode,
+           (unsigned long long)wanted.fileSize, (long long)wanted.mtimeSec,
+           (long long)wanted.mtimeNsec, (unsigned long)bytes, dname.c_str());
+  char segment[64];
+  snprintf(segment, sizeof(segment), "/simhdf5-%016llx", (unsigned long long)storeHash(identity));
+  name = segment;
+  mapSize = SIMHDF5_STORE_HEADER_SIZE + bytes;
+
+  for (int attempt = 0; attempt < SIMHDF5_STORE_RETRIES; attempt++){
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0){
+      // We created the segment, mark ourselves attached and hold the header
+      // lock until the header is written
+      flock(fd, LOCK_SH);
+      lockHeader(fd, true);
+      if (ftruncate(fd, mapSize) != 0 || posix_fallocate(fd, 0, mapSize) != 0){
+        printf("Unable to reserve %lu bytes of shared memory\n", (unsigned long)mapSize);
+        shm_unlink(name.c_str());
+        close(fd);
+        fd = -1;
+        return false;
+      }
+      wanted.state = SimHDF5StoreLoading;
+      wanted.loaderPid = getpid();
+      pwrite(fd, &wanted, sizeof(wanted), 0);
+      unlockHeader(fd);
+      map = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (map == MAP_FAILED){
+        map = 0;
+        shm_unlink(name.c_str());
+        close(fd);
+        fd = -1;
+        return false;
+      }
+      base = (char *)map + SIMHDF5_STORE_HEADER_SIZE;
+      this->bytes = bytes;
+      loader = true;
+      return true;
+    }
+    if (errno != EEXIST){
+      return false;
+    }
+
+    fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0){
+      if (errno == ENOENT){
+        // Removed since we looked, try to create it again
+        continue;
+      }
+      return false;
+    }
+    // Mark ourselves attached, which only blocks while another IOC is
+    // removing the segment, then hold the header while it is checked
+    flock(fd, LOCK_SH);
+    lockHeader(fd, true);
+    SimHDF5StoreHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, SIMHDF5_STORE_MAGIC, sizeof(SIMHDF5_STORE_MAGIC)) != 0){
+      // The creator has not written the header yet
+      unlockHeader(fd);
+      close(fd);
+      fd = -1;
+      usleep(10000);
+      continue;
+    }
+    if (header.state == SimHDF5StoreRemoved){
+      unlockHeader(fd);
+      close(fd);
+      fd = -1;
+      continue;
+    }
+    if (!sameIdentity(&header, &wanted)){
+      if (flock(fd, LOCK_EX | LOCK_NB) == 0){
+        // No IOC is attached, so the segment was left behind by an IOC that
+        // crashed or was of another version.  Remove it and start again.
+        header.state = SimHDF5StoreRemoved;
+        pwrite(fd, &header, sizeof(header), 0);
+        shm_unlink(name.c_str());
+        unlockHeader(fd);
+        close(fd);
+        fd = -1;
+        continue;
+      }
+      // Name collision with a different dataset
+      unlockHeader(fd);
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    this->bytes = bytes;
+    bool abandoned = (header.state == SimHDF5StoreLoading && !loaderAlive(header.loaderPid));
+    if (abandoned || header.state == SimHDF5StoreFailed){
+      // The load was given up, or the IOC loading the segment exited
+      // without finishing, so load the segment ourselves
+      map = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (map == MAP_FAILED){
+        map = 0;
+        unlockHeader(fd);
+        close(fd);
+        fd = -1;
+        return false;
+      }
+      header.state = SimHDF5StoreLoading;
+      header.resident = 0;
+      header.loaderPid = getpid();
+      pwrite(fd, &header, sizeof(header), 0);
+      unlockHeader(fd);
+      base = (char *)map + SIMHDF5_STORE_HEADER_SIZE;
+      loader = true;
+      return true;
+    }
+    map = mmap(0, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED){
+      map = 0;
+      unlockHeader(fd);
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    unlockHeader(fd);
+    base = (char *)map + SIMHDF5_STORE_HEADER_SIZE;
+    loader = false;
+    // A store still being loaded is followed with progress()
+    complete = (header.state == SimHDF5StoreReady);
+    return true;
+  }
+  return false;
+}
+
+/** Allocate a private store.
+  * \param[in] bytes number of bytes of frame data
+  */
+bool SimHDF5FrameStore::createPrivate(size_t bytes)
+{
+  base = (char *)malloc(bytes > 0 ? bytes : 1);
+  if (!base){
+    return false;
+  }
+  this->bytes = bytes;
+  loader = true;
+  complete = false;
+  return true;
+}
+
+/** Lock the frame data into memory.
+  * \return 0 on success, otherwise the error number from mlock.
+  *
+  * Locking faults in every page.  If the lock fails, usually because
+  * RLIMIT_MEMLOCK is too small, the pages are still faulted in so that at
+  * least the first reads do not stall, but they may later be reclaimed.
+  */
+int SimHDF5FrameStore::lockPages()
+{
+  if (locked || bytes == 0){
+    return 0;
+  }
+  if (mlock(base, bytes) != 0){
+    int error = errno;
+    prefault();
+    return error;
+  }
+  locked = true;
+  return 0;
+}
+
+/** Allow the frame data to be swapped out or reclaimed again.
+  *
+  */
+void SimHDF5FrameStore::unlockPages()
+{
+  if (locked){
+    munlock(base, bytes);
+    locked = false;
+  }
+}
+
+/** Number of bytes locked into memory.
+  *
+  */
+size_t SimHDF5FrameStore::lockedBytes()
+{
+  return locked ? bytes : 0;
+}
+
+/** Fault in every page of the frame data.
+  *
+  * Pages are read rather than written, so that read only mappings of shared
+  * stores and snapshots can be faulted in too.
+  */
+void SimHDF5FrameStore::prefault()
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t offset = (size_t)base % page;
+  madvise(base - offset, bytes + offset, MADV_WILLNEED);
+  volatile char sum = 0;
+  for (size_t pos = 0; pos < bytes; pos += page){
+    sum += ((volatile char *)base)[pos];
+  }
+  if (bytes > 0){
+    sum += ((volatile char *)base)[bytes-1];
+  }
+}
+
+/** Detach from a shared store, removing the segment if no other IOC is attached.
+  *
+  * Called with the registry of shared stores locked, when the store is
+  * destroyed or the IOC exits.  The mapping is kept until the store is
+  * destroyed.  Closing the segment drops the shared flock that marks this
+  * IOC as attached, which the kernel also drops if the IOC crashes.
+  */
+void SimHDF5FrameStore::release()
+{
+  if (fd < 0){
+    return;
+  }
+  lockHeader(fd, true);
+  SimHDF5StoreHeader header;
+  if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)){
+    if (needsLoad() && header.state == SimHDF5StoreLoading){
+      // Let the next IOC to create the store finish the load
+      header.state = SimHDF5StoreFailed;
+    }
+    // The exclusive lock is only granted once no other IOC is attached
+    if (header.state != SimHDF5StoreRemoved && flock(fd, LOCK_EX | LOCK_NB) == 0){
+      header.state = SimHDF5StoreRemoved;
+      shm_unlink(name.c_str());
+    }
+    pwrite(fd, &header, sizeof(header), 0);
+  }
+  unlockHeader(fd);
+  close(fd);
+  fd = -1;
+}
+
+/** Release the memory of the store.
+  *
+  */
+void SimHDF5FrameStore::detach()
+{
+  unlockPages();
+  if (map){
+    munmap(map, mapSize);
+  } else {
+    free(base);
+  }
+  map = 0;
+  base = 0;
+}
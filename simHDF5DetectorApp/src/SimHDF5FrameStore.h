@@ -0,0 +1,80 @@
+/*
+ * SimHDF5FrameStore.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5FRAMESTORE_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5FRAMESTORE_H_
+
+#include <stddef.h>
+#include <string>
+#include <tr1/memory>
+
+/** Block of memory holding every decoded frame of a dataset.
+  *
+  * A private store is allocated on the heap.  A shared store lives in a
+  * POSIX shared memory segment named after the identity of the source file
+  * (device, inode, size and modification time) and the dataset path, so
+  * that several IOCs on one host replaying the same dataset hold a single
+  * copy.  The first IOC to create the segment loads it, other IOCs map the
+  * segment read only at once and follow the progress of the load published
+  * in the segment header.  Each attached IOC holds a shared flock on the
+  * segment, and the segment is removed by the IOC that detaches when no
+  * other holds one.  Stores are detached when the IOC exits, and the kernel
+  * drops the lock of an IOC that crashes.  A segment left behind by a crash
+  * of the last IOC is reused, or removed if it no longer matches, by the
+  * next IOC to open it.
+  *
+  * A loaded store can also be written to a snapshot file together with the
+  * identity of the source file.  A later load maps the snapshot read only
+  * instead of reading the dataset again, as long as the source file has not
+  * changed.
+  *
+  * A loaded store can be locked into memory so that its pages are never
+  * swapped out or reclaimed, and is faulted in when locked so that the
+  * first read of each frame does not stall.
+  */
+class SimHDF5FrameStore
+{
+public:
+  static std::tr1::shared_ptr<SimHDF5FrameStore> create(const std::string& filename, const std::string& dname, size_t bytes, bool shared);
+  static std::tr1::shared_ptr<SimHDF5FrameStore> openSnapshot(const std::string& path, const std::string& filename, const std::string& dname, size_t bytes);
+  static std::string snapshotName(const std::string& filename, const std::string& dname);
+  virtual ~SimHDF5FrameStore();
+
+  char *data();
+  size_t size();
+  bool needsLoad();
+  bool isShared();
+  bool isSnapshot();
+  void loaded();
+  void failed();
+  void publishProgress(size_t resident);
+  bool isFollowing();
+  size_t progress(bool *failed);
+  int lockPages();
+  void unlockPages();
+  size_t lockedBytes();
+  void prefault();
+  bool writeSnapshot(const std::string& path, const std::string& filename, const std::string& dname);
+  void release();
+
+private:
+  SimHDF5FrameStore();
+  bool createShared(const std::string& filename, const std::string& dname, size_t bytes);
+  bool createPrivate(size_t bytes);
+  void detach();
+
+  std::string name;   // Name of the shared memory segment
+  int fd;             // Descriptor of the shared memory segment, -1 for a private store or snapshot
+  void *map;          // Mapping of the whole segment or snapshot including the header
+  size_t mapSize;     // Size of the mapping
+  char *base;         // First byte of frame data
+  size_t bytes;       // Number of bytes of frame data
+  bool loader;        // This store is responsible for filling the data
+  bool complete;      // The data has been filled
+  bool locked;        // The data is locked into memory
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5FRAMESTORE_H_ */
@@ -0,0 +1,348 @@
+/*
+ * SimHDF5Geometry.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "SimHDF5Geometry.h"
+#include "SimHDF5Placement.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Fewest output lines worth sharing between threads
+#define SIMHDF5_GEOMETRY_MIN_LINES 64
+
+/** C function called by newly created worker threads.
+  * \param[in] drvPvt pointer to the worker structure.
+  */
+static void SimHDF5GeometryTaskC(void *drvPvt)
+{
+  SimHDF5Geometry::Worker *worker = (SimHDF5Geometry::Worker *)drvPvt;
+  worker->owner->workerTask(worker);
+}
+
+/** Look up elements of a row through a column table.
+  * \param[in] src pointer to the source row
+  * \param[in] map source column of each output element
+  * \param[out] dst pointer to the output row
+  * \param[in] n number of output elements
+  *
+  * The loop is free of aliasing so that the compiler can use vector gathers.
+  */
+template <typename T>
+static void gather(const T * __restrict__ src, const int * __restrict__ map, T * __restrict__ dst, size_t n)
+{
+  for (size_t i = 0; i < n; i++){
+    dst[i] = src[map[i]];
+  }
+}
+
+/** Return the source position of an output position.
+  * \param[in] mode one of the SimHDF5GeometryMode_t values
+  * \param[in] pos position in the synthetic frame
+  * \param[in] srcSize size of the source frame
+  * \param[in] outSize size of the synthetic frame
+  */
+static int sourcePosition(int mode, int pos, int srcSize, int outSize)
+{
+  switch (mode){
+    case SimHDF5GeometryMirror:
+      pos = pos % (2 * srcSize);
+      return pos < srcSize ? pos : 2 * srcSize - 1 - pos;
+    case SimHDF5GeometryUpscale:
+      return (int)(((int64_t)pos * srcSize) / outSize);
+    default:
+      return pos % srcSize;
+  }
+}
+
+/** Constructor.
+  *
+  * No worker threads are created until setThreads is called.
+  */
+SimHDF5Geometry::SimHDF5Geometry() :
+  exiting(false),
+  priority(0),
+  placementError(0),
+  src(0),
+  dst(0),
+  srcWidth(0),
+  srcHeight(0),
+  width(0),
+  height(0),
+  elementSize(0),
+  rowsPerLine(1),
+  lines(0),
+  period(0)
+{
+}
+
+/** Destructor.
+  *
+  * Stops all worker threads.
+  */
+SimHDF5Geometry::~SimHDF5Geometry()
+{
+  stopWorkers();
+}
+
+/** Select the number of threads used to expand frames.
+  * \param[in] threads total number of threads including the calling thread
+  *
+  * Workers are created with the priority of the calling thread and the
+  * default stack size of the acquisition task, which they run alongside.
+  * Each worker is waited for until it has placed itself, and the first
+  * error is kept for getPlacementError.
+  */
+void SimHDF5Geometry::setThreads(int threads)
+{
+  if (threads < 1){
+    threads = 1;
+  }
+  if (threads == getThreads()){
+    return;
+  }
+  stopWorkers();
+  placementError = 0;
+  for (int index = 1; index < threads; index++){
+    Worker *worker = new Worker();
+    worker->owner = this;
+    worker->index = index;
+    worker->placementError = 0;
+    worker->startEvent = epicsEventCreate(epicsEventEmpty);
+    worker->doneEvent = epicsEventCreate(epicsEventEmpty);
+    if (epicsThreadCreate("SimHDF5Geometry",
+                          epicsThreadGetPrioritySelf(),
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)SimHDF5GeometryTaskC,
+                          worker) == NULL){
+      printf("SimHDF5Geometry: epicsThreadCreate failure, using %d threads\n", index);
+      epicsEventDestroy(worker->startEvent);
+      epicsEventDestroy(worker->doneEvent);
+      delete worker;
+      break;
+    }
+    // The worker signals once it has placed itself
+    epicsEventWait(worker->doneEvent);
+    if (worker->placementError != 0 && placementError == 0){
+      placementError = worker->placementError;
+    }
+    workers.push_back(worker);
+  }
+}
+
+/** Select the CPUs and priority of the worker threads.
+  * \param[in] cpus the CPU list, empty for any CPU
+  * \param[in] priority SCHED_FIFO priority, or 0 for normal scheduling
+  *
+  * Running workers are stopped if the placement changes, and the next call
+  * to setThreads starts them again with the new placement.
+  */
+void SimHDF5Geometry::setPlacement(const std::string& cpus, int priority)
+{
+  if (cpus != this->cpus || priority != this->priority){
+    stopWorkers();
+    this->cpus = cpus;
+    this->priority = priority;
+    this->placementError = 0;
+  }
+}
+
+/** Return the number of threads used to expand frames, including the calling thread.
+  */
+int SimHDF5Geometry::getThreads()
+{
+  return (int)workers.size() + 1;
+}
+
+/** Return the error number from placing the workers last started, 0 if they were all placed.
+  */
+int SimHDF5Geometry::getPlacementError()
+{
+  return placementError;
+}
+
+/** Stop and destroy all worker threads.
+  */
+void SimHDF5Geometry::stopWorkers()
+{
+  exiting = true;
+  for (size_t index = 0; index < workers.size(); index++){
+    epicsEventSignal(workers[index]->startEvent);
+    epicsEventWait(workers[index]->doneEvent);
+    epicsEventDestroy(workers[index]->startEvent);
+    epicsEventDestroy(workers[index]->doneEvent);
+    delete workers[index];
+  }
+  workers.clear();
+  exiting = false;
+}
+
+/** Main loop of a worker thread.
+  * \param[in] worker the worker run by this thread.
+  *
+  * Places itself on the worker CPUs and signals the result, then waits to
+  * be woken, expands its share of the output lines and signals that it has
+  * finished.  Exits when woken while the geometry is stopping.
+  */
+void SimHDF5Geometry::workerTask(Worker *worker)
+{
+  worker->placementError = SimHDF5Placement::applyToThread(cpus, priority > 0 ? priority : -1);
+  epicsEventSignal(worker->doneEvent);
+  while (1){
+    epicsEventWait(worker->startEvent);
+    if (exiting){
+      epicsEventSignal(worker->doneEvent);
+      return;
+    }
+    expandLines(worker->index);
+    epicsEventSignal(worker->doneEvent);
+  }
+}
+
+/** Expand a region of a synthetic frame from a source frame.
+  * \param[in] mode one of the SimHDF5GeometryMode_t values
+  * \param[in] src pointer to the source frames
+  * \param[in] srcWidth width of a source frame in elements
+  * \param[in] srcHeight height of a source frame in lines
+  * \param[out] dst pointer to the output frames
+  * \param[in] minX first column of the synthetic frame to output
+  * \param[in] minY first line of the synthetic frame to output
+  * \param[in] width number of columns to output
+  * \param[in] height number of lines to output
+  * \param[in] outWidth width of the synthetic frame
+  * \param[in] outHeight height of the synthetic frame
+  * \param[in] elementSize size of one element in bytes
+  * \param[in] rowsPerLine number of rows stored for each line
+  * \param[in] nframes number of consecutive frames to expand
+  *
+  * Pixel interleaved colour is expanded by treating each pixel as a single
+  * element, row interleaved colour by storing three rows for each line and
+  * planar colour as three frames.
+  */
+void SimHDF5Geometry::expand(int mode, const void *src, int srcWidth, int srcHeight,
+                             void *dst, int minX, int minY, int width, int height,
+                             int outWidth, int outHeight, size_t elementSize, int rowsPerLine, int nframes)
+{
+  this->src = (const char *)src;
+  this->dst = (char *)dst;
+  this->srcWidth = srcWidth;
+  this->srcHeight = srcHeight;
+  this->width = width;
+  this->height = height;
+  this->elementSize = elementSize;
+  this->rowsPerLine = rowsPerLine;
+  this->lines = height * nframes;
+
+  // Build the tables of source columns and lines
+  colMap.resize(width);
+  for (int x = 0; x < width; x++){
+    colMap[x] = sourcePosition(mode, minX + x, srcWidth, outWidth);
+  }
+  rowMap.resize(height);
+  for (int y = 0; y < height; y++){
+    rowMap[y] = sourcePosition(mode, minY + y, srcHeight, outHeight);
+  }
+  // Tiled rows repeat, so only the first period needs to be looked up
+  period = 0;
+  if (mode == SimHDF5GeometryTile){
+    period = srcWidth;
+  } else if (mode == SimHDF5GeometryMirror){
+    period = 2 * srcWidth;
+  }
+
+  // Share the lines between the workers and this thread
+  int active = 0;
+  if (lines >= SIMHDF5_GEOMETRY_MIN_LINES){
+    active = (int)workers.size();
+  }
+  for (int index = 0; index < active; index++){
+    epicsEventSignal(workers[index]->startEvent);
+  }
+  expandLines(0);
+  for (int index = 0; index < active; index++){
+    epicsEventWait(workers[index]->doneEvent);
+  }
+}
+
+/** Expand the share of output lines belonging to one thread.
+  * \param[in] index index of the thread, 0 for the calling thread.
+  */
+void SimHDF5Geometry::expandLines(int index)
+{
+  int threads = (lines >= SIMHDF5_GEOMETRY_MIN_LINES) ? getThreads() : 1;
+  int share = (lines + threads - 1) / threads;
+  int first = index * share;
+  int last = first + share;
+  if (last > lines){
+    last = lines;
+  }
+  size_t srcRowBytes = (size_t)srcWidth * elementSize;
+  size_t rowBytes = (size_t)width * elementSize;
+  size_t lineBytes = rowBytes * rowsPerLine;
+  size_t srcFrameBytes = srcRowBytes * rowsPerLine * srcHeight;
+
+  // Output line already built from each source line of the current frame
+  std::vector<int> built(srcHeight, -1);
+  int frame = -1;
+  for (int line = first; line < last; line++){
+    if (line / height != frame){
+      frame = line / height;
+      built.assign(srcHeight, -1);
+    }
+    int srcLine = rowMap[line % height];
+    char *out = dst + (size_t)line * lineBytes;
+    if (built[srcLine] >= 0){
+      // This source line has been built already, copy it
+      memcpy(out, dst + (size_t)built[srcLine] * lineBytes, lineBytes);
+    } else {
+      const char *in = src + frame * srcFrameBytes + (size_t)srcLine * rowsPerLine * srcRowBytes;
+      for (int row = 0; row < rowsPerLine; row++){
+        buildRow(in + row * srcRowBytes, out + row * rowBytes);
+      }
+      built[srcLine] = line;
+    }
+  }
+}
+
+/** Build one output row from a source row.
+  * \param[in] src pointer to the source row
+  * \param[out] dst pointer to the output row
+  */
+void SimHDF5Geometry::buildRow(const char *src, char *dst)
+{
+  size_t n = width;
+  if (period > 0 && (size_t)period < n){
+    n = period;
+  }
+  switch (elementSize){
+    case 1:
+      gather((const uint8_t *)src, &colMap[0], (uint8_t *)dst, n);
+      break;
+    case 2:
+      gather((const uint16_t *)src, &colMap[0], (uint16_t *)dst, n);
+      break;
+    case 4:
+      gather((const uint32_t *)src, &colMap[0], (uint32_t *)dst, n);
+      break;
+    case 8:
+      gather((const uint64_t *)src, &colMap[0], (uint64_t *)dst, n);
+      break;
+    default:
+      for (size_t i = 0; i < n; i++){
+        memcpy(dst + i * elementSize, src + (size_t)colMap[i] * elementSize, elementSize);
+      }
+      break;
+  }
+  // Replicate the first period across the rest of the row, doubling each time
+  size_t done = n;
+  while (done < (size_t)width){
+    size_t copy = done;
+    if (copy > (size_t)width - done){
+      copy = (size_t)width - done;
+    }
+    memcpy(dst + done * elementSize, dst, copy * elementSize);
+    done += copy;
+  }
+}
@@ -0,0 +1,86 @@
+/*
+ * SimHDF5Geometry.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5GEOMETRY_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5GEOMETRY_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+
+/** Enumeration of the ways a frame read from the dataset is mapped onto the output frame */
+typedef enum
+{
+  SimHDF5GeometryDirect,      // The frame is output as it is read
+  SimHDF5GeometryTile,        // The frame is repeated across the output frame
+  SimHDF5GeometryMirror,      // The frame is repeated with alternate copies mirrored so that edges match
+  SimHDF5GeometryUpscale      // The frame is enlarged to the output frame with nearest neighbour sampling
+} SimHDF5GeometryMode_t;
+
+/** Expands a small frame read from the dataset into a larger synthetic frame.
+  *
+  * The synthetic frame has the size of the output geometry and the caller
+  * asks for a region of it, so that a ROI can be applied to the synthetic
+  * detector.  Each output row is built once from its source row with a
+  * column lookup table.  For tiled output only one period of the row is
+  * looked up and the rest is filled by doubling it with memcpy.  Output
+  * rows that come from a source row already built are copied with memcpy.
+  * The rows are shared between a pool of worker threads and the calling
+  * thread.
+  */
+class SimHDF5Geometry
+{
+public:
+  struct Worker
+  {
+    SimHDF5Geometry *owner;    // Geometry that the worker belongs to
+    int index;                 // Index of the worker, the calling thread is 0
+    epicsEventId startEvent;   // Signalled when there is work to do
+    epicsEventId doneEvent;    // Signalled when the work is done
+    int placementError;        // Error number from placing the worker, 0 if it was placed
+  };
+
+  SimHDF5Geometry();
+  virtual ~SimHDF5Geometry();
+
+  void setThreads(int threads);
+  void setPlacement(const std::string& cpus, int priority);
+  int getThreads();
+  int getPlacementError();
+  void expand(int mode, const void *src, int srcWidth, int srcHeight,
+              void *dst, int minX, int minY, int width, int height,
+              int outWidth, int outHeight, size_t elementSize, int rowsPerLine, int nframes);
+  void workerTask(Worker *worker);
+
+private:
+  void stopWorkers();
+  void expandLines(int index);
+  void buildRow(const char *src, char *dst);
+
+  std::vector<Worker *> workers;  // Worker threads, not including the calling thread
+  bool exiting;                   // Workers should exit when woken
+  std::string cpus;               // CPUs the workers run on, empty for any
+  int priority;                   // SCHED_FIFO priority of the workers, 0 for normal scheduling
+  int placementError;             // Error number from placing the workers, 0 if they were all placed
+
+  // Description of the expansion being carried out
+  const char *src;                // Source frames
+  char *dst;                      // Output frames
+  int srcWidth;                   // Width of a source frame in elements
+  int srcHeight;                  // Height of a source frame in lines
+  int width;                      // Width of the output region in elements
+  int height;                     // Height of the output region in lines
+  size_t elementSize;             // Size of one element in bytes
+  int rowsPerLine;                // Rows stored for each line, 3 for row interleaved colour
+  int lines;                      // Total number of output lines in all frames
+  int period;                     // Number of output columns before the columns repeat, 0 if they do not
+  std::vector<int> colMap;        // Source column of each output column
+  std::vector<int> rowMap;        // Source line of each output line
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5GEOMETRY_H_ */
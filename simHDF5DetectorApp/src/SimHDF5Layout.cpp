@@ -0,0 +1,252 @@
+/*
+ * SimHDF5Layout.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "SimHDF5Layout.h"
+#include <string.h>
+#include <stdint.h>
+#include "NDArray.h"
+
+// Width and height in elements of the tiles a strided frame is copied in
+#define SIMHDF5_TILE 32
+
+/** Interleave three planes into a single RGB stream.
+  * \param[in] p0 pointer to the first colour plane
+  * \param[in] p1 pointer to the second colour plane
+  * \param[in] p2 pointer to the third colour plane
+  * \param[out] dst pointer to the interleaved output
+  * \param[in] n number of pixels to interleave
+  *
+  * The loop body is free of aliasing and branches so that the compiler
+  * can vectorize the stride 3 stores.
+  */
+template <typename T>
+static void interleave3(const T * __restrict__ p0, const T * __restrict__ p1, const T * __restrict__ p2,
+                        T * __restrict__ dst, size_t n)
+{
+  for (size_t i = 0; i < n; i++){
+    dst[3*i]   = p0[i];
+    dst[3*i+1] = p1[i];
+    dst[3*i+2] = p2[i];
+  }
+}
+
+/** Split a single RGB stream into three planes.
+  * \param[in] src pointer to the interleaved input
+  * \param[out] p0 pointer to the first colour plane
+  * \param[out] p1 pointer to the second colour plane
+  * \param[out] p2 pointer to the third colour plane
+  * \param[in] n number of pixels to de-interleave
+  */
+template <typename T>
+static void deinterleave3(const T * __restrict__ src,
+                          T * __restrict__ p0, T * __restrict__ p1, T * __restrict__ p2, size_t n)
+{
+  for (size_t i = 0; i < n; i++){
+    p0[i] = src[3*i];
+    p1[i] = src[3*i+1];
+    p2[i] = src[3*i+2];
+  }
+}
+
+/** Rearrange a three colour block from one layout to another.
+  *
+  * Works one row at a time, picking a straight copy, an interleave or a
+  * de-interleave kernel when the strides allow, and falling back to a
+  * generic strided copy for any other combination.
+  */
+template <typename T>
+static void convertColorT(const T *src, const ptrdiff_t *ss, T *dst, const ptrdiff_t *ds, size_t sizeX, size_t sizeY)
+{
+  for (size_t y = 0; y < sizeY; y++){
+    const T *s = src + y*ss[1];
+    T *d = dst + y*ds[1];
+    if (ss[0] == 1 && ds[0] == 1){
+      for (int c = 0; c < 3; c++){
+        memcpy(d + c*ds[2], s + c*ss[2], sizeX*sizeof(T));
+      }
+    } else if (ss[0] == 1 && ds[0] == 3 && ds[2] == 1){
+      interleave3<T>(s, s + ss[2], s + 2*ss[2], d, sizeX);
+    } else if (ss[0] == 3 && ss[2] == 1 && ds[0] == 1){
+      deinterleave3<T>(s, d, d + ds[2], d + 2*ds[2], sizeX);
+    } else {
+      for (size_t x = 0; x < sizeX; x++){
+        for (int c = 0; c < 3; c++){
+          d[x*ds[0] + c*ds[2]] = s[x*ss[0] + c*ss[2]];
+        }
+      }
+    }
+  }
+}
+
+/** Copy one tile of a strided frame into a packed frame.
+  * \param[in] src pointer to the first element of the tile
+  * \param[in] sx element stride of the source in x
+  * \param[in] sy element stride of the source in y
+  * \param[out] dst pointer to the first element of the tile in the packed frame
+  * \param[in] width number of elements in each row of the packed frame
+  * \param[in] nx number of elements in x
+  * \param[in] ny number of elements in y
+  *
+  * The tile is small enough that the source lines it touches stay in the
+  * L1 cache while every row is written, so each cache line is fetched once
+  * however the source is strided.  The fixed stride inner loop is left to
+  * the compiler to vectorize.
+  */
+template <typename T>
+static void packTile(const T * __restrict__ src, ptrdiff_t sx, ptrdiff_t sy,
+                     T * __restrict__ dst, ptrdiff_t width, ptrdiff_t nx, ptrdiff_t ny)
+{
+  for (ptrdiff_t y = 0; y < ny; y++){
+    const T *s = src + y*sy;
+    T *d = dst + y*width;
+    for (ptrdiff_t x = 0; x < nx; x++){
+      d[x] = s[x*sx];
+    }
+  }
+}
+
+/** Copy a strided frame into a packed frame one tile at a time.
+  */
+template <typename T>
+static void packFrameT(const T *src, const ptrdiff_t *ss, T *dst, ptrdiff_t sizeX, ptrdiff_t sizeY)
+{
+  for (ptrdiff_t ty = 0; ty < sizeY; ty += SIMHDF5_TILE){
+    ptrdiff_t ny = sizeY - ty < SIMHDF5_TILE ? sizeY - ty : SIMHDF5_TILE;
+    for (ptrdiff_t tx = 0; tx < sizeX; tx += SIMHDF5_TILE){
+      ptrdiff_t nx = sizeX - tx < SIMHDF5_TILE ? sizeX - tx : SIMHDF5_TILE;
+      packTile<T>(src + tx*ss[0] + ty*ss[1], ss[0], ss[1], dst + ty*sizeX + tx, sizeX, nx, ny);
+    }
+  }
+}
+
+/** Calculate the strides of a block read from a dataset.
+  * \param[in] xdim dataset dimension used for x
+  * \param[in] ydim dataset dimension used for y
+  * \param[in] cdim dataset dimension used for colour
+  * \param[in] sizeX number of elements in x
+  * \param[in] sizeY number of elements in y
+  * \param[out] strides element strides indexed [x, y, c]
+  *
+  * HDF5 returns a hyperslab in the order of the dataset dimensions, so the
+  * highest numbered dimension is the fastest varying in memory.
+  */
+void SimHDF5Layout::fileStrides(int xdim, int ydim, int cdim, size_t sizeX, size_t sizeY, ptrdiff_t *strides)
+{
+  int axes[3] = {xdim, ydim, cdim};
+  size_t sizes[3] = {sizeX, sizeY, 3};
+  for (int i = 0; i < 3; i++){
+    strides[i] = 1;
+    for (int j = 0; j < 3; j++){
+      if (axes[j] > axes[i]){
+        strides[i] *= sizes[j];
+      }
+    }
+  }
+}
+
+/** Calculate the strides of an NDArray for the given colour mode.
+  * \param[in] colorMode one of the NDColorModeRGB values
+  * \param[in] sizeX number of elements in x
+  * \param[in] sizeY number of elements in y
+  * \param[out] strides element strides indexed [x, y, c]
+  */
+void SimHDF5Layout::colorStrides(int colorMode, size_t sizeX, size_t sizeY, ptrdiff_t *strides)
+{
+  switch (colorMode){
+    case NDColorModeRGB1:
+      // [y][x][c]
+      strides[0] = 3;
+      strides[1] = 3*sizeX;
+      strides[2] = 1;
+      break;
+    case NDColorModeRGB2:
+      // [y][c][x]
+      strides[0] = 1;
+      strides[1] = 3*sizeX;
+      strides[2] = sizeX;
+      break;
+    default:
+      // [c][y][x]
+      strides[0] = 1;
+      strides[1] = sizeX;
+      strides[2] = sizeX*sizeY;
+      break;
+  }
+}
+
+/** Check whether two layouts are identical, in which case no conversion is required.
+  */
+bool SimHDF5Layout::sameStrides(const ptrdiff_t *a, const ptrdiff_t *b)
+{
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+/** Rearrange a three colour block from one layout into another.
+  * \param[in] src pointer to the source block
+  * \param[in] srcStrides element strides of the source indexed [x, y, c]
+  * \param[out] dst pointer to the destination block
+  * \param[in] dstStrides element strides of the destination indexed [x, y, c]
+  * \param[in] sizeX number of elements in x
+  * \param[in] sizeY number of elements in y
+  * \param[in] bytes number of bytes per element
+  */
+void SimHDF5Layout::convertColor(const void *src, const ptrdiff_t *srcStrides,
+                                 void *dst, const ptrdiff_t *dstStrides,
+                                 size_t sizeX, size_t sizeY, int bytes)
+{
+  switch (bytes){
+    case 1:
+      convertColorT<uint8_t>((const uint8_t *)src, srcStrides, (uint8_t *)dst, dstStrides, sizeX, sizeY);
+      break;
+    case 2:
+      convertColorT<uint16_t>((const uint16_t *)src, srcStrides, (uint16_t *)dst, dstStrides, sizeX, sizeY);
+      break;
+    case 4:
+      convertColorT<uint32_t>((const uint32_t *)src, srcStrides, (uint32_t *)dst, dstStrides, sizeX, sizeY);
+      break;
+    case 8:
+      convertColorT<uint64_t>((const uint64_t *)src, srcStrides, (uint64_t *)dst, dstStrides, sizeX, sizeY);
+      break;
+  }
+}
+
+/** Copy a frame with any element strides into a packed [y][x] frame.
+  * \param[in] src pointer to the first element of the frame
+  * \param[in] srcStrides element strides of the source indexed [x, y]
+  * \param[out] dst pointer to the packed frame
+  * \param[in] sizeX number of elements in x
+  * \param[in] sizeY number of elements in y
+  * \param[in] bytes number of bytes per element
+  *
+  * Rows that are already contiguous are copied whole.  Anything else, such
+  * as a frame whose x and y dimensions are swapped or are not the innermost
+  * dimensions of the dataset, is transposed in cache sized tiles.
+  */
+void SimHDF5Layout::packFrame(const void *src, const ptrdiff_t *srcStrides,
+                              void *dst, size_t sizeX, size_t sizeY, int bytes)
+{
+  if (srcStrides[0] == 1){
+    size_t rowBytes = sizeX * bytes;
+    for (size_t y = 0; y < sizeY; y++){
+      memcpy((char *)dst + y*rowBytes, (const char *)src + y*srcStrides[1]*bytes, rowBytes);
+    }
+    return;
+  }
+  switch (bytes){
+    case 1:
+      packFrameT<uint8_t>((const uint8_t *)src, srcStrides, (uint8_t *)dst, sizeX, sizeY);
+      break;
+    case 2:
+      packFrameT<uint16_t>((const uint16_t *)src, srcStrides, (uint16_t *)dst, sizeX, sizeY);
+      break;
+    case 4:
+      packFrameT<uint32_t>((const uint32_t *)src, srcStrides, (uint32_t *)dst, sizeX, sizeY);
+      break;
+    case 8:
+      packFrameT<uint64_t>((const uint64_t *)src, srcStrides, (uint64_t *)dst, sizeX, sizeY);
+      break;
+  }
+}
@@ -0,0 +1,30 @@
+/*
+ * SimHDF5Layout.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5LAYOUT_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5LAYOUT_H_
+
+#include <stddef.h>
+
+/** Memory layout helpers used to rearrange blocks read from a dataset
+  * into the layout required by the output NDArray.
+  *
+  * Strides are always given in elements and indexed as [x, y, c].
+  */
+class SimHDF5Layout
+{
+public:
+  static void fileStrides(int xdim, int ydim, int cdim, size_t sizeX, size_t sizeY, ptrdiff_t *strides);
+  static void colorStrides(int colorMode, size_t sizeX, size_t sizeY, ptrdiff_t *strides);
+  static bool sameStrides(const ptrdiff_t *a, const ptrdiff_t *b);
+  static void convertColor(const void *src, const ptrdiff_t *srcStrides,
+                           void *dst, const ptrdiff_t *dstStrides,
+                           size_t sizeX, size_t sizeY, int bytes);
+  static void packFrame(const void *src, const ptrdiff_t *srcStrides,
+                        void *dst, size_t sizeX, size_t sizeY, int bytes);
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5LAYOUT_H_ */
@@ -6,10 +6,20 @@
  */
 
 #include "SimHDF5MemoryReader.h"
+#include "SimHDF5Layout.h"
+#include "SimHDF5Placement.h"
 #include <iostream>
 #include <string.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <epicsThread.h>
+
+// Size of each slab read when loading a dataset, large enough for efficient
+// reads and small enough that the first frames are resident quickly
+#define SIMHDF5_LOAD_SLAB_BYTES (64 * 1024 * 1024)
+
+// Interval in seconds between checks of a load by another IOC
+#define SIMHDF5_FOLLOW_PERIOD   0.1
 
 /** C function called when inspecting the HDF5 for datasets.
   * \param[in] loc_id Internal ID of the HDF5 object.
@@ -38,23 +48,24 @@ SimHDF5MemoryReader::SimHDF5MemoryReader() :
   file(0),
   filename(""),
   fileLoaded(false),
-  dset_id(0),
-  dspace_id(0),
-  ndims(0),
-  dims(0),
-  type_id(0),
-  ntype_id(0),
   reading(false),
-  inMemory(false),
-  rawPtr(0),
-  memDatatype(NDUInt8)
+  sharedStore(false),
+  snapshotDir(""),
+  numaNode(-1),
+  lockStores(false),
+  lockError(0)
 {
-
+  hdf5Mutex = epicsMutexMustCreate();
+  datasetsMutex = epicsMutexMustCreate();
+  residentEvent = epicsEventMustCreate(epicsEventEmpty);
 }
 
 SimHDF5MemoryReader::~SimHDF5MemoryReader()
 {
-  // TODO Auto-generated destructor stub
+  unloadFile();
+  epicsEventDestroy(residentEvent);
+  epicsMutexDestroy(datasetsMutex);
+  epicsMutexDestroy(hdf5Mutex);
 }
 
 /** Set the filename of the HDF5 to read.
@@ -94,6 +105,7 @@ bool SimHDF5MemoryReader::validateFilename()
 
   if (validated){
     // Now attempt to open the file
+    epicsMutexLock(hdf5Mutex);
     fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     if (fid < 0){
       validated = false;
@@ -101,6 +113,7 @@ bool SimHDF5MemoryReader::validateFilename()
       // Close the file again
       H5Fclose(fid);
     }
+    epicsMutexUnlock(hdf5Mutex);
   }
   return validated;
 }
@@ -121,19 +134,25 @@ int SimHDF5MemoryReader::fileExists()
   * The file specified by filename is opened and then inspected
   * for datasets.
   */
-void SimHDF5MemoryReader::loadFile()
+bool SimHDF5MemoryReader::loadFile()
 {
   if (fileLoaded){
     // If there is already an open file then we need to unload it first
     unloadFile();
   }
   // Open the file
+  epicsMutexLock(hdf5Mutex);
   file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file < 0){
+    epicsMutexUnlock(hdf5Mutex);
+    return false;
+  }
   fileLoaded = true;
-  // Iterate through the file structure to obtain all datasets
+  // Iterate through the file structure to obtain all datasets, the frames
+  // are only loaded once a dataset is prepared for reading or preloaded
   H5Giterate(file, "/", NULL, file_mem_info, this);
-  //H5Fclose(this->file);
-  //this->file = NULL;
+  epicsMutexUnlock(hdf5Mutex);
+  return true;
 }
 
 /** Unload currently loaded file and clear resources.
@@ -142,9 +161,16 @@ void SimHDF5MemoryReader::loadFile()
 void SimHDF5MemoryReader::unloadFile()
 {
   if (fileLoaded){
-    // First empty the dataset containers
+    cancelPreload();
+    // First empty the dataset containers, detaching from any frame stores
+    epicsMutexLock(hdf5Mutex);
+    epicsMutexLock(datasetsMutex);
     datasets.clear();
+    epicsMutexUnlock(datasetsMutex);
+    H5Fclose(this->file);
+    this->file = -1;
     fileLoaded = false;
+    epicsMutexUnlock(hdf5Mutex);
   }
 }
 
@@ -164,14 +190,14 @@ std::vector<std::string> SimHDF5MemoryReader::getDatasetKeys()
 
 /** Return the specified dataset dimensions.
   * \param[in] dname Name of the dataset
-  * \return vector of integer dimensions.
+  * \return vector of dimensions.
   *
   * Returns the dimensions of the specified dataset as a vector of
-  * integer values.
+  * 64-bit values.
   */
-std::vector<int> SimHDF5MemoryReader::getDatasetDimensions(const std::string& dname)
+std::vector<hsize_t> SimHDF5MemoryReader::getDatasetDimensions(const std::string& dname)
 {
-  std::vector<int> dimensions;
+  std::vector<hsize_t> dimensions;
   if (datasets.count(dname) > 0){
     dimensions = datasets[dname]->getDimensions();
   }
@@ -180,21 +206,20 @@ std::vector<int> SimHDF5MemoryReader::getDatasetDimensions(const std::string& dn
 
 /** Return the specified dataset dimensions.
   * \param[in] dname Name of the dataset
-  * \return vector of integer dimensions.
+  * \return vector of dimensions.
   *
   * Returns the dimensions of the specified dataset as a vector of
-  * integer values.
+  * 64-bit values.
   */
-std::vector<int> SimHDF5MemoryReader::parseDatasetDimensions(const std::string& dname)
+std::vector<hsize_t> SimHDF5MemoryReader::parseDatasetDimensions(const std::string& dname)
 {
-  std::vector<int> dimensions;
+  std::vector<hsize_t> dimensions;
   hid_t dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
   hid_t dspace = H5Dget_space(dset);
   const int ndims = H5Sget_simple_extent_ndims(dspace);
-  hsize_t dims[ndims];
-  H5Sget_simple_extent_dims(dspace, dims, NULL);
-  for (int i = 0; i < ndims; i++){
-    dimensions.push_back((int)dims[i]);
+  dimensions.resize(ndims);
+  if (ndims > 0){
+    H5Sget_simple_extent_dims(dspace, &dimensions[0], NULL);
   }
   H5Sclose(dspace);
   H5Dclose(dset);
@@ -293,23 +318,400 @@ int SimHDF5MemoryReader::dataTypeToBytes(NDDataType_t NDType)
 /** Prepare information required to read out dataset data.
   * \param[in] dname Name of the dataset
   *
-  * Allocates the required resources ready to read out the data for
-  * the specified dataset.
+  * Loads every frame of the dataset into its frame store the first time
+  * the dataset is read.  The store is kept until the file is unloaded, so
+  * any number of datasets can be prepared and switched between.  A dataset
+  * that is still being preloaded is read while it loads, each read waiting
+  * for its frames to become resident.  A store left incomplete by a failed
+  * or cancelled load is loaded again.  Datasets switched to during an
+  * acquisition have already been loaded with preloadDataset, so that the
+  * acquisition task does not wait here.
   */
 void SimHDF5MemoryReader::prepareToReadDataset(const std::string& dname)
 {
-  if (!reading){
-    reading = true;
+  epicsMutexLock(hdf5Mutex);
+  if (datasets.count(dname) > 0){
+    std::tr1::shared_ptr<HDF5MemDataset> dataset = datasets[dname];
+    std::tr1::shared_ptr<SimHDF5FrameStore> store = dataset->getStore();
+    if (!store || dataset->isFailed()){
+      loadDataset(dname);
+    }
   }
+  epicsMutexUnlock(hdf5Mutex);
+  reading = true;
 }
 
-void SimHDF5MemoryReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data)
+/** Load every frame of a dataset into a frame store.
+  * \param[in] dname Name of the dataset
+  *
+  * Returns once the whole dataset is resident.  Called with the HDF5 mutex held.
+  */
+void SimHDF5MemoryReader::loadDataset(const std::string& dname)
 {
-  int indexes[6] = {0,0,0,0,0,0};
-  readFromDataset(dname, minX, minY, sizeX, sizeY, wdim, hdim, indexes, data);
+  DatasetLoad load;
+  if (beginLoad(dname, load)){
+    while (loadSlab(load)){
+    }
+  }
 }
 
-/** Prepare information required to read out dataset data.
+/** Start loading a dataset into a new frame store.
+  * \param[in] dname Name of the dataset
+  * \param[out] load state of the load, to be passed to loadSlab
+  * \return true if slabs must be read from the file to fill the store.
+  *
+  * The store holds the dataset in file order.  If a snapshot of the current
+  * source file exists it is mapped instead, and if a shared store is loaded
+  * or being loaded by another IOC it is attached to without reading the
+  * file.  Called with the HDF5 mutex held.
+  */
+bool SimHDF5MemoryReader::beginLoad(const std::string& dname, DatasetLoad& load)
+{
+  std::tr1::shared_ptr<HDF5MemDataset> dataset = datasets[dname];
+  std::vector<hsize_t> dimsizes = dataset->getDimensions();
+  size_t totalBytes = dataTypeToBytes(dataset->getDataType());
+  for (size_t index = 0; index < dimsizes.size(); index++){
+    totalBytes *= dimsizes[index];
+  }
+  std::string snapshot;
+  if (!snapshotDir.empty()){
+    snapshot = snapshotDir + "/" + SimHDF5FrameStore::snapshotName(filename, dname);
+    std::tr1::shared_ptr<SimHDF5FrameStore> mapped = SimHDF5FrameStore::openSnapshot(snapshot, filename, dname, totalBytes);
+    if (mapped){
+      printf("Mapped snapshot %s for dataset %s\n", snapshot.c_str(), dname.c_str());
+      setDatasetStore(dataset.get(), mapped);
+      dataset->setResident(mapped->size());
+      lockStore(mapped);
+      return false;
+    }
+  }
+  std::tr1::shared_ptr<SimHDF5FrameStore> store = SimHDF5FrameStore::create(filename, dname, totalBytes, sharedStore);
+  if (!store){
+    return false;
+  }
+  if (!store->needsLoad()){
+    bool failed = false;
+    setDatasetStore(dataset.get(), store);
+    dataset->setResident(store->progress(&failed));
+    if (dataset->getResident() < store->size()){
+      // Another IOC is loading the shared store, reads follow its progress
+      printf("Following the load of dataset %s by another IOC\n", dname.c_str());
+      dataset->setFailed(failed);
+      dataset->setLoading(!failed);
+      return false;
+    }
+    printf("Attached to shared frame store for dataset %s\n", dname.c_str());
+    lockStore(store);
+    return false;
+  }
+  printf("Loading %lu bytes for dataset %s\n", (unsigned long)totalBytes, dname.c_str());
+  // Place the frames on the node that reads them before they are first touched
+  SimHDF5Placement::bindMemory(store->data(), store->size(), numaNode);
+  load.dname = dname;
+  load.dset = H5Dopen(this->file, dname.c_str(), H5P_DEFAULT);
+  hid_t type = H5Dget_type(load.dset);
+  load.ntype = H5Tget_native_type(type, H5T_DIR_ASCEND);
+  H5Tclose(type);
+  load.rows = dimsizes[0];
+  load.next = 0;
+  load.rowBytes = load.rows > 0 ? totalBytes / load.rows : 0;
+  load.step = 1;
+  if (load.rowBytes > 0 && load.rowBytes < SIMHDF5_LOAD_SLAB_BYTES){
+    load.step = SIMHDF5_LOAD_SLAB_BYTES / load.rowBytes;
+  }
+  // Whole chunks are read by each slab so that no chunk is decompressed twice
+  hid_t plist = H5Dget_create_plist(load.dset);
+  if (H5Pget_layout(plist) == H5D_CHUNKED){
+    hsize_t chunk[dimsizes.size()];
+    H5Pget_chunk(plist, dimsizes.size(), chunk);
+    if (chunk[0] > 0){
+      load.step = ((load.step + chunk[0] - 1) / chunk[0]) * chunk[0];
+    }
+  }
+  H5Pclose(plist);
+  load.snapshot = snapshot;
+  load.store = store;
+  dataset->setResident(0);
+  dataset->setFailed(false);
+  dataset->setLoading(true);
+  setDatasetStore(dataset.get(), store);
+  return true;
+}
+
+/** Read the next slab of a dataset into its frame store.
+  * \param[in,out] load state of the load started by beginLoad
+  * \return true while more slabs remain to be read.
+  *
+  * Readers waiting for frames in the slab are woken once it is resident.
+  * Called with the HDF5 mutex held.
+  */
+bool SimHDF5MemoryReader::loadSlab(DatasetLoad& load)
+{
+  std::vector<hsize_t> dimsizes = datasets[load.dname]->getDimensions();
+  int ndims = dimsizes.size();
+  hsize_t start[ndims];
+  hsize_t count[ndims];
+  for (int index = 0; index < ndims; index++){
+    start[index] = 0;
+    count[index] = dimsizes[index];
+  }
+  start[0] = load.next;
+  count[0] = load.rows - load.next;
+  if (count[0] > load.step){
+    count[0] = load.step;
+  }
+  herr_t status = 0;
+  if (count[0] > 0){
+    hid_t fspace = H5Dget_space(load.dset);
+    H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL, count, NULL);
+    hid_t mspace = H5Screate_simple(ndims, count, NULL);
+    status = H5Dread(load.dset, load.ntype, mspace, fspace, H5P_DEFAULT, load.store->data() + load.next * load.rowBytes);
+    H5Sclose(mspace);
+    H5Sclose(fspace);
+  }
+  if (status < 0){
+    printf("Failed to load dataset %s\n", load.dname.c_str());
+    endLoad(load, false);
+    return false;
+  }
+  load.next += count[0];
+  datasets[load.dname]->setResident(load.next * load.rowBytes);
+  load.store->publishProgress(load.next * load.rowBytes);
+  epicsEventSignal(residentEvent);
+  if (load.next >= load.rows){
+    endLoad(load, true);
+    return false;
+  }
+  return true;
+}
+
+/** Finish loading a dataset.
+  * \param[in,out] load state of the load started by beginLoad
+  * \param[in] complete every slab has been read
+  *
+  * A complete store is written out as a snapshot when a snapshot directory
+  * has been set.  An incomplete store is kept, as an acquisition may still
+  * be reading it, and the dataset is marked as failed so that reads of the
+  * missing frames fail and the store is replaced when the dataset is next
+  * prepared.
+  * Called with the HDF5 mutex held.
+  */
+void SimHDF5MemoryReader::endLoad(DatasetLoad& load, bool complete)
+{
+  H5Tclose(load.ntype);
+  H5Dclose(load.dset);
+  if (complete){
+    load.store->loaded();
+    if (!load.snapshot.empty() && load.store->writeSnapshot(load.snapshot, filename, load.dname)){
+      printf("Wrote snapshot %s\n", load.snapshot.c_str());
+    }
+    lockStore(load.store);
+  } else {
+    load.store->failed();
+    datasets[load.dname]->setFailed(true);
+  }
+  datasets[load.dname]->setLoading(false);
+  epicsEventSignal(residentEvent);
+  load = DatasetLoad();
+}
+
+/** Lock a loaded frame store into memory if locking is selected.
+  * \param[in] store the store
+  */
+void SimHDF5MemoryReader::lockStore(std::tr1::shared_ptr<SimHDF5FrameStore> store)
+{
+  if (lockStores){
+    int error = store->lockPages();
+    if (error != 0){
+      lockError = error;
+    }
+  }
+}
+
+/** Load the next part of a dataset in the background.
+  * \param[in] dname Name of the dataset
+  * \param[out] done number of bytes of the dataset resident in memory
+  * \param[out] total size of the dataset in bytes
+  * \return true while more of the dataset remains to be loaded.
+  *
+  * Each call reads one slab of about 64 MiB, so the caller can report
+  * progress and stop between calls.  The dataset can be prepared and read
+  * while it loads.  While another IOC loads a shared store each call waits
+  * a short time and reports the progress of that load.  A store left
+  * incomplete by a failed load is loaded again.
+  */
+bool SimHDF5MemoryReader::preloadDataset(const std::string& dname, size_t *done, size_t *total)
+{
+  bool more = false;
+  bool following = false;
+  *done = 0;
+  *total = 0;
+  epicsMutexLock(hdf5Mutex);
+  if (datasets.count(dname) > 0){
+    std::tr1::shared_ptr<HDF5MemDataset> dataset = datasets[dname];
+    if ((!dataset->getStore() || dataset->isFailed()) && preload.dname.empty()){
+      beginLoad(dname, preload);
+    }
+    if (preload.dname == dname){
+      more = loadSlab(preload);
+    } else if (dataset->isLoading()){
+      // Loaded into a shared store by another IOC, report its progress
+      followLoad(dataset.get());
+      more = following = dataset->isLoading();
+    }
+    std::tr1::shared_ptr<SimHDF5FrameStore> store = dataset->getStore();
+    if (store){
+      *done = dataset->getResident();
+      *total = store->size();
+    }
+  }
+  epicsMutexUnlock(hdf5Mutex);
+  if (following){
+    epicsThreadSleep(SIMHDF5_FOLLOW_PERIOD);
+  }
+  return more;
+}
+
+/** Stop a preload and release the frames loaded so far.
+  *
+  * Must not be called while the dataset is being read.
+  */
+void SimHDF5MemoryReader::cancelPreload()
+{
+  epicsMutexLock(hdf5Mutex);
+  if (!preload.dname.empty()){
+    printf("Cancelled loading dataset %s\n", preload.dname.c_str());
+    std::tr1::shared_ptr<HDF5MemDataset> dataset = datasets[preload.dname];
+    endLoad(preload, false);
+    setDatasetStore(dataset.get(), std::tr1::shared_ptr<SimHDF5FrameStore>());
+    dataset->setResident(0);
+  }
+  epicsMutexUnlock(hdf5Mutex);
+}
+
+/** Replace the frame store of a dataset.
+  * \param[in] dataset the dataset
+  * \param[in] store the new store, empty for none
+  */
+void SimHDF5MemoryReader::setDatasetStore(HDF5MemDataset *dataset, std::tr1::shared_ptr<SimHDF5FrameStore> store)
+{
+  epicsMutexLock(datasetsMutex);
+  dataset->setStore(store);
+  epicsMutexUnlock(datasetsMutex);
+}
+
+/** Look up a dataset and its frame store for reading.
+  * \param[in] dname Name of the dataset
+  * \param[out] store the frame store of the dataset, empty if it has none
+  * \return the dataset, empty if the file has no such dataset.
+  *
+  * The copies keep the dataset and its frames alive while they are read,
+  * even if the file is unloaded or a preload is cancelled meanwhile.  The
+  * HDF5 mutex is not taken, so reads are not held up by a slab being loaded.
+  */
+std::tr1::shared_ptr<SimHDF5MemoryReader::HDF5MemDataset> SimHDF5MemoryReader::findDataset(const std::string& dname, std::tr1::shared_ptr<SimHDF5FrameStore> *store)
+{
+  std::tr1::shared_ptr<HDF5MemDataset> dataset;
+  epicsMutexLock(datasetsMutex);
+  std::map<std::string, std::tr1::shared_ptr<HDF5MemDataset> >::iterator iter = datasets.find(dname);
+  if (iter != datasets.end()){
+    dataset = iter->second;
+    *store = dataset->getStore();
+  }
+  epicsMutexUnlock(datasetsMutex);
+  return dataset;
+}
+
+/** Update the resident size of a dataset loaded into a shared store by another IOC.
+  * \param[in] dataset the dataset
+  */
+void SimHDF5MemoryReader::followLoad(HDF5MemDataset *dataset)
+{
+  std::tr1::shared_ptr<SimHDF5FrameStore> store = dataset->getStore();
+  if (!dataset->isLoading() || !store || !store->isFollowing()){
+    return;
+  }
+  bool failed = false;
+  dataset->setResident(store->progress(&failed));
+  if (failed || dataset->getResident() >= store->size()){
+    dataset->setFailed(failed);
+    dataset->setLoading(false);
+    if (!failed){
+      lockStore(store);
+    }
+  }
+}
+
+/** Wait until the start of a dataset is resident in its frame store.
+  * \param[in] dataset the dataset
+  * \param[in] bytes number of bytes from the start of the store that are needed
+  *
+  * Returns at once unless the dataset is still loading.
+  */
+void SimHDF5MemoryReader::waitResident(HDF5MemDataset *dataset, size_t bytes)
+{
+  followLoad(dataset);
+  while (dataset->isLoading() && dataset->getResident() < bytes){
+    epicsEventWaitWithTimeout(residentEvent, SIMHDF5_FOLLOW_PERIOD);
+    followLoad(dataset);
+  }
+}
+
+/** Locate the first element of a frame in the frame store.
+  * \param[in] dataset the dataset
+  * \param[in] store the frame store of the dataset, may be NULL
+  * \param[in] minX offset of data in x dimension
+  * \param[in] minY offset of data in y dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[in] skipdim dimension that is not indexed, or -1
+  * \param[in] indexes index values for the remaining dimensions
+  * \param[out] strides element stride of each dimension in the store
+  * \return pointer to the element, or NULL if the frame is not resident.
+  *
+  * Waits for the frame if the dataset is still being loaded.  NULL is
+  * returned for a frame that a failed or cancelled load did not reach.
+  */
+char *SimHDF5MemoryReader::frameOrigin(HDF5MemDataset *dataset, SimHDF5FrameStore *store, int minX, int minY, int wdim, int hdim, int skipdim, hsize_t *indexes, size_t *strides)
+{
+  if (!store){
+    return 0;
+  }
+  std::vector<hsize_t> dimsizes = dataset->getDimensions();
+  int ndims = dimsizes.size();
+  strides[ndims-1] = 1;
+  for (int index = ndims-2; index >= 0; index--){
+    strides[index] = strides[index+1] * dimsizes[index+1];
+  }
+  size_t offset = (size_t)minX * strides[wdim] + (size_t)minY * strides[hdim];
+  int ofsindex = 0;
+  for (int index = 0; index < ndims; index++){
+    if (index != wdim && index != hdim && index != skipdim){
+      offset += (size_t)indexes[ofsindex] * strides[index];
+      ofsindex++;
+    }
+  }
+  size_t bytes = dataTypeToBytes(dataset->getDataType());
+  // Datasets are loaded in slabs of the first dimension, so the frame is
+  // resident once its index in that dimension has been loaded
+  size_t needed = (size_t)dimsizes[0] * strides[0];
+  if (wdim != 0 && hdim != 0 && skipdim != 0){
+    needed = ((size_t)indexes[0] + 1) * strides[0];
+  }
+  waitResident(dataset, needed * bytes);
+  if (dataset->getResident() < needed * bytes){
+    return 0;
+  }
+  return store->data() + offset * bytes;
+}
+
+bool SimHDF5MemoryReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data)
+{
+  hsize_t indexes[6] = {0,0,0,0,0,0};
+  return readFromDataset(dname, minX, minY, sizeX, sizeY, wdim, hdim, indexes, data);
+}
+
+/** Read out a frame from the frame store.
   * \param[in] dname Name of the dataset
   * \param[in] minX offset of data in x dimension
   * \param[in] minY offset of data in y dimension
@@ -319,26 +721,84 @@ void SimHDF5MemoryReader::readFromDataset(const std::string& dname, int minX, in
   * \param[in] hdim specified dimension number for y dimension
   * \param[in] indexes index values for additional dimensions
   * \param[out] data pointer to buffer for storing data
+  * \return false if the frame is not in the frame store.
   *
   * Fills the data buffer with the data required according to the supplied
-  * indexes, offsets and ROI parameters.
+  * indexes, offsets and ROI parameters.  Any pair of dimensions can be used
+  * for the image.  Rows are copied whole when x is the last dimension, and
+  * any other choice of dimensions is transposed out of the store in cache
+  * sized tiles.
   */
-void SimHDF5MemoryReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int *indexes, void *data)
+bool SimHDF5MemoryReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, void *data)
 {
-  std::vector<int> dimsizes = datasets[dname]->getDimensions();
-  int index = 0;
-  for (size_t dimno = 0; dimno < dimsizes.size()-2; dimno++){
-    int cindex = indexes[dimno];
-    for (size_t nx = dimno; nx < dimsizes.size()-3; nx++){
-      cindex = cindex * dimsizes[nx];
+  std::tr1::shared_ptr<SimHDF5FrameStore> store;
+  std::tr1::shared_ptr<HDF5MemDataset> dataset = findDataset(dname, &store);
+  if (!dataset){
+    return false;
+  }
+  size_t strides[dataset->getDimensions().size()];
+  char *in = frameOrigin(dataset.get(), store.get(), minX, minY, wdim, hdim, -1, indexes, strides);
+  if (!in){
+    return false;
+  }
+  ptrdiff_t srcStrides[2] = {(ptrdiff_t)strides[wdim], (ptrdiff_t)strides[hdim]};
+  SimHDF5Layout::packFrame(in, srcStrides, data, sizeX, sizeY, dataTypeToBytes(dataset->getDataType()));
+  return true;
+}
+
+/** Read a number of consecutive frames from the frame store.
+  * \param[in] dname Name of the dataset
+  * \param[in] minX offset of data in x dimension
+  * \param[in] minY offset of data in y dimension
+  * \param[in] sizeX ROI of data in x dimension
+  * \param[in] sizeY ROI of data in y dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[in] indexes index values for additional dimensions of the first frame
+  * \param[in] nframes number of frames to read
+  * \param[out] data pointer to buffer for storing nframes*sizeX*sizeY elements
+  * \return false if any of the frames is not in the frame store.
+  */
+bool SimHDF5MemoryReader::readFramesFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, int nframes, void *data)
+{
+  std::tr1::shared_ptr<SimHDF5FrameStore> store;
+  std::tr1::shared_ptr<HDF5MemDataset> dataset = findDataset(dname, &store);
+  if (!dataset){
+    return false;
+  }
+  std::vector<hsize_t> dimsizes = dataset->getDimensions();
+  int nframedims = dimsizes.size() - 2;
+  int framedims[dimsizes.size()];
+  hsize_t cur[dimsizes.size()];
+  size_t frameBytes = (size_t)sizeX * sizeY * dataTypeToBytes(dataset->getDataType());
+  char *out = (char *)data;
+  int fi = 0;
+  for (int index = 0; index < (int)dimsizes.size(); index++){
+    if (index != wdim && index != hdim){
+      framedims[fi] = index;
+      cur[fi] = indexes[fi];
+      fi++;
     }
-    index += cindex;
   }
-  printf("Bytes: %d\n", datasets[dname]->getImage(index)->getAllocatedBytes());
-  memcpy(data, datasets[dname]->getImage(index)->getRawPtr(), datasets[dname]->getImage(index)->getAllocatedBytes());
+  for (int frame = 0; frame < nframes; frame++){
+    if (!readFromDataset(dname, minX, minY, sizeX, sizeY, wdim, hdim, cur, out)){
+      return false;
+    }
+    out += frameBytes;
+    // Move to the next frame
+    cur[nframedims-1]++;
+    for (int i = nframedims-1; i > 0 && cur[i] >= dimsizes[framedims[i]]; i--){
+      cur[i] = 0;
+      cur[i-1]++;
+    }
+    if (cur[0] >= dimsizes[framedims[0]]){
+      cur[0] = 0;
+    }
+  }
+  return true;
 }
 
-/** Prepare information required to read out dataset data.
+/** Read a three colour image from the frame store.
   * \param[in] dname Name of the dataset
   * \param[in] minX offset of data in x dimension
   * \param[in] minY offset of data in y dimension
@@ -346,82 +806,142 @@ void SimHDF5MemoryReader::readFromDataset(const std::string& dname, int minX, in
   * \param[in] sizeY ROI of data in y dimension
   * \param[in] wdim specified dimension number for x dimension
   * \param[in] hdim specified dimension number for y dimension
+  * \param[in] cdim specified dimension number for colour dimension
   * \param[in] indexes index values for additional dimensions
-  * \param[out] data pointer to buffer for storing data
+  * \param[out] data pointer to buffer for storing 3*sizeX*sizeY elements
+  * \return false if the frame is not in the frame store.
   *
-  * Fills the data buffer with the data required according to the supplied
-  * indexes, offsets and ROI parameters.
+  * The data is returned in the order of the dataset dimensions, matching
+  * the file reader, so that the caller can rearrange it in the same way.
+  */
+bool SimHDF5MemoryReader::readColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes, void *data)
+{
+  std::tr1::shared_ptr<SimHDF5FrameStore> store;
+  std::tr1::shared_ptr<HDF5MemDataset> dataset = findDataset(dname, &store);
+  if (!dataset){
+    return false;
+  }
+  size_t strides[dataset->getDimensions().size()];
+  char *in = frameOrigin(dataset.get(), store.get(), minX, minY, wdim, hdim, cdim, indexes, strides);
+  if (!in){
+    return false;
+  }
+  ptrdiff_t srcStrides[3] = {(ptrdiff_t)strides[wdim], (ptrdiff_t)strides[hdim], (ptrdiff_t)strides[cdim]};
+  ptrdiff_t dstStrides[3];
+  SimHDF5Layout::fileStrides(wdim, hdim, cdim, sizeX, sizeY, dstStrides);
+  SimHDF5Layout::convertColor(in, srcStrides, data, dstStrides, sizeX, sizeY, dataTypeToBytes(dataset->getDataType()));
+  return true;
+}
+
+/** Cleanup all resources after completion of reading out current dataset.
+  *
+  * The frame store is kept so that the next acquisition starts immediately.
   */
-void SimHDF5MemoryReader::parseDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int *indexes, void *data)
+void SimHDF5MemoryReader::cleanupDataset()
 {
-  hid_t memspace;    // Memory space ID
-  hsize_t dimsm[2];  // Memory space dimensions
-  herr_t status;
+  reading = false;
+}
 
-  hsize_t count[ndims];  // Size of the hyperslab in the file
-  hsize_t offset[ndims]; // Hyperslab offset in the file
-  hsize_t count_out[2];  // Size of the hyperslab in memory
-  hsize_t offset_out[2]; // Hyperslab offset in memory
+/** Select whether frame stores are held in shared memory.
+  * \param[in] shared share the frames with other IOCs on the host
+  *
+  * Only affects datasets loaded after the call.
+  */
+void SimHDF5MemoryReader::setSharedStore(bool shared)
+{
+  sharedStore = shared;
+}
 
-  // Define hyperslab in the dataset.
-  // First initialise offsets to zero in all dimensions
-  // Also initialise size to 1 in all dimensions
-  int ofsindex = 0;
-  for (int index = 0; index < ndims; index++){
-    if (index == wdim || index == hdim){
-      // This is a frame dimension, so set the offset to minX, minY
-      if (index == wdim){
-        offset[index] = minX;
-      } else if (index == hdim){
-        offset[index] = minY;
+/** Select the directory used for snapshots of frame stores.
+  * \param[in] dir directory path, ideally on tmpfs or local NVMe, empty to disable snapshots
+  */
+void SimHDF5MemoryReader::setSnapshotDir(const std::string& dir)
+{
+  snapshotDir = dir;
+}
+
+/** Select the NUMA node that frame stores are placed on.
+  * \param[in] node the node, or -1 to leave placement to the kernel
+  *
+  * Only affects datasets loaded after the call.
+  */
+void SimHDF5MemoryReader::setNumaNode(int node)
+{
+  numaNode = node;
+}
+
+/** Select whether frame stores are locked into memory.
+  * \param[in] lock lock the stores, or unlock them
+  * \return 0, or the error number of the first lock that failed.
+  *
+  * Applies to the stores already loaded and to those loaded later.
+  */
+int SimHDF5MemoryReader::setLockMemory(bool lock)
+{
+  std::map<std::string, std::tr1::shared_ptr<HDF5MemDataset> >::iterator iter;
+  epicsMutexLock(hdf5Mutex);
+  lockStores = lock;
+  lockError = 0;
+  for (iter = datasets.begin(); iter != datasets.end(); ++iter){
+    std::tr1::shared_ptr<SimHDF5FrameStore> store = iter->second->getStore();
+    if (!store || iter->second->isLoading()){
+      // A store is locked when its load completes
+      continue;
+    }
+    if (lock){
+      int error = store->lockPages();
+      if (error != 0 && lockError == 0){
+        lockError = error;
       }
     } else {
-      // Set the offset to the specified index
-      offset[index] = indexes[ofsindex];
-      ofsindex++;
+      store->unlockPages();
     }
-    count[index]  = 1;
   }
-  // Now set the count dimensions for the chosen width, height to the real
-  // dimension sizes for the chosen width, height
-  count[wdim] = sizeX;
-  count[hdim] = sizeY;
-  // Select the hyperslab
-  status = H5Sselect_hyperslab(dspace_id, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-  // Define the memory dataspace.
-  dimsm[1] = sizeX;
-  dimsm[0] = sizeY;
-  int ndimsout = 2;
-  memspace = H5Screate_simple(ndimsout,dimsm,NULL);
-
-  // Define memory hyperslab.  This is only 2 dimensional no matter how many dims there are
-  offset_out[0] = 0;
-  offset_out[1] = 0;
-  count_out[1]  = sizeX;
-  count_out[0]  = sizeY;
-  // Select the memory hyperslab
-  status = H5Sselect_hyperslab(memspace, H5S_SELECT_SET, offset_out, NULL, count_out, NULL);
-
-  // Read data from hyperslab in the file into the hyperslab in memory and to the data pointer
-  status = H5Dread(dset_id, ntype_id, memspace, dspace_id, H5P_DEFAULT, data);
+  epicsMutexUnlock(hdf5Mutex);
+  return lockError;
+}
 
-  H5Sclose(memspace);
+/** Number of bytes of frame stores locked into memory.
+  *
+  */
+size_t SimHDF5MemoryReader::getLockedBytes()
+{
+  std::map<std::string, std::tr1::shared_ptr<HDF5MemDataset> >::iterator iter;
+  size_t bytes = 0;
+  epicsMutexLock(hdf5Mutex);
+  for (iter = datasets.begin(); iter != datasets.end(); ++iter){
+    std::tr1::shared_ptr<SimHDF5FrameStore> store = iter->second->getStore();
+    if (store){
+      bytes += store->lockedBytes();
+    }
+  }
+  epicsMutexUnlock(hdf5Mutex);
+  return bytes;
 }
 
-/** Cleanup all resources after completion of reading out current dataset.
+/** Error number of the last lock of a frame store that failed, 0 if none did.
   *
   */
-void SimHDF5MemoryReader::cleanupDataset()
+int SimHDF5MemoryReader::getLockError()
 {
-  if (reading){
-    H5Tclose(ntype_id);
-    H5Tclose(type_id);
-    H5Sclose(dspace_id);
-    H5Dclose(dset_id);
-    free(dims);
-    reading = false;
+  return lockError;
+}
+
+/** Read a one dimensional dataset of numbers, such as frame timestamps.
+  * \param[in] path full path of the dataset in the file
+  * \param[out] values the values, converted to double
+  * \param[out] integer set if the values are integers, such as frame numbers
+  * \return false if the file is not loaded or the dataset cannot be read.
+  */
+bool SimHDF5MemoryReader::readColumn(const std::string& path, std::vector<double>& values, bool *integer)
+{
+  if (!fileLoaded){
+    return false;
   }
+  epicsMutexLock(hdf5Mutex);
+  bool status = readColumnFromFile(this->file, path, values, integer);
+  epicsMutexUnlock(hdf5Mutex);
+  return status;
 }
 
 /** Process an HDF5 object and store the datasets.
@@ -430,8 +950,9 @@ void SimHDF5MemoryReader::cleanupDataset()
   * \param[in] type HDF5 object type.
   *
   * This method is called by the C function callback <b>file_info</b> invoked by
-  * inspecting the HDF5 file.  Any datasets are stored in a map of dataset objects
-  * to allow the driver to quickly retrieve information relating to each dataset.
+  * inspecting the HDF5 file.  The dimensions and type of any datasets are stored
+  * in a map of dataset objects to allow the driver to quickly retrieve information
+  * relating to each dataset.
   */
 void SimHDF5MemoryReader::process(hid_t loc_id, const char *name, H5G_obj_t type)
 {
@@ -439,53 +960,13 @@ void SimHDF5MemoryReader::process(hid_t loc_id, const char *name, H5G_obj_t type
   std::string oldname = cname;
   cname = cname + "/" + sname;
   if (type == H5G_DATASET){
-    dset_id = H5Dopen(this->file, cname.c_str(), H5P_DEFAULT);
-    dspace_id = H5Dget_space(dset_id);
-    ndims = H5Sget_simple_extent_ndims(dspace_id);
-    dims = (hsize_t *)malloc(sizeof(hsize_t) * ndims);
-    H5Sget_simple_extent_dims(dspace_id, dims, NULL);
-    type_id = H5Dget_type(dset_id);
-    ntype_id = H5Tget_native_type(type_id, H5T_DIR_ASCEND);
-    if (parseDatasetDimensions(cname).size() > 2){
-      std::vector<int> dims = parseDatasetDimensions(cname);
-      NDDataType_t type = parseDatasetType(cname);
-      int ndims = dims.size() - 2; // Subtract image width and height dimensions
-      int totalFrames = 1;
-      for (int index = 0; index < ndims; index++){
-        totalFrames = totalFrames * dims[index];
-      }
-      std::vector<std::tr1::shared_ptr<HDF5RawImage> > images;
-      std::tr1::shared_ptr<HDF5RawImage> image;
-      for (int index = 0; index < totalFrames; index++){
-        // Read in each frame
-        int cindex = index;
-        int indexes[dims.size()-2];
-        int ci = 0;
-        int remainder = 0;
-        int quotient = 0;
-        for (int i = dims.size()-3; i >= 0; i--){
-          quotient = cindex / dims[i];
-          remainder = cindex - (quotient * dims[i]);
-          cindex = quotient;
-          // Work out the index in this dimension
-          indexes[dims.size() - 3 - ci] = remainder;
-          ci++;
-        }
-        printf("index[0]: %d\n", indexes[0]);
-        image = std::tr1::shared_ptr<HDF5RawImage>(new HDF5RawImage(dims[dims.size()-1], dims[dims.size()-2], dataTypeToBytes(type)));
-        this->parseDataset(cname, 0, 0, dims[dims.size()-1], dims[dims.size()-2], dims.size()-1, dims.size()-2, indexes, image->getRawPtr());
-        images.push_back(image);
-      }
-      datasets[cname] = std::tr1::shared_ptr<HDF5MemDataset>(new HDF5MemDataset(name,
-                                                                                dims,
-                                                                                type,
-                                                                                images));
+    std::vector<hsize_t> dims = parseDatasetDimensions(cname);
+    if (dims.size() > 2){
+      std::tr1::shared_ptr<HDF5MemDataset> dataset(new HDF5MemDataset(name, dims, parseDatasetType(cname)));
+      epicsMutexLock(datasetsMutex);
+      datasets[cname] = dataset;
+      epicsMutexUnlock(datasetsMutex);
     }
-    H5Tclose(ntype_id);
-    H5Tclose(type_id);
-    H5Sclose(dspace_id);
-    H5Dclose(dset_id);
-    free(dims);
   }
   if (type == H5G_GROUP){
     H5Giterate(loc_id, name, NULL, file_mem_info, this);
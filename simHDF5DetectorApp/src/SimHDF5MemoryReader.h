@@ -14,8 +14,11 @@
 #include <map>
 #include <vector>
 #include <tr1/memory>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
 #include "NDArray.h"
 #include "SimHDF5Reader.h"
+#include "SimHDF5FrameStore.h"
 
 class SimHDF5MemoryReader : public SimHDF5Reader
 {
@@ -26,20 +29,30 @@ public:
   std::string getFilename();
   bool validateFilename();
   int fileExists();
-  void loadFile();
+  bool loadFile();
   void unloadFile();
 
   std::vector<std::string> getDatasetKeys();
-  std::vector<int> getDatasetDimensions(const std::string& dname);
-  std::vector<int> parseDatasetDimensions(const std::string& dname);
+  std::vector<hsize_t> getDatasetDimensions(const std::string& dname);
+  std::vector<hsize_t> parseDatasetDimensions(const std::string& dname);
   NDDataType_t getDatasetType(const std::string& dname);
   NDDataType_t parseDatasetType(const std::string& dname);
   int dataTypeToBytes(NDDataType_t NDType);
   void prepareToReadDataset(const std::string& dname);
-  void readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data);
-  void readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int *indexes, void *data);
-  void parseDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int *indexes, void *data);
+  bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data);
+  bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, void *data);
+  bool readColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes, void *data);
+  bool readFramesFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, int nframes, void *data);
   void cleanupDataset();
+  void setSharedStore(bool shared);
+  void setSnapshotDir(const std::string& dir);
+  void setNumaNode(int node);
+  int setLockMemory(bool lock);
+  size_t getLockedBytes();
+  int getLockError();
+  bool readColumn(const std::string& path, std::vector<double>& values, bool *integer);
+  bool preloadDataset(const std::string& dname, size_t *done, size_t *total);
+  void cancelPreload();
   void process(hid_t loc_id, const char *name, H5G_obj_t type);
 
 private:
@@ -47,82 +60,121 @@ private:
   std::string filename;
   std::string cname;
   bool fileLoaded;
-  hid_t dset_id;
-  hid_t dspace_id;
-  int ndims;
-  hsize_t *dims;
-  hid_t type_id;
-  hid_t ntype_id;
   bool reading;
-  bool inMemory;
-  void *rawPtr;
-  std::vector<int> memDims;
-  NDDataType_t memDatatype;
+  bool sharedStore;                // Place frame stores in shared memory
+  std::string snapshotDir;         // Directory for frame store snapshots, empty for none
+  int numaNode;                    // NUMA node for newly loaded frame stores, -1 for any
+  bool lockStores;                 // Lock frame stores into memory
+  int lockError;                   // Error number of the last lock that failed, 0 if none did
+  epicsMutexId hdf5Mutex;          // Serialises HDF5 calls from the loader and acquisition threads
+  epicsMutexId datasetsMutex;      // Guards the dataset map and the store of each dataset for readers
+  epicsEventId residentEvent;      // Signalled when more frames of a dataset become resident
 
-  class HDF5RawImage
+  class HDF5MemDataset
   {
   public:
-    HDF5RawImage(int width, int height, int dataSize)
+    HDF5MemDataset(const std::string& name, std::vector<hsize_t> dimensions, NDDataType_t datatype)
     {
-      this->width = width;
-      this->height = height;
-      this->dataSize = dataSize;
-      this->rawPtr = malloc(width*height*dataSize);
+      this->name = name;
+      this->dimensions = dimensions;
+      this->datatype = datatype;
+      this->resident = 0;
+      this->loading = false;
+      this->failure = false;
+    };
+
+    std::vector<hsize_t> getDimensions()
+    {
+      return this->dimensions;
     }
 
-    int getAllocatedBytes()
+    NDDataType_t getDataType()
     {
-      return this->width*this->height*this->dataSize;
+      return this->datatype;
     }
 
-    void *getRawPtr()
+    std::tr1::shared_ptr<SimHDF5FrameStore> getStore()
     {
-      return this->rawPtr;
+      return this->store;
     }
 
-  private:
-    int width;
-    int height;
-    int dataSize;
-    void *rawPtr;
-  };
+    void setStore(std::tr1::shared_ptr<SimHDF5FrameStore> store)
+    {
+      this->store = store;
+    }
 
-  class HDF5MemDataset
-  {
-  public:
-    HDF5MemDataset(const std::string& name, std::vector<int> dimensions, NDDataType_t datatype, std::vector<std::tr1::shared_ptr<HDF5RawImage> > rawImages)
+    // The resident size and loading flag are read by the acquisition
+    // thread while the loader thread fills the store
+    size_t getResident()
     {
-      this->name = name;
-      this->dimensions = dimensions;
-      this->datatype = datatype;
-      this->rawImages = rawImages;
-    };
+      return __atomic_load_n(&this->resident, __ATOMIC_ACQUIRE);
+    }
 
-    std::vector<int> getDimensions()
+    void setResident(size_t bytes)
     {
-      return this->dimensions;
+      __atomic_store_n(&this->resident, bytes, __ATOMIC_RELEASE);
     }
 
-    NDDataType_t getDataType()
+    bool isLoading()
     {
-      return this->datatype;
+      return __atomic_load_n(&this->loading, __ATOMIC_ACQUIRE);
     }
 
-    std::tr1::shared_ptr<HDF5RawImage> getImage(int index)
+    void setLoading(bool loading)
     {
-      return rawImages[index%rawImages.size()];
+      __atomic_store_n(&this->loading, loading, __ATOMIC_RELEASE);
+    }
+
+    bool isFailed()
+    {
+      return __atomic_load_n(&this->failure, __ATOMIC_ACQUIRE);
+    }
+
+    void setFailed(bool failure)
+    {
+      __atomic_store_n(&this->failure, failure, __ATOMIC_RELEASE);
     }
 
     virtual ~HDF5MemDataset(){};
 
   private:
     std::string name;
-    std::vector<int> dimensions;
+    std::vector<hsize_t> dimensions;
     NDDataType_t datatype;
-    std::vector<std::tr1::shared_ptr<HDF5RawImage> > rawImages;
+    std::tr1::shared_ptr<SimHDF5FrameStore> store;
+    size_t resident;          // Bytes from the start of the store that have been loaded
+    bool loading;             // The store is being filled
+    bool failure;             // The last load of the store failed before it was filled
   };
 
+  /** A dataset being loaded into its frame store in slabs of the first dimension */
+  struct DatasetLoad
+  {
+    DatasetLoad() : dset(-1), ntype(-1), rows(0), next(0), step(1), rowBytes(0) {}
+    std::string dname;        // Name of the dataset, empty when no load is in progress
+    hid_t dset;               // Open dataset
+    hid_t ntype;              // Native type the frames are read as
+    hsize_t rows;             // Size of the first dimension
+    hsize_t next;             // First row of the next slab
+    hsize_t step;             // Number of rows read by each slab
+    size_t rowBytes;          // Size of one row of the first dimension in bytes
+    std::string snapshot;     // Snapshot written when the load completes, empty for none
+    std::tr1::shared_ptr<SimHDF5FrameStore> store;
+  };
+
+  void loadDataset(const std::string& dname);
+  bool beginLoad(const std::string& dname, DatasetLoad& load);
+  bool loadSlab(DatasetLoad& load);
+  void endLoad(DatasetLoad& load, bool complete);
+  void lockStore(std::tr1::shared_ptr<SimHDF5FrameStore> store);
+  void setDatasetStore(HDF5MemDataset *dataset, std::tr1::shared_ptr<SimHDF5FrameStore> store);
+  std::tr1::shared_ptr<HDF5MemDataset> findDataset(const std::string& dname, std::tr1::shared_ptr<SimHDF5FrameStore> *store);
+  void followLoad(HDF5MemDataset *dataset);
+  void waitResident(HDF5MemDataset *dataset, size_t bytes);
+  char *frameOrigin(HDF5MemDataset *dataset, SimHDF5FrameStore *store, int minX, int minY, int wdim, int hdim, int skipdim, hsize_t *indexes, size_t *strides);
+
   std::map<std::string, std::tr1::shared_ptr<HDF5MemDataset> > datasets;
+  DatasetLoad preload;             // Dataset being preloaded by preloadDataset
 
 };
 
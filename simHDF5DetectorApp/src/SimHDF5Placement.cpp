@@ -0,0 +1,159 @@
+/*
+ * SimHDF5Placement.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "SimHDF5Placement.h"
+#include <sched.h>
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef WITH_NUMA
+#include <numa.h>
+#endif
+
+/** Parse a CPU list into a CPU set.
+  * \param[in] cpus list of CPUs and ranges separated by commas, such as "0-3,8"
+  * \param[out] set the CPUs in the list
+  * \return false if the list cannot be parsed or names no CPUs.
+  */
+static bool parseCPUs(const std::string& cpus, cpu_set_t *set)
+{
+  CPU_ZERO(set);
+  const char *ptr = cpus.c_str();
+  while (*ptr != '\0'){
+    char *end = NULL;
+    if (*ptr == ',' || *ptr == ' '){
+      ptr++;
+      continue;
+    }
+    long first = strtol(ptr, &end, 10);
+    if (end == ptr || first < 0){
+      return false;
+    }
+    long last = first;
+    ptr = end;
+    if (*ptr == '-'){
+      ptr++;
+      last = strtol(ptr, &end, 10);
+      if (end == ptr || last < first){
+        return false;
+      }
+      ptr = end;
+    }
+    if (last >= CPU_SETSIZE){
+      return false;
+    }
+    for (long cpu = first; cpu <= last; cpu++){
+      CPU_SET(cpu, set);
+    }
+    if (*ptr != '\0' && *ptr != ',' && *ptr != ' '){
+      return false;
+    }
+  }
+  return CPU_COUNT(set) > 0;
+}
+
+/** Check a CPU list.
+  * \param[in] cpus the CPU list, empty for every CPU
+  * \return false if the list cannot be parsed.
+  */
+bool SimHDF5Placement::validCPUs(const std::string& cpus)
+{
+  cpu_set_t set;
+  return cpus.empty() || parseCPUs(cpus, &set);
+}
+
+/** Place the calling thread on a set of CPUs with a scheduling priority.
+  * \param[in] cpus the CPU list, empty for every CPU
+  * \param[in] priority SCHED_FIFO priority from 1 to 99, 0 for normal
+  *            SCHED_OTHER scheduling or -1 to leave the scheduling as it is
+  * \return 0 on success, otherwise the error number of the call that failed.
+  *
+  * Real time priorities need CAP_SYS_NICE or a suitable RLIMIT_RTPRIO.
+  */
+int SimHDF5Placement::applyToThread(const std::string& cpus, int priority)
+{
+  cpu_set_t set;
+  int status = 0;
+  if (cpus.empty()){
+    // Allow every configured CPU
+    CPU_ZERO(&set);
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    for (long cpu = 0; cpu < count && cpu < CPU_SETSIZE; cpu++){
+      CPU_SET(cpu, &set);
+    }
+  } else if (!parseCPUs(cpus, &set)){
+    return EINVAL;
+  }
+  status = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (status == 0 && priority >= 0){
+    struct sched_param param;
+    param.sched_priority = priority;
+    status = pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+  }
+  return status;
+}
+
+/** Return the NUMA node of the first CPU in a CPU list.
+  * \param[in] cpus the CPU list
+  * \return the node, or -1 if the list is empty or NUMA support is not built.
+  */
+int SimHDF5Placement::nodeOfCPUs(const std::string& cpus)
+{
+  int node = -1;
+#ifdef WITH_NUMA
+  cpu_set_t set;
+  if (!cpus.empty() && numa_available() >= 0 && parseCPUs(cpus, &set)){
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+      if (CPU_ISSET(cpu, &set)){
+        node = numa_node_of_cpu(cpu);
+        break;
+      }
+    }
+  }
+#endif
+  return node;
+}
+
+/** Prefer a NUMA node for memory allocated by the calling thread.
+  * \param[in] node the node, or -1 to allocate on the local node
+  *
+  * Does nothing unless NUMA support is built.
+  */
+void SimHDF5Placement::preferNode(int node)
+{
+#ifdef WITH_NUMA
+  if (numa_available() >= 0){
+    numa_set_preferred(node);
+  }
+#endif
+}
+
+/** Place a block of memory on a NUMA node before it is first touched.
+  * \param[in] addr start of the block
+  * \param[in] bytes size of the block
+  * \param[in] node the node
+  * \return false if the memory was not placed.
+  *
+  * Pages that are already present are not moved.  Does nothing unless NUMA
+  * support is built.
+  */
+bool SimHDF5Placement::bindMemory(void *addr, size_t bytes, int node)
+{
+#ifdef WITH_NUMA
+  if (node >= 0 && bytes > 0 && numa_available() >= 0){
+    // The block must start on a page boundary
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t offset = (size_t)addr % page;
+    numa_tonode_memory((char *)addr - offset, bytes + offset, node);
+    return true;
+  }
+#endif
+  return false;
+}
@@ -0,0 +1,31 @@
+/*
+ * SimHDF5Placement.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5PLACEMENT_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5PLACEMENT_H_
+
+#include <stddef.h>
+#include <string>
+
+/** Helpers that place threads on CPUs and memory on NUMA nodes.
+  *
+  * CPU sets are given as lists such as "0-7,16-23", an empty list allowing
+  * every CPU.  Threads always place themselves, so each thread applies its
+  * own settings.  NUMA placement of memory is only available when built
+  * with WITH_NUMA, otherwise memory is placed by the kernel when it is
+  * first touched.
+  */
+class SimHDF5Placement
+{
+public:
+  static bool validCPUs(const std::string& cpus);
+  static int applyToThread(const std::string& cpus, int priority);
+  static int nodeOfCPUs(const std::string& cpus);
+  static void preferNode(int node);
+  static bool bindMemory(void *addr, size_t bytes, int node);
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5PLACEMENT_H_ */
@@ -0,0 +1,916 @@
+/*
+ * SimHDF5ProcessReader.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "SimHDF5ProcessReader.h"
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+/** Enumeration of the commands handled by a worker process */
+typedef enum
+{
+  SimHDF5WorkerOpen,          // Open the file named in the request
+  SimHDF5WorkerUnload,        // Close the file
+  SimHDF5WorkerConfigure,     // Select the read engine
+  SimHDF5WorkerRead,          // Read frames into the slot
+  SimHDF5WorkerCleanup,       // Close the datasets prepared for reading
+  SimHDF5WorkerExit           // Exit the process
+} SimHDF5WorkerCommand_t;
+
+/** Enumeration of the read functions called for a read */
+typedef enum
+{
+  SimHDF5WorkerReadImage,     // A frame of a two dimensional dataset
+  SimHDF5WorkerReadFrame,     // A frame at the given indexes
+  SimHDF5WorkerReadColor,     // The three colours of a frame
+  SimHDF5WorkerReadFrames     // Consecutive frames
+} SimHDF5WorkerRead_t;
+
+/** Return the size in bytes of an element of an NDArray data type.
+  * \param[in] type the data type.
+  */
+static size_t typeBytes(NDDataType_t type)
+{
+  switch (type){
+    case NDInt8:
+    case NDUInt8:
+      return 1;
+    case NDInt16:
+    case NDUInt16:
+      return 2;
+    case NDInt32:
+    case NDUInt32:
+    case NDFloat32:
+      return 4;
+    default:
+      return 8;
+  }
+}
+
+/** Send or receive a whole message on a socket.
+  * \param[in] fd the socket.
+  * \param[in] buffer the message.
+  * \param[in] bytes size of the message.
+  * \param[in] sending true to send, false to receive.
+  * \return false if the other end has gone away.
+  */
+static bool transfer(int fd, void *buffer, size_t bytes, bool sending)
+{
+  char *ptr = (char *)buffer;
+  while (bytes > 0){
+    ssize_t done = sending ? ::send(fd, ptr, bytes, MSG_NOSIGNAL) : ::recv(fd, ptr, bytes, 0);
+    if (done < 0 && errno == EINTR){
+      continue;
+    }
+    if (done <= 0){
+      return false;
+    }
+    ptr += done;
+    bytes -= done;
+  }
+  return true;
+}
+
+/** Close every descriptor inherited from the IOC that a worker does not use.
+  * \param[in] sock socket carrying requests and replies.
+  * \param[in] shmFd shared memory holding the slot frames are read into.
+  *
+  * Standard input, output and error are kept.  Without this a worker would
+  * hold the IOC's files, sockets and shared memory open after the IOC has
+  * closed them.
+  */
+static void closeInherited(int sock, int shmFd)
+{
+  std::vector<int> fds;
+  DIR *dir = opendir("/proc/self/fd");
+  if (dir){
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL){
+      if (entry->d_name[0] != '.'){
+        fds.push_back(atoi(entry->d_name));
+      }
+    }
+    int dirFd = dirfd(dir);
+    for (size_t index = 0; index < fds.size(); index++){
+      if (fds[index] == dirFd){
+        fds[index] = -1;
+      }
+    }
+    closedir(dir);
+  } else {
+    long maxFd = sysconf(_SC_OPEN_MAX);
+    for (long fd = 0; fd < maxFd; fd++){
+      fds.push_back((int)fd);
+    }
+  }
+  for (size_t index = 0; index < fds.size(); index++){
+    if (fds[index] > STDERR_FILENO && fds[index] != sock && fds[index] != shmFd){
+      close(fds[index]);
+    }
+  }
+}
+
+/** Main loop of a worker process.
+  * \param[in] sock socket carrying requests and replies.
+  * \param[in] shmFd shared memory holding the slot frames are read into.
+  *
+  * Never returns.  The worker exits when asked to, or when the IOC goes
+  * away and the socket is closed.
+  */
+static void workerMain(int sock, int shmFd)
+{
+  // Do not outlive the IOC
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+  signal(SIGINT, SIG_IGN);
+
+  SimHDF5FileReader reader;
+  bool loaded = false;
+  std::set<std::string> names;
+  void *slot = NULL;
+  size_t slotBytes = 0;
+  SimHDF5WorkerRequest request;
+  SimHDF5WorkerReply reply;
+  bool readOk = true;
+
+  while (transfer(sock, &request, sizeof(request), false)){
+    reply.status = 0;
+    request.path[SIMHDF5_WORKER_PATH_LEN - 1] = '\0';
+    switch (request.command){
+      case SimHDF5WorkerOpen:
+        if (loaded){
+          reader.unloadFile();
+        }
+        reader.setFileDriver(request.driver);
+        reader.setFilename(request.path);
+        loaded = reader.validateFilename() && reader.loadFile();
+        names.clear();
+        if (loaded){
+          std::vector<std::string> keys = reader.getDatasetKeys();
+          names.insert(keys.begin(), keys.end());
+        } else {
+          reply.status = -1;
+        }
+        break;
+      case SimHDF5WorkerUnload:
+        if (loaded){
+          reader.unloadFile();
+          loaded = false;
+        }
+        names.clear();
+        break;
+      case SimHDF5WorkerConfigure:
+        reader.setReadEngine(request.engine, request.queueDepth, request.directIO != 0, request.readahead);
+        break;
+      case SimHDF5WorkerRead:
+        if (!loaded || names.count(request.path) == 0){
+          reply.status = -1;
+          break;
+        }
+        if (slotBytes < request.bytes){
+          // The slot has grown since it was mapped
+          if (slot){
+            munmap(slot, slotBytes);
+          }
+          slot = mmap(NULL, request.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+          slotBytes = request.bytes;
+          if (slot == MAP_FAILED){
+            slot = NULL;
+            slotBytes = 0;
+            reply.status = -1;
+            break;
+          }
+        }
+        reader.prepareToReadDataset(request.path);
+        switch (request.kind){
+          case SimHDF5WorkerReadImage:
+            readOk = reader.readFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                            request.wdim, request.hdim, slot);
+            break;
+          case SimHDF5WorkerReadColor:
+            readOk = reader.readColorFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                                 request.wdim, request.hdim, request.cdim, request.indexes, slot);
+            break;
+          case SimHDF5WorkerReadFrames:
+            readOk = reader.readFramesFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                                  request.wdim, request.hdim, request.indexes, request.nframes, slot);
+            break;
+          default:
+            readOk = reader.readFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                            request.wdim, request.hdim, request.indexes, slot);
+            break;
+        }
+        if (!readOk){
+          reply.status = -1;
+        }
+        break;
+      case SimHDF5WorkerCleanup:
+        reader.cleanupDataset();
+        break;
+      case SimHDF5WorkerExit:
+        _exit(0);
+    }
+    reply.engine = reader.getReadEngine();
+    if (!transfer(sock, &reply, sizeof(reply), true)){
+      break;
+    }
+  }
+  _exit(0);
+}
+
+/** Constructor.
+  * \param[in] workers number of worker processes to fork.
+  */
+SimHDF5ProcessReader::SimHDF5ProcessReader(int workers) :
+  local(new SimHDF5FileReader()),
+  nextWorker(0),
+  engineType(SimHDF5EngineHDF5),
+  engineQueueDepth(1),
+  engineDirectIO(false),
+  engineReadahead(0),
+  activeEngine(SimHDF5EngineHDF5),
+  fileDriver(SimHDF5DriverSec2)
+{
+  this->mutex = epicsMutexMustCreate();
+  startWorkers(workers);
+}
+
+/** Destructor.
+  *
+  * Asks the workers to exit and waits for them.
+  */
+SimHDF5ProcessReader::~SimHDF5ProcessReader()
+{
+  broadcast(SimHDF5WorkerExit);
+  for (size_t index = 0; index < workers.size(); index++){
+    Worker& worker = workers[index];
+    if (worker.pid > 0){
+      waitpid(worker.pid, NULL, 0);
+    }
+    if (worker.slot){
+      munmap(worker.slot, worker.slotBytes);
+    }
+    close(worker.socket);
+    close(worker.shmFd);
+  }
+  epicsMutexDestroy(this->mutex);
+}
+
+/** Fork the worker processes.
+  * \param[in] count number of workers.
+  *
+  * Each worker is given a socket and an unnamed shared memory object for
+  * its slot.  The slot starts empty and is grown as frames need it.
+  */
+void SimHDF5ProcessReader::startWorkers(int count)
+{
+  char name[64];
+  for (int index = 0; index < count; index++){
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0){
+      printf("SimHDF5ProcessReader: unable to create the socket for worker %d, error %d\n", index, errno);
+      break;
+    }
+    snprintf(name, sizeof(name), "/simHDF5Worker-%d-%d", (int)getpid(), index);
+    int shmFd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (shmFd < 0){
+      printf("SimHDF5ProcessReader: unable to create the slot for worker %d, error %d\n", index, errno);
+      close(fds[0]);
+      close(fds[1]);
+      break;
+    }
+    // Only the descriptor is needed, which the worker inherits
+    shm_unlink(name);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0){
+      // Keep only the descriptors of this worker
+      closeInherited(fds[1], shmFd);
+      workerMain(fds[1], shmFd);
+    }
+    close(fds[1]);
+    if (pid < 0){
+      printf("SimHDF5ProcessReader: unable to fork worker %d, error %d\n", index, errno);
+      close(fds[0]);
+      close(shmFd);
+      break;
+    }
+    Worker worker;
+    memset(&worker, 0, sizeof(worker));
+    worker.pid = pid;
+    worker.socket = fds[0];
+    worker.shmFd = shmFd;
+    workers.push_back(worker);
+  }
+}
+
+/** Send a request to a worker.
+  * \param[in] worker the worker, which must not be busy.
+  * \param[in] request the request.
+  * \return false if the worker has died.
+  */
+bool SimHDF5ProcessReader::send(Worker& worker, const SimHDF5WorkerRequest& request)
+{
+  if (worker.pid <= 0){
+    return false;
+  }
+  if (request.command == SimHDF5WorkerRead && worker.slotBytes < request.bytes){
+    // Grow the slot, which the worker maps again when it sees the larger read
+    if (worker.slot){
+      munmap(worker.slot, worker.slotBytes);
+      worker.slot = NULL;
+      worker.slotBytes = 0;
+    }
+    if (ftruncate(worker.shmFd, request.bytes) != 0){
+      return false;
+    }
+    void *slot = mmap(NULL, request.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, worker.shmFd, 0);
+    if (slot == MAP_FAILED){
+      return false;
+    }
+    worker.slot = slot;
+    worker.slotBytes = request.bytes;
+  }
+  worker.request = request;
+  worker.ready = false;
+  worker.busy = transfer(worker.socket, &worker.request, sizeof(worker.request), true);
+  if (!worker.busy){
+    failed(worker);
+  }
+  return worker.busy;
+}
+
+/** Wait for the reply to the request a worker is busy with.
+  * \param[in] worker the worker.
+  * \return true if the request succeeded.
+  */
+bool SimHDF5ProcessReader::collect(Worker& worker)
+{
+  SimHDF5WorkerReply reply;
+  if (!worker.busy){
+    return worker.ready;
+  }
+  worker.busy = false;
+  if (!transfer(worker.socket, &reply, sizeof(reply), false)){
+    failed(worker);
+    return false;
+  }
+  if (worker.request.command == SimHDF5WorkerRead){
+    worker.ready = (reply.status == 0);
+    activeEngine = reply.engine;
+  }
+  return reply.status == 0;
+}
+
+/** Collect the reply of a busy worker if it has already arrived.
+  * \param[in] worker the worker.
+  */
+void SimHDF5ProcessReader::poll(Worker& worker)
+{
+  struct pollfd fd;
+  if (!worker.busy){
+    return;
+  }
+  fd.fd = worker.socket;
+  fd.events = POLLIN;
+  fd.revents = 0;
+  if (::poll(&fd, 1, 0) > 0){
+    collect(worker);
+  }
+}
+
+/** Send the same command to every worker and wait for them all.
+  * \param[in] command one of the SimHDF5WorkerCommand_t values.
+  */
+void SimHDF5ProcessReader::broadcast(int command)
+{
+  SimHDF5WorkerRequest request;
+  memset(&request, 0, sizeof(request));
+  request.command = command;
+  request.engine = engineType;
+  request.queueDepth = engineQueueDepth;
+  request.directIO = engineDirectIO ? 1 : 0;
+  request.readahead = engineReadahead;
+  request.driver = fileDriver;
+  strncpy(request.path, local->getFilename().c_str(), SIMHDF5_WORKER_PATH_LEN - 1);
+
+  epicsMutexLock(this->mutex);
+  for (size_t index = 0; index < workers.size(); index++){
+    collect(workers[index]);
+    workers[index].ready = false;
+    if (!send(workers[index], request) && command != SimHDF5WorkerExit){
+      printf("SimHDF5ProcessReader: worker %d is not running\n", (int)index);
+    }
+  }
+  if (command != SimHDF5WorkerExit){
+    for (size_t index = 0; index < workers.size(); index++){
+      bool running = workers[index].busy;
+      if (!collect(workers[index]) && running && workers[index].pid > 0 && command == SimHDF5WorkerOpen){
+        // Its reads fail and are made in this process instead
+        printf("SimHDF5ProcessReader: worker %d could not open %s\n", (int)index, request.path);
+      }
+    }
+  }
+  epicsMutexUnlock(this->mutex);
+}
+
+/** Stop using a worker that has died.
+  * \param[in] worker the worker.
+  */
+void SimHDF5ProcessReader::failed(Worker& worker)
+{
+  if (worker.pid > 0){
+    printf("SimHDF5ProcessReader: worker process %d has stopped, reading in the IOC instead\n", (int)worker.pid);
+    waitpid(worker.pid, NULL, WNOHANG);
+  }
+  worker.pid = 0;
+  worker.busy = false;
+  worker.ready = false;
+}
+
+/** Return whether two reads produce the same frames.
+  * \param[in] a first read.
+  * \param[in] b second read.
+  */
+bool SimHDF5ProcessReader::sameFrames(const SimHDF5WorkerRequest& a, const SimHDF5WorkerRequest& b)
+{
+  return a.command == SimHDF5WorkerRead && b.command == SimHDF5WorkerRead &&
+         a.kind == b.kind && a.minX == b.minX && a.minY == b.minY &&
+         a.sizeX == b.sizeX && a.sizeY == b.sizeY && a.wdim == b.wdim && a.hdim == b.hdim &&
+         a.cdim == b.cdim && a.nframes == b.nframes && a.nindexes == b.nindexes &&
+         memcmp(a.indexes, b.indexes, a.nindexes * sizeof(hsize_t)) == 0 &&
+         strcmp(a.path, b.path) == 0;
+}
+
+/** Fill in a read request.
+  *
+  * The number of frame indexes and the size of the frames are taken from
+  * the dataset.
+  */
+void SimHDF5ProcessReader::makeRequest(int kind, const std::string& dname, int minX, int minY, int sizeX, int sizeY,
+                                       int wdim, int hdim, int cdim, hsize_t *indexes, int nframes, SimHDF5WorkerRequest *request)
+{
+  memset(request, 0, sizeof(*request));
+  request->command = SimHDF5WorkerRead;
+  request->kind = kind;
+  strncpy(request->path, dname.c_str(), SIMHDF5_WORKER_PATH_LEN - 1);
+  request->minX = minX;
+  request->minY = minY;
+  request->sizeX = sizeX;
+  request->sizeY = sizeY;
+  request->wdim = wdim;
+  request->hdim = hdim;
+  request->cdim = cdim;
+  request->nframes = nframes;
+  if (indexes){
+    int ndims = (int)local->getDatasetDimensions(dname).size();
+    request->nindexes = ndims > 2 ? ndims - 2 : 0;
+    if (request->nindexes > SIMHDF5_WORKER_MAX_INDEXES){
+      request->nindexes = SIMHDF5_WORKER_MAX_INDEXES;
+    }
+    memcpy(request->indexes, indexes, request->nindexes * sizeof(hsize_t));
+  }
+  request->bytes = (size_t)sizeX * sizeY * typeBytes(local->getDatasetType(dname)) *
+                   (kind == SimHDF5WorkerReadColor ? 3 : nframes);
+}
+
+/** Find the worker reading or holding the frames of a read.
+  * \param[in] request the read.
+  * \return the worker, or NULL if there is none.
+  */
+SimHDF5ProcessReader::Worker *SimHDF5ProcessReader::holding(const SimHDF5WorkerRequest& request)
+{
+  for (size_t index = 0; index < workers.size(); index++){
+    if ((workers[index].busy || workers[index].ready) && sameFrames(workers[index].request, request)){
+      return &workers[index];
+    }
+  }
+  return NULL;
+}
+
+/** Find a worker that is neither reading nor holding a frame.
+  * \return the worker, or NULL if there is none.
+  */
+SimHDF5ProcessReader::Worker *SimHDF5ProcessReader::idle()
+{
+  for (size_t index = 0; index < workers.size(); index++){
+    poll(workers[index]);
+    if (workers[index].pid > 0 && !workers[index].busy && !workers[index].ready){
+      return &workers[index];
+    }
+  }
+  return NULL;
+}
+
+/** Split a read into parts that the workers can read in parallel.
+  * \param[in] request the read.
+  * \param[out] parts the parts.
+  * \param[out] offsets offset in bytes of each part in the frames.
+  *
+  * A stack is split into its frames, so that each frame can be matched
+  * with one that was prefetched.  A single frame of at least
+  * SIMHDF5_WORKER_SPLIT_BYTES is split into one band of rows for each
+  * worker, with the bands on chunk boundaries so that no chunk is
+  * decompressed by two workers.  Colour images are not split.
+  */
+void SimHDF5ProcessReader::splitRequest(const SimHDF5WorkerRequest& request, std::vector<SimHDF5WorkerRequest>& parts, std::vector<size_t>& offsets)
+{
+  SimHDF5WorkerRequest part = request;
+  if (request.kind == SimHDF5WorkerReadFrames && request.nframes > 1){
+    std::vector<hsize_t> dims = local->getDatasetDimensions(request.path);
+    int framedims[SIMHDF5_WORKER_MAX_INDEXES];
+    int nframedims = 0;
+    for (int index = 0; index < (int)dims.size() && nframedims < request.nindexes; index++){
+      if (index != request.wdim && index != request.hdim){
+        framedims[nframedims++] = index;
+      }
+    }
+    size_t frameBytes = request.bytes / request.nframes;
+    part.kind = SimHDF5WorkerReadFrame;
+    part.nframes = 1;
+    part.bytes = frameBytes;
+    for (int frame = 0; frame < request.nframes; frame++){
+      parts.push_back(part);
+      offsets.push_back(frame * frameBytes);
+      if (nframedims < 1){
+        continue;
+      }
+      // Move to the next frame
+      part.indexes[nframedims-1]++;
+      for (int i = nframedims-1; i > 0 && part.indexes[i] >= dims[framedims[i]]; i--){
+        part.indexes[i] = 0;
+        part.indexes[i-1]++;
+      }
+      if (part.indexes[0] >= dims[framedims[0]]){
+        part.indexes[0] = 0;
+      }
+    }
+    return;
+  }
+
+  int running = 0;
+  for (size_t index = 0; index < workers.size(); index++){
+    if (workers[index].pid > 0){
+      running++;
+    }
+  }
+  if (request.kind == SimHDF5WorkerReadColor || request.nframes != 1 || running < 2 ||
+      request.sizeY < 2 || request.bytes < SIMHDF5_WORKER_SPLIT_BYTES){
+    parts.push_back(request);
+    offsets.push_back(0);
+    return;
+  }
+  if (chunkDims.count(request.path) == 0){
+    chunkDims[request.path] = local->getChunkDimensions(request.path);
+  }
+  const std::vector<hsize_t>& chunk = chunkDims[request.path];
+  int chunkRows = 1;
+  if (request.hdim < (int)chunk.size() && chunk[request.hdim] > 0){
+    chunkRows = (int)chunk[request.hdim];
+  }
+  int firstChunk = request.minY / chunkRows;
+  int chunks = (request.minY + request.sizeY - 1) / chunkRows - firstChunk + 1;
+  int bands = chunks < running ? chunks : running;
+  size_t rowBytes = request.bytes / request.sizeY;
+  int end = request.minY + request.sizeY;
+  int y = request.minY;
+  for (int band = 0; band < bands; band++){
+    int next = end;
+    if (band < bands - 1){
+      next = (firstChunk + (int)((long long)chunks * (band + 1) / bands)) * chunkRows;
+    }
+    part.minY = y;
+    part.sizeY = next - y;
+    part.bytes = part.sizeY * rowBytes;
+    parts.push_back(part);
+    offsets.push_back((y - request.minY) * rowBytes);
+    y = next;
+  }
+}
+
+/** Read frames through the workers.
+  * \param[in] request the read.
+  * \param[out] data the frames.
+  * \return false if the frames could not be read.
+  *
+  * A worker already reading or holding the same frames is waited for.
+  * Otherwise the read is split into parts, and each part is given to a
+  * worker already reading or holding it, to an idle worker, or failing
+  * that to the next worker in the ring.  The parts are read in parallel and
+  * collected once all have been handed out.  A part that no worker could
+  * read is read in this process.
+  */
+bool SimHDF5ProcessReader::read(const SimHDF5WorkerRequest& request, void *data)
+{
+  std::vector<SimHDF5WorkerRequest> parts;
+  std::vector<size_t> offsets;
+  bool status = true;
+  epicsMutexLock(this->mutex);
+  if (holding(request) || workers.empty()){
+    parts.push_back(request);
+    offsets.push_back(0);
+  } else {
+    splitRequest(request, parts, offsets);
+  }
+  std::vector<Worker *> assigned(parts.size(), (Worker *)NULL);
+  for (size_t part = 0; part < parts.size(); part++){
+    Worker *worker = holding(parts[part]);
+    if (!worker){
+      worker = idle();
+      if (worker && !send(*worker, parts[part])){
+        worker = NULL;
+      }
+    }
+    for (size_t tries = 0; tries < workers.size() && !worker; tries++){
+      Worker& next = workers[nextWorker];
+      nextWorker = (nextWorker + 1) % workers.size();
+      if (next.pid <= 0){
+        continue;
+      }
+      // A worker still reading an earlier part of this read finishes it first
+      for (size_t other = 0; other < part; other++){
+        if (assigned[other] == &next){
+          status = finish(assigned[other], parts[other], (char *)data + offsets[other]) && status;
+          assigned[other] = NULL;
+        }
+      }
+      collect(next);
+      if (send(next, parts[part])){
+        worker = &next;
+      }
+    }
+    if (worker){
+      assigned[part] = worker;
+    } else {
+      status = readLocal(parts[part], (char *)data + offsets[part]) && status;
+    }
+  }
+  for (size_t part = 0; part < parts.size(); part++){
+    if (assigned[part]){
+      status = finish(assigned[part], parts[part], (char *)data + offsets[part]) && status;
+    }
+  }
+  epicsMutexUnlock(this->mutex);
+  return status;
+}
+
+/** Collect a part of a read from the worker it was given to.
+  * \param[in] worker the worker.
+  * \param[in] request the part.
+  * \param[out] data where the frames of the part are copied to.
+  * \return false if the frames could not be read.
+  *
+  * If the worker failed the part is read in this process instead.
+  */
+bool SimHDF5ProcessReader::finish(Worker *worker, const SimHDF5WorkerRequest& request, void *data)
+{
+  if (collect(*worker)){
+    memcpy(data, worker->slot, request.bytes);
+    worker->ready = false;
+    return true;
+  }
+  return readLocal(request, data);
+}
+
+/** Read frames in this process.
+  * \param[in] request the read.
+  * \param[out] data the frames.
+  * \return false if the frames could not be read.
+  */
+bool SimHDF5ProcessReader::readLocal(const SimHDF5WorkerRequest& request, void *data)
+{
+  hsize_t indexes[SIMHDF5_WORKER_MAX_INDEXES];
+  memcpy(indexes, request.indexes, sizeof(indexes));
+  if (local->getDatasetDimensions(request.path).empty()){
+    // The dataset does not exist
+    return false;
+  }
+  local->prepareToReadDataset(request.path);
+  switch (request.kind){
+    case SimHDF5WorkerReadImage:
+      return local->readFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                    request.wdim, request.hdim, data);
+    case SimHDF5WorkerReadColor:
+      return local->readColorFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                         request.wdim, request.hdim, request.cdim, indexes, data);
+    case SimHDF5WorkerReadFrames:
+      return local->readFramesFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                          request.wdim, request.hdim, indexes, request.nframes, data);
+    default:
+      return local->readFromDataset(request.path, request.minX, request.minY, request.sizeX, request.sizeY,
+                                    request.wdim, request.hdim, indexes, data);
+  }
+}
+
+void SimHDF5ProcessReader::setFilename(const std::string &filename)
+{
+  local->setFilename(filename);
+}
+
+std::string SimHDF5ProcessReader::getFilename()
+{
+  return local->getFilename();
+}
+
+bool SimHDF5ProcessReader::validateFilename()
+{
+  return local->validateFilename();
+}
+
+int SimHDF5ProcessReader::fileExists()
+{
+  return local->fileExists();
+}
+
+/** Open the file in this process and in every worker.
+  *
+  * This process always uses the default file driver, as it only reads the
+  * names, sizes and types of the datasets.
+  */
+bool SimHDF5ProcessReader::loadFile()
+{
+  epicsMutexLock(this->mutex);
+  chunkDims.clear();
+  epicsMutexUnlock(this->mutex);
+  if (!local->loadFile()){
+    // Workers must not go on reading the previous file
+    broadcast(SimHDF5WorkerUnload);
+    return false;
+  }
+  broadcast(SimHDF5WorkerOpen);
+  return true;
+}
+
+void SimHDF5ProcessReader::unloadFile()
+{
+  broadcast(SimHDF5WorkerUnload);
+  local->unloadFile();
+  epicsMutexLock(this->mutex);
+  chunkDims.clear();
+  epicsMutexUnlock(this->mutex);
+}
+
+std::vector<std::string> SimHDF5ProcessReader::getDatasetKeys()
+{
+  return local->getDatasetKeys();
+}
+
+std::vector<hsize_t> SimHDF5ProcessReader::getDatasetDimensions(const std::string& dname)
+{
+  return local->getDatasetDimensions(dname);
+}
+
+NDDataType_t SimHDF5ProcessReader::getDatasetType(const std::string& dname)
+{
+  return local->getDatasetType(dname);
+}
+
+/** Datasets are prepared by each worker when it first reads them.
+  *
+  */
+void SimHDF5ProcessReader::prepareToReadDataset(const std::string& dname)
+{
+}
+
+bool SimHDF5ProcessReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data)
+{
+  SimHDF5WorkerRequest request;
+  makeRequest(SimHDF5WorkerReadImage, dname, minX, minY, sizeX, sizeY, wdim, hdim, -1, NULL, 1, &request);
+  return read(request, data);
+}
+
+bool SimHDF5ProcessReader::readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, void *data)
+{
+  SimHDF5WorkerRequest request;
+  makeRequest(SimHDF5WorkerReadFrame, dname, minX, minY, sizeX, sizeY, wdim, hdim, -1, indexes, 1, &request);
+  return read(request, data);
+}
+
+bool SimHDF5ProcessReader::readColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes, void *data)
+{
+  SimHDF5WorkerRequest request;
+  makeRequest(SimHDF5WorkerReadColor, dname, minX, minY, sizeX, sizeY, wdim, hdim, cdim, indexes, 1, &request);
+  return read(request, data);
+}
+
+bool SimHDF5ProcessReader::readFramesFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, int nframes, void *data)
+{
+  SimHDF5WorkerRequest request;
+  makeRequest(SimHDF5WorkerReadFrames, dname, minX, minY, sizeX, sizeY, wdim, hdim, -1, indexes, nframes, &request);
+  return read(request, data);
+}
+
+void SimHDF5ProcessReader::cleanupDataset()
+{
+  broadcast(SimHDF5WorkerCleanup);
+  local->cleanupDataset();
+}
+
+/** Start reading a frame that will be needed soon in an idle worker.
+  *
+  * Stacked arrays are hinted a frame at a time, and their reads are split
+  * into frames that match these hints.
+  */
+void SimHDF5ProcessReader::prefetchFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes)
+{
+  SimHDF5WorkerRequest request;
+  makeRequest(SimHDF5WorkerReadFrame, dname, minX, minY, sizeX, sizeY, wdim, hdim, -1, indexes, 1, &request);
+  prefetch(request);
+}
+
+/** Start reading a three colour image that will be needed soon in an idle worker.
+  *
+  */
+void SimHDF5ProcessReader::prefetchColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes)
+{
+  SimHDF5WorkerRequest request;
+  makeRequest(SimHDF5WorkerReadColor, dname, minX, minY, sizeX, sizeY, wdim, hdim, cdim, indexes, 1, &request);
+  prefetch(request);
+}
+
+/** Give a read that will be needed soon to an idle worker.
+  * \param[in] request the read.
+  *
+  * The hint is dropped if every worker is busy or holds a frame that has
+  * not been collected yet.
+  */
+void SimHDF5ProcessReader::prefetch(const SimHDF5WorkerRequest& request)
+{
+  epicsMutexLock(this->mutex);
+  if (!holding(request)){
+    Worker *worker = idle();
+    if (worker){
+      send(*worker, request);
+    }
+  }
+  epicsMutexUnlock(this->mutex);
+}
+
+void SimHDF5ProcessReader::dropCache()
+{
+  local->dropCache();
+}
+
+/** Select the read engine used by the workers.
+  *
+  */
+void SimHDF5ProcessReader::setReadEngine(int engine, int queueDepth, bool directIO, int readahead)
+{
+  engineType = engine;
+  engineQueueDepth = queueDepth;
+  engineDirectIO = directIO;
+  engineReadahead = readahead;
+  activeEngine = SimHDF5EngineHDF5;
+  broadcast(SimHDF5WorkerConfigure);
+}
+
+/** Return the read engine the workers used for their last read.
+  *
+  */
+int SimHDF5ProcessReader::getReadEngine()
+{
+  return activeEngine;
+}
+
+/** Select the file driver the workers open the file with.
+  *
+  */
+void SimHDF5ProcessReader::setFileDriver(int driver)
+{
+  fileDriver = driver;
+}
+
+bool SimHDF5ProcessReader::readColumn(const std::string& path, std::vector<double>& values, bool *integer)
+{
+  return local->readColumn(path, values, integer);
+}
+
+/** Return the number of worker processes still running.
+  *
+  */
+int SimHDF5ProcessReader::getWorkers()
+{
+  int count = 0;
+  epicsMutexLock(this->mutex);
+  for (size_t index = 0; index < workers.size(); index++){
+    if (workers[index].pid > 0){
+      count++;
+    }
+  }
+  epicsMutexUnlock(this->mutex);
+  return count;
+}
@@ -0,0 +1,151 @@
+/*
+ * SimHDF5ProcessReader.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5PROCESSREADER_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5PROCESSREADER_H_
+
+#include <sys/types.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <tr1/memory>
+#include <epicsMutex.h>
+#include "NDArray.h"
+#include "SimHDF5Reader.h"
+#include "SimHDF5FileReader.h"
+
+// Longest file or dataset name passed to a worker process
+#define SIMHDF5_WORKER_PATH_LEN 1024
+// Most frame indexes passed with a read
+#define SIMHDF5_WORKER_MAX_INDEXES 32
+// Smallest frame in bytes that is split between the workers
+#define SIMHDF5_WORKER_SPLIT_BYTES (256*1024)
+
+/** Request sent to a reader worker process */
+struct SimHDF5WorkerRequest
+{
+  int command;                // One of the commands handled by workerMain
+  int kind;                   // Which read function is called for a read
+  char path[SIMHDF5_WORKER_PATH_LEN]; // File name to open or dataset name to read
+  int minX;                   // Region of the frame to read
+  int minY;
+  int sizeX;
+  int sizeY;
+  int wdim;                   // Dataset dimensions used for the width, height and colour
+  int hdim;
+  int cdim;
+  int nframes;                // Number of consecutive frames read
+  int nindexes;               // Number of frame indexes used
+  hsize_t indexes[SIMHDF5_WORKER_MAX_INDEXES]; // Frame indexes in the non-image dimensions
+  size_t bytes;               // Size of the frame data in bytes
+  int engine;                 // Read engine settings for a configure
+  int queueDepth;
+  int directIO;
+  int readahead;
+  int driver;                 // File driver used to open the file
+};
+
+/** Reply from a reader worker process */
+struct SimHDF5WorkerReply
+{
+  int status;                 // 0 on success, -1 if the file could not be opened or the frames read
+  int engine;                 // Read engine used by the worker
+};
+
+/** Reader that reads frames in forked worker processes.
+  *
+  * HDF5 serialises every call behind one library lock, so readers in the
+  * same process never read in parallel.  Each worker process has its own
+  * copy of the library and its own SimHDF5FileReader, and leaves frames in a
+  * shared memory slot of its own.  The slots of the workers form a ring:
+  * reads and prefetch hints are handed out to the workers in turn, so up to
+  * one frame per worker is read and decompressed at the same time, and a
+  * frame that was prefetched is copied straight from its slot.  A read that
+  * no worker has prefetched is split between the workers: a stack into its
+  * frames and a large single frame into bands of whole chunk rows, so the
+  * workers read in parallel even without readahead.
+  *
+  * The workers are forked when the reader is created, which must happen
+  * before the IOC starts using HDF5 from other threads.  Dataset names,
+  * sizes and types are read in this process, and only frame reads go to
+  * the workers.  A worker that dies is not restarted, and its reads are
+  * made in this process instead.
+  */
+class SimHDF5ProcessReader : public SimHDF5Reader
+{
+public:
+  SimHDF5ProcessReader(int workers);
+  virtual ~SimHDF5ProcessReader();
+  void setFilename(const std::string &filename);
+  std::string getFilename();
+  bool validateFilename();
+  int fileExists();
+  bool loadFile();
+  void unloadFile();
+
+  std::vector<std::string> getDatasetKeys();
+  std::vector<hsize_t> getDatasetDimensions(const std::string& dname);
+  NDDataType_t getDatasetType(const std::string& dname);
+  void prepareToReadDataset(const std::string& dname);
+  bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data);
+  bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, void *data);
+  bool readColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes, void *data);
+  bool readFramesFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, int nframes, void *data);
+  void cleanupDataset();
+  void prefetchFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes);
+  void prefetchColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes);
+  void dropCache();
+  void setReadEngine(int engine, int queueDepth, bool directIO, int readahead);
+  int getReadEngine();
+  void setFileDriver(int driver);
+  bool readColumn(const std::string& path, std::vector<double>& values, bool *integer);
+  int getWorkers();
+
+private:
+  /** State of a worker process as seen from this process */
+  struct Worker
+  {
+    pid_t pid;                // Process ID, 0 once the worker has died
+    int socket;               // Socket carrying requests and replies
+    int shmFd;                // Shared memory holding the slot of the worker
+    void *slot;               // Slot mapped into this process
+    size_t slotBytes;         // Size of the slot
+    bool busy;                // A request has been sent and not yet answered
+    bool ready;               // The slot holds the frame of the last read
+    SimHDF5WorkerRequest request; // Last request sent
+  };
+
+  void startWorkers(int count);
+  bool send(Worker& worker, const SimHDF5WorkerRequest& request);
+  bool collect(Worker& worker);
+  void poll(Worker& worker);
+  void broadcast(int command);
+  void failed(Worker& worker);
+  bool sameFrames(const SimHDF5WorkerRequest& a, const SimHDF5WorkerRequest& b);
+  Worker *holding(const SimHDF5WorkerRequest& request);
+  Worker *idle();
+  void makeRequest(int kind, const std::string& dname, int minX, int minY, int sizeX, int sizeY,
+                   int wdim, int hdim, int cdim, hsize_t *indexes, int nframes, SimHDF5WorkerRequest *request);
+  void splitRequest(const SimHDF5WorkerRequest& request, std::vector<SimHDF5WorkerRequest>& parts, std::vector<size_t>& offsets);
+  bool read(const SimHDF5WorkerRequest& request, void *data);
+  bool finish(Worker *worker, const SimHDF5WorkerRequest& request, void *data);
+  bool readLocal(const SimHDF5WorkerRequest& request, void *data);
+  void prefetch(const SimHDF5WorkerRequest& request);
+
+  std::tr1::shared_ptr<SimHDF5FileReader> local; // Reads names, sizes and types, and frames when no worker can
+  std::vector<Worker> workers;                   // Worker processes
+  size_t nextWorker;                             // Worker given the next request that is not already in flight
+  epicsMutexId mutex;                            // Protects the workers
+  int engineType;                                // Requested read engine
+  int engineQueueDepth;
+  bool engineDirectIO;
+  int engineReadahead;
+  int activeEngine;                              // Read engine reported by the last worker read
+  int fileDriver;                                // File driver the workers open the file with
+  std::map<std::string, std::vector<hsize_t> > chunkDims; // Chunk dimensions of each dataset read, empty if not chunked
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5PROCESSREADER_H_ */
@@ -6,6 +6,7 @@
  */
 
 #include "SimHDF5Reader.h"
+#include <string.h>
 
 SimHDF5Reader::SimHDF5Reader ()
 {
@@ -18,3 +19,255 @@ SimHDF5Reader::~SimHDF5Reader ()
   // TODO Auto-generated destructor stub
 }
 
+/** Release the resources held for one prepared dataset.
+  * \param[in] dname Name of the dataset
+  *
+  * Several datasets may be prepared for reading at once so that the next
+  * one is ready before it is switched to.  This releases a dataset that is
+  * no longer being read without disturbing the others.  The default
+  * implementation does nothing, everything is released by cleanupDataset.
+  */
+void SimHDF5Reader::releaseDataset(const std::string& dname)
+{
+}
+
+/** Hint that a frame will be read soon.
+  * \param[in] dname Name of the dataset
+  * \param[in] minX offset of data in x dimension
+  * \param[in] minY offset of data in y dimension
+  * \param[in] sizeX ROI of data in x dimension
+  * \param[in] sizeY ROI of data in y dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[in] indexes index values for additional dimensions
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::prefetchFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes)
+{
+}
+
+/** Hint that a three colour image will be read soon.
+  * \param[in] dname Name of the dataset
+  * \param[in] minX offset of data in x dimension
+  * \param[in] minY offset of data in y dimension
+  * \param[in] sizeX ROI of data in x dimension
+  * \param[in] sizeY ROI of data in y dimension
+  * \param[in] wdim specified dimension number for x dimension
+  * \param[in] hdim specified dimension number for y dimension
+  * \param[in] cdim specified dimension number for colour dimension
+  * \param[in] indexes index values for additional dimensions
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::prefetchColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes)
+{
+}
+
+/** Drop any cached file data so that subsequent reads are cold.
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::dropCache()
+{
+}
+
+/** Select the engine used to read frames from the next dataset prepared.
+  * \param[in] engine SimHDF5EngineHDF5 or SimHDF5EngineChunk
+  * \param[in] queueDepth maximum number of reads to keep in flight
+  * \param[in] directIO bypass the page cache with O_DIRECT
+  * \param[in] readahead number of frames prefetched ahead of the reads
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::setReadEngine(int engine, int queueDepth, bool directIO, int readahead)
+{
+}
+
+/** Return the engine actually being used to read frames.
+  *
+  * The default implementation always reads through HDF5.
+  */
+int SimHDF5Reader::getReadEngine()
+{
+  return SimHDF5EngineHDF5;
+}
+
+/** Select the virtual file driver used the next time the file is loaded.
+  * \param[in] driver one of the SimHDF5Driver_t values
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::setFileDriver(int driver)
+{
+}
+
+/** Select whether preloaded frames are held in shared memory.
+  * \param[in] shared share the frames with other IOCs on the host
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::setSharedStore(bool shared)
+{
+}
+
+/** Select the directory used for snapshots of preloaded frames.
+  * \param[in] dir directory path, empty to disable snapshots
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::setSnapshotDir(const std::string& dir)
+{
+}
+
+/** Select the NUMA node that preloaded frames are placed on.
+  * \param[in] node the node, or -1 to leave placement to the kernel
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::setNumaNode(int node)
+{
+}
+
+/** Select whether preloaded frames are locked into memory.
+  * \param[in] lock lock the frames, or unlock them
+  * \return 0, or the error number of the first lock that failed.
+  *
+  * The default implementation does nothing.
+  */
+int SimHDF5Reader::setLockMemory(bool lock)
+{
+  return 0;
+}
+
+/** Number of bytes of preloaded frames locked into memory.
+  *
+  * The default implementation returns 0.
+  */
+size_t SimHDF5Reader::getLockedBytes()
+{
+  return 0;
+}
+
+/** Error number of the last lock of preloaded frames that failed, 0 if none did.
+  *
+  * The default implementation returns 0.
+  */
+int SimHDF5Reader::getLockError()
+{
+  return 0;
+}
+
+/** Read a one dimensional dataset of numbers, such as frame timestamps.
+  * \param[in] path full path of the dataset in the file
+  * \param[out] values the values, converted to double
+  * \param[out] integer set if the values are integers, such as frame numbers
+  * \return false if the dataset cannot be read.
+  *
+  * The default implementation reads nothing.
+  */
+bool SimHDF5Reader::readColumn(const std::string& path, std::vector<double>& values, bool *integer)
+{
+  *integer = false;
+  return false;
+}
+
+/** Load the next part of a dataset into memory in the background.
+  * \param[in] dname Name of the dataset
+  * \param[out] done number of bytes of the dataset loaded
+  * \param[out] total size of the dataset in bytes
+  * \return true while more of the dataset remains to be loaded.
+  *
+  * The default implementation loads nothing and returns false.
+  */
+bool SimHDF5Reader::preloadDataset(const std::string& dname, size_t *done, size_t *total)
+{
+  *done = 0;
+  *total = 0;
+  return false;
+}
+
+/** Stop a preload and release the frames loaded so far.
+  *
+  * The default implementation does nothing.
+  */
+void SimHDF5Reader::cancelPreload()
+{
+}
+
+/** Read a one dimensional dataset of numbers from an open file.
+  * \param[in] file the open file
+  * \param[in] path full path of the dataset in the file
+  * \param[out] values the values, converted to double
+  * \param[out] integer set if the values are integers, such as frame numbers
+  * \return false if the dataset does not exist or is not a numeric column.
+  *
+  * Values are scaled to seconds when the dataset has a units attribute of
+  * ms, us or ns.  Datasets of more than one dimension are read in storage
+  * order.
+  */
+bool SimHDF5Reader::readColumnFromFile(hid_t file, const std::string& path, std::vector<double>& values, bool *integer)
+{
+  hid_t dset = -1;
+  values.clear();
+  *integer = false;
+  if (file < 0 || path.empty()){
+    return false;
+  }
+  H5E_BEGIN_TRY {
+    dset = H5Dopen(file, path.c_str(), H5P_DEFAULT);
+  } H5E_END_TRY;
+  if (dset < 0){
+    return false;
+  }
+  hid_t type = H5Dget_type(dset);
+  H5T_class_t typeClass = H5Tget_class(type);
+  H5Tclose(type);
+  hid_t dspace = H5Dget_space(dset);
+  hssize_t npoints = H5Sget_simple_extent_npoints(dspace);
+  H5Sclose(dspace);
+  if ((typeClass != H5T_INTEGER && typeClass != H5T_FLOAT) || npoints <= 0){
+    H5Dclose(dset);
+    return false;
+  }
+  values.resize(npoints);
+  if (H5Dread(dset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &values[0]) < 0){
+    values.clear();
+    H5Dclose(dset);
+    return false;
+  }
+
+  // Scale to seconds if the units say otherwise
+  double scale = 1.0;
+  if (H5Aexists(dset, "units") > 0){
+    hid_t attr = H5Aopen(dset, "units", H5P_DEFAULT);
+    hid_t atype = H5Aget_type(attr);
+    char units[16] = "";
+    if (H5Tget_class(atype) == H5T_STRING && !H5Tis_variable_str(atype) && H5Tget_size(atype) < sizeof(units)){
+      H5Aread(attr, atype, units);
+    } else if (H5Tget_class(atype) == H5T_STRING && H5Tis_variable_str(atype)){
+      char *text = NULL;
+      if (H5Aread(attr, atype, &text) >= 0 && text){
+        strncpy(units, text, sizeof(units)-1);
+        H5free_memory(text);
+      }
+    }
+    H5Tclose(atype);
+    H5Aclose(attr);
+    if (strcmp(units, "ms") == 0){
+      scale = 1.0e-3;
+    } else if (strcmp(units, "us") == 0){
+      scale = 1.0e-6;
+    } else if (strcmp(units, "ns") == 0){
+      scale = 1.0e-9;
+    }
+  }
+  if (scale != 1.0){
+    for (size_t index = 0; index < values.size(); index++){
+      values[index] *= scale;
+    }
+  }
+  *integer = (typeClass == H5T_INTEGER && scale == 1.0);
+  H5Dclose(dset);
+  return true;
+}
@@ -15,6 +15,23 @@
 #include <tr1/memory>
 #include "NDArray.h"
 
+/** Enumeration of the engines that can be used to read frames */
+typedef enum
+{
+  SimHDF5EngineHDF5,          // Frames are read with H5Dread
+  SimHDF5EngineChunk,         // Raw chunks are read with pread and decoded in user space
+  SimHDF5EngineUring          // Raw chunks are read in batches through io_uring
+} SimHDF5Engine_t;
+
+/** Enumeration of the HDF5 virtual file drivers used to open the file */
+typedef enum
+{
+  SimHDF5DriverSec2,          // Default POSIX driver, reads go through the page cache
+  SimHDF5DriverDirect,        // O_DIRECT driver, reads bypass the page cache
+  SimHDF5DriverCore,          // Whole file held in memory by the core driver
+  SimHDF5DriverImage          // Whole file read sequentially into a file image
+} SimHDF5Driver_t;
+
 class SimHDF5Reader
 {
 public:
@@ -25,15 +42,38 @@ public:
   virtual std::string getFilename() = 0;
   virtual bool validateFilename() = 0;
   virtual int fileExists() = 0;
-  virtual void loadFile() = 0;
+  virtual bool loadFile() = 0;
   virtual void unloadFile() = 0;
   virtual std::vector<std::string> getDatasetKeys() = 0;
-  virtual std::vector<int> getDatasetDimensions(const std::string& dname) = 0;
+  virtual std::vector<hsize_t> getDatasetDimensions(const std::string& dname) = 0;
   virtual NDDataType_t getDatasetType(const std::string& dname) = 0;
   virtual void prepareToReadDataset(const std::string& dname) = 0;
-  virtual void readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data) = 0;
-  virtual void readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int *indexes, void *data) = 0;
+  virtual bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, void *data) = 0;
+  virtual bool readFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, void *data) = 0;
+  virtual bool readColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes, void *data) = 0;
+  virtual bool readFramesFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes, int nframes, void *data) = 0;
   virtual void cleanupDataset() = 0;
+
+  // Optional hints for readers that can make use of them
+  virtual void releaseDataset(const std::string& dname);
+  virtual void prefetchFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, hsize_t *indexes);
+  virtual void prefetchColorFromDataset(const std::string& dname, int minX, int minY, int sizeX, int sizeY, int wdim, int hdim, int cdim, hsize_t *indexes);
+  virtual void dropCache();
+  virtual void setReadEngine(int engine, int queueDepth, bool directIO, int readahead);
+  virtual int getReadEngine();
+  virtual void setFileDriver(int driver);
+  virtual void setSharedStore(bool shared);
+  virtual void setSnapshotDir(const std::string& dir);
+  virtual void setNumaNode(int node);
+  virtual int setLockMemory(bool lock);
+  virtual size_t getLockedBytes();
+  virtual int getLockError();
+  virtual bool readColumn(const std::string& path, std::vector<double>& values, bool *integer);
+  virtual bool preloadDataset(const std::string& dname, size_t *done, size_t *total);
+  virtual void cancelPreload();
+
+protected:
+  static bool readColumnFromFile(hid_t file, const std::string& path, std::vector<double>& values, bool *integer);
 };
 
 #endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5READER_H_ */
@@ -0,0 +1,202 @@
+/*
+ * SimHDF5SyncGroup.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <epicsThread.h>
+#include "SimHDF5SyncGroup.h"
+
+// Number of frames whose first publication time is remembered
+#define SIMHDF5_SYNC_HISTORY 256
+
+static epicsThreadOnceId registryOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId registryMutex = 0;
+static std::map<std::string, SimHDF5SyncGroup *> groups;
+
+/** Create the mutex that protects the registry of groups, run once. */
+static void createRegistry(void *arg)
+{
+  registryMutex = epicsMutexMustCreate();
+}
+
+/** Constructor.
+  * \param[in] name name the group is found by.
+  */
+SimHDF5SyncGroup::SimHDF5SyncGroup(const std::string& name) :
+  name(name),
+  arrivals(0),
+  generation(0)
+{
+  this->mutex = epicsMutexMustCreate();
+  this->startTime.secPastEpoch = 0;
+  this->startTime.nsec = 0;
+}
+
+/** Destructor.
+  */
+SimHDF5SyncGroup::~SimHDF5SyncGroup()
+{
+  epicsMutexDestroy(this->mutex);
+}
+
+/** Join a group, creating it if no member has joined it before.
+  * \param[in] name name of the group.
+  * \param[in] member the joining member.
+  * \param[in] wakeEvent event signalled when the start barrier is released.
+  * \return the group.
+  *
+  * Called from IOC threads, so the registry is created on first use.  The
+  * member is added with the registry held so that the last member leaving
+  * cannot free the group in between.
+  */
+SimHDF5SyncGroup *SimHDF5SyncGroup::join(const std::string& name, void *member, epicsEventId wakeEvent)
+{
+  epicsThreadOnce(&registryOnce, createRegistry, NULL);
+  epicsMutexLock(registryMutex);
+  SimHDF5SyncGroup *group = groups[name];
+  if (!group){
+    group = new SimHDF5SyncGroup(name);
+    groups[name] = group;
+  }
+  epicsMutexLock(group->mutex);
+  Member entry;
+  entry.wakeEvent = wakeEvent;
+  entry.arrived = false;
+  group->members[member] = entry;
+  epicsMutexUnlock(group->mutex);
+  epicsMutexUnlock(registryMutex);
+  return group;
+}
+
+/** Leave the group.
+  * \param[in] member the leaving member.
+  *
+  * Members still waiting at the start barrier are released if they were
+  * only waiting for this member.  The group is freed once its last member
+  * has left, so it must not be used by the caller afterwards.
+  */
+void SimHDF5SyncGroup::leave(void *member)
+{
+  epicsMutexLock(registryMutex);
+  epicsMutexLock(this->mutex);
+  std::map<void *, Member>::iterator iter = this->members.find(member);
+  if (iter != this->members.end()){
+    if (iter->second.arrived){
+      this->arrivals--;
+    }
+    this->members.erase(iter);
+    releaseIfComplete();
+  }
+  bool empty = this->members.empty();
+  epicsMutexUnlock(this->mutex);
+  if (empty){
+    groups.erase(this->name);
+    delete this;
+  }
+  epicsMutexUnlock(registryMutex);
+}
+
+/** Return the number of members of the group.
+  */
+int SimHDF5SyncGroup::getMembers()
+{
+  epicsMutexLock(this->mutex);
+  int count = (int)this->members.size();
+  epicsMutexUnlock(this->mutex);
+  return count;
+}
+
+/** Arrive at the start barrier.
+  * \param[in] member the arriving member.
+  * \return ticket passed to released.
+  *
+  * The last member to arrive releases the barrier.
+  */
+int SimHDF5SyncGroup::arrive(void *member)
+{
+  epicsMutexLock(this->mutex);
+  int ticket = this->generation;
+  std::map<void *, Member>::iterator iter = this->members.find(member);
+  if (iter != this->members.end() && !iter->second.arrived){
+    iter->second.arrived = true;
+    this->arrivals++;
+    releaseIfComplete();
+  }
+  epicsMutexUnlock(this->mutex);
+  return ticket;
+}
+
+/** Check whether the start barrier has been released since a member arrived.
+  * \param[in] ticket ticket returned when the member arrived.
+  * \param[out] start the shared start time, set once released.
+  * \return true once released.
+  */
+bool SimHDF5SyncGroup::released(int ticket, epicsTimeStamp *start)
+{
+  epicsMutexLock(this->mutex);
+  bool done = (this->generation != ticket);
+  if (done){
+    *start = this->startTime;
+  }
+  epicsMutexUnlock(this->mutex);
+  return done;
+}
+
+/** Stop waiting at the start barrier.
+  * \param[in] member the member that has stopped or given up waiting.
+  */
+void SimHDF5SyncGroup::withdraw(void *member)
+{
+  epicsMutexLock(this->mutex);
+  std::map<void *, Member>::iterator iter = this->members.find(member);
+  if (iter != this->members.end() && iter->second.arrived){
+    iter->second.arrived = false;
+    this->arrivals--;
+  }
+  epicsMutexUnlock(this->mutex);
+}
+
+/** Record that a member has published a frame.
+  * \param[in] frame index of the frame counted from the shared start.
+  * \param[in] when time the frame was published.
+  * \return time in seconds that the member lags the first member to publish the frame.
+  */
+double SimHDF5SyncGroup::published(size_t frame, const epicsTimeStamp& when)
+{
+  double lag = 0.0;
+  epicsMutexLock(this->mutex);
+  std::map<size_t, epicsTimeStamp>::iterator iter = this->firstPublished.find(frame);
+  if (iter == this->firstPublished.end()){
+    this->firstPublished[frame] = when;
+    // Forget frames that every member has long since published
+    while (!this->firstPublished.empty() && this->firstPublished.begin()->first + SIMHDF5_SYNC_HISTORY <= frame){
+      this->firstPublished.erase(this->firstPublished.begin());
+    }
+  } else {
+    epicsTimeStamp first = iter->second;
+    lag = epicsTimeDiffInSeconds(&when, &first);
+  }
+  epicsMutexUnlock(this->mutex);
+  return lag;
+}
+
+/** Release the start barrier if every member has arrived.
+  *
+  * Called with the group mutex held.  The start time is taken now, and
+  * every member is woken.
+  */
+void SimHDF5SyncGroup::releaseIfComplete()
+{
+  if (this->arrivals == 0 || this->arrivals < (int)this->members.size()){
+    return;
+  }
+  epicsTimeGetCurrent(&this->startTime);
+  this->generation++;
+  this->arrivals = 0;
+  this->firstPublished.clear();
+  for (std::map<void *, Member>::iterator iter = this->members.begin(); iter != this->members.end(); ++iter){
+    iter->second.arrived = false;
+    epicsEventSignal(iter->second.wakeEvent);
+  }
+}
@@ -0,0 +1,59 @@
+/*
+ * SimHDF5SyncGroup.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5SYNCGROUP_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5SYNCGROUP_H_
+
+#include <string>
+#include <map>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+
+/** Group of detectors in one IOC that start together on a shared clock.
+  *
+  * Groups are found by name, created by the first member to join and freed
+  * when the last member leaves.  Each member arrives at the start barrier
+  * when its acquisition starts, and once every member has arrived they are
+  * all released with the same start time.
+  * Members pace their frames from that time, so frames with the same index
+  * have the same deadline and time stamp on every member.  Members report
+  * when they publish each frame, and the group measures how far each member
+  * lags the first to publish the same frame.
+  */
+class SimHDF5SyncGroup
+{
+public:
+  static SimHDF5SyncGroup *join(const std::string& name, void *member, epicsEventId wakeEvent);
+  void leave(void *member);
+  int getMembers();
+  int arrive(void *member);
+  bool released(int ticket, epicsTimeStamp *start);
+  void withdraw(void *member);
+  double published(size_t frame, const epicsTimeStamp& when);
+
+private:
+  SimHDF5SyncGroup(const std::string& name);
+  ~SimHDF5SyncGroup();
+  void releaseIfComplete();
+
+  /** Member of the group */
+  struct Member
+  {
+    epicsEventId wakeEvent;   // Event signalled when the start barrier is released
+    bool arrived;             // Is the member waiting at the start barrier
+  };
+
+  std::string name;                                   // Name the group is found by
+  epicsMutexId mutex;                                 // Protects the state of the group
+  std::map<void *, Member> members;                   // Members of the group
+  int arrivals;                                       // Members waiting at the start barrier
+  int generation;                                     // Number of times the barrier has been released
+  epicsTimeStamp startTime;                           // Start time given at the last release
+  std::map<size_t, epicsTimeStamp> firstPublished;    // Earliest time each recent frame was published
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5SYNCGROUP_H_ */
@@ -0,0 +1,73 @@
+/*
+ * SimHDF5ViewPool.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "SimHDF5ViewPool.h"
+
+/** NDArray created by the view pool, which remembers the NDArray it views */
+class SimHDF5ViewArray : public NDArray
+{
+public:
+  SimHDF5ViewArray() : NDArray(), pParent(NULL) {}
+  NDArray *pParent;           // NDArray whose memory is shared, NULL when the view is free
+};
+
+/** Constructor.
+  * \param[in] pDriver the driver publishing the views.
+  *
+  * The pool has no memory limit as the memory belongs to the viewed NDArrays.
+  */
+SimHDF5ViewPool::SimHDF5ViewPool(asynNDArrayDriver *pDriver) :
+  NDArrayPool(pDriver, 0)
+{
+}
+
+/** Create a view of part of an NDArray.
+  * \param[in] pParent the NDArray to view.
+  * \param[in] ndims number of dimensions of the view.
+  * \param[in] dims size of each dimension of the view.
+  * \param[in] offset offset of the view from the start of the parent data in bytes.
+  * \param[in] bytes size of the view in bytes.
+  * \return the view, or NULL if it cannot be created.
+  *
+  * The parent is reserved until the view is released by its last user.
+  */
+NDArray *SimHDF5ViewPool::view(NDArray *pParent, int ndims, size_t *dims, size_t offset, size_t bytes)
+{
+  pParent->reserve();
+  NDArray *pView = alloc(ndims, dims, pParent->dataType, bytes, (char *)pParent->pData + offset);
+  if (!pView){
+    pParent->release();
+    return NULL;
+  }
+  ((SimHDF5ViewArray *)pView)->pParent = pParent;
+  return pView;
+}
+
+/** Create the NDArray objects handed out by the pool.
+  *
+  */
+NDArray *SimHDF5ViewPool::createArray()
+{
+  return new SimHDF5ViewArray();
+}
+
+/** Release the viewed NDArray once the last user of a view has released it.
+  * \param[in] pArray the view.
+  *
+  * The data pointer is cleared so that the pool never frees or reuses
+  * memory belonging to the parent.
+  */
+void SimHDF5ViewPool::onReleaseArray(NDArray *pArray)
+{
+  SimHDF5ViewArray *pView = (SimHDF5ViewArray *)pArray;
+  if (pView->getReferenceCount() == 0 && pView->pParent){
+    NDArray *pParent = pView->pParent;
+    pView->pParent = NULL;
+    pView->pData = NULL;
+    pView->dataSize = 0;
+    pParent->release();
+  }
+}
@@ -0,0 +1,32 @@
+/*
+ * SimHDF5ViewPool.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SIMHDF5DETECTORAPP_SRC_SIMHDF5VIEWPOOL_H_
+#define SIMHDF5DETECTORAPP_SRC_SIMHDF5VIEWPOOL_H_
+
+#include <stddef.h>
+#include "NDArray.h"
+
+/** Pool of NDArrays that share the memory of part of another NDArray.
+  *
+  * A view holds a reference to the NDArray it was taken from, which is
+  * released when the last user of the view releases it, so the memory is
+  * not reused while the view is in use.  Only a region that is contiguous
+  * in memory can be viewed.  The pool never allocates or frees data
+  * buffers itself.
+  */
+class SimHDF5ViewPool : public NDArrayPool
+{
+public:
+  SimHDF5ViewPool(asynNDArrayDriver *pDriver);
+  NDArray *view(NDArray *pParent, int ndims, size_t *dims, size_t offset, size_t bytes);
+
+protected:
+  virtual NDArray *createArray();
+  virtual void onReleaseArray(NDArray *pArray);
+};
+
+#endif /* SIMHDF5DETECTORAPP_SRC_SIMHDF5VIEWPOOL_H_ */